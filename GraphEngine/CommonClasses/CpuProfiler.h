@@ -0,0 +1,137 @@
+#pragma once
+
+// Define GRE_CPU_PROFILING before including the engine to record zones, otherwise the profiling macros compile to nothing
+#ifdef GRE_CPU_PROFILING
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include "Functions.h"
+
+
+namespace gre {
+    // Zones of CPU time, every thread writes its zones into its own ring buffer without locks
+    class CpuProfiler {
+    public:
+        struct Zone {
+            // Zone names are string literals, only pointers are stored
+            const char* name = nullptr;
+            // Nanoseconds of the steady clock
+            int64_t begin = 0;
+            int64_t end = 0;
+        };
+
+    private:
+        inline static const size_t CAPACITY = 1 << 16;
+
+        struct ThreadBuffer {
+            size_t thread_id = 0;
+            // Number of zones written since the start, older zones are overwritten
+            std::atomic<size_t> count_zones = 0;
+            std::vector<Zone> zones = std::vector<Zone>(CAPACITY);
+        };
+
+        // Buffer is returned for reuse when its thread finishes, so short worker jobs do not allocate new buffers
+        struct ThreadHandle {
+            ThreadBuffer* buffer = nullptr;
+
+            ~ThreadHandle() {
+                if (buffer != nullptr) {
+                    std::lock_guard<std::mutex> lock(threads_mutex_);
+                    free_threads_.push_back(buffer);
+                }
+            }
+        };
+
+        inline static std::mutex threads_mutex_;
+        // Buffers outlive their threads, so zones of finished worker jobs are exported too
+        inline static std::vector<std::unique_ptr<ThreadBuffer>> threads_;
+        inline static std::vector<ThreadBuffer*> free_threads_;
+
+        // The mutex is locked only once per thread, when it takes a buffer
+        static ThreadBuffer& get_thread_buffer() {
+            thread_local ThreadHandle handle;
+            if (handle.buffer == nullptr) {
+                std::lock_guard<std::mutex> lock(threads_mutex_);
+                if (free_threads_.empty()) {
+                    threads_.push_back(std::make_unique<ThreadBuffer>());
+                    threads_.back()->thread_id = threads_.size();
+                    free_threads_.push_back(threads_.back().get());
+                }
+                handle.buffer = free_threads_.back();
+                free_threads_.pop_back();
+            }
+            return *handle.buffer;
+        }
+
+    public:
+        static int64_t get_time() noexcept {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static void record(const char* name, int64_t begin, int64_t end) {
+            ThreadBuffer& buffer = get_thread_buffer();
+            size_t count_zones = buffer.count_zones.load(std::memory_order_relaxed);
+            buffer.zones[count_zones % CAPACITY] = { name, begin, end };
+            buffer.count_zones.store(count_zones + 1, std::memory_order_release);
+        }
+
+        // Writes the last zones of all threads as Chrome trace events, the file is opened by chrome://tracing and Perfetto
+        // Zones which threads write during saving may be lost, so it is called between frames
+        static void save_trace(const std::string& path) {
+            std::ofstream trace_file(path);
+            if (trace_file.fail()) {
+                throw GreRuntimeError(__FILE__, __LINE__, "save_trace, failed to open the trace file.\n\n");
+            }
+
+            std::lock_guard<std::mutex> lock(threads_mutex_);
+            trace_file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+            bool first = true;
+            for (const std::unique_ptr<ThreadBuffer>& buffer : threads_) {
+                size_t count_zones = buffer->count_zones.load(std::memory_order_acquire);
+                for (size_t i = count_zones - std::min(count_zones, CAPACITY); i < count_zones; ++i) {
+                    const Zone& zone = buffer->zones[i % CAPACITY];
+                    trace_file << (first ? "" : ",") << "\n{\"name\":\"" << zone.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread_id;
+                    trace_file << ",\"ts\":" << zone.begin / 1000 << "." << std::setfill('0') << std::setw(3) << zone.begin % 1000;
+                    trace_file << ",\"dur\":" << (zone.end - zone.begin) / 1000 << "." << std::setw(3) << (zone.end - zone.begin) % 1000 << "}";
+                    first = false;
+                }
+            }
+            trace_file << "\n]}\n";
+        }
+    };
+
+
+    // Records the time from construction to destruction of the zone
+    class CpuProfilerZone {
+        const char* name_;
+        int64_t begin_;
+
+    public:
+        explicit CpuProfilerZone(const char* name) noexcept : name_(name), begin_(CpuProfiler::get_time()) {
+        }
+
+        CpuProfilerZone(const CpuProfilerZone& other) = delete;
+
+        CpuProfilerZone& operator=(const CpuProfilerZone& other) = delete;
+
+        ~CpuProfilerZone() {
+            CpuProfiler::record(name_, begin_, CpuProfiler::get_time());
+        }
+    };
+}
+
+#define GRE_PROFILE_CONCAT_IMPL(left, right) left##right
+#define GRE_PROFILE_CONCAT(left, right) GRE_PROFILE_CONCAT_IMPL(left, right)
+#define GRE_PROFILE_ZONE(name) gre::CpuProfilerZone GRE_PROFILE_CONCAT(gre_profile_zone_, __LINE__)(name)
+#define GRE_PROFILE_SAVE(path) gre::CpuProfiler::save_trace(path)
+
+#else
+
+#define GRE_PROFILE_ZONE(name)
+#define GRE_PROFILE_SAVE(path)
+
+#endif
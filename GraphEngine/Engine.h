@@ -2,6 +2,7 @@
 
 #include "CommonClasses/Plane.h"
 #include "Engine/GraphEngine.h"
+#include "Engine/HeadlessContext.h"
 #include "Light/DirLight.h"
 #include "Light/PointLight.h"
 #include "Light/SpotLight.h"
@@ -155,30 +155,33 @@ namespace gre {
             set_projection_matrix();
         }
 
-        void set_viewport(const Shader<size_t>& shader) const {
+        // Viewport position is counted from the top of the frame buffer
+        void set_viewport(const Shader<size_t>& shader, GLsizei frame_buffer_height) const {
             if (shader.description != ShaderType::POST) {
                 throw GreInvalidArgument(__FILE__, __LINE__, "set_viewport, invalid shader type.\n\n");
             }
 
-            glViewport(static_cast<GLint>(viewport_position_.x), static_cast<GLint>(window_->getSize().y - viewport_size_.y - viewport_position_.y), static_cast<GLsizei>(viewport_size_.x), static_cast<GLsizei>(viewport_size_.y));
+            glViewport(static_cast<GLint>(viewport_position_.x), static_cast<GLint>(frame_buffer_height - viewport_size_.y - viewport_position_.y), static_cast<GLsizei>(viewport_size_.x), static_cast<GLsizei>(viewport_size_.y));
             check_gl_errors(__FILE__, __LINE__, __func__);
-
-            shader.set_uniform_f("screen_texture_size", static_cast<GLfloat>(viewport_size_.x / window_->getSize().x), static_cast<GLfloat>(viewport_size_.y / window_->getSize().y));
         }
 
         void set_uniforms(const Shader<size_t>& shader) const {
+            set_uniforms(shader, viewport_size_);
+        }
+
+        // Render_size - size of the frame buffer in pixels, smaller than the viewport size when resolution is scaled
+        void set_uniforms(const Shader<size_t>& shader, const Vec2& render_size) const {
             if (shader.description != ShaderType::MAIN) {
                 throw GreInvalidArgument(__FILE__, __LINE__, "set_uniforms, invalid shader type.\n\n");
             }
 
-            glViewport(0, 0, static_cast<GLsizei>(viewport_size_.x), static_cast<GLsizei>(viewport_size_.y));
+            glViewport(0, 0, static_cast<GLsizei>(render_size.x), static_cast<GLsizei>(render_size.y));
             check_gl_errors(__FILE__, __LINE__, __func__);
 
             
-            shader.set_uniform_f("check_point", static_cast<GLfloat>(check_point_.x * viewport_size_.x), static_cast<GLfloat>(check_point_.y * viewport_size_.y));
+            shader.set_uniform_f("check_point", static_cast<GLfloat>(check_point_.x * render_size.x), static_cast<GLfloat>(check_point_.y * render_size.y));
             shader.set_uniform_f("view_pos", position);
-            shader.set_uniform_matrix("view", get_view_matrix());
-            shader.set_uniform_matrix("projection", projection_);
+            shader.set_uniform_matrix("view_projection", projection_ * get_view_matrix());
         }
         
         // Position_on_width, position_on_height - proportions relative to overall size
@@ -0,0 +1,488 @@
+#pragma once
+
+#include <tuple>
+#include "GraphObjectStorage.h"
+
+
+namespace gre {
+	// Multi draw indirect submission, meshes with equal render state are drawn by one call
+	class DrawBatcher {
+		// Layout of DrawElementsIndirectCommand
+		struct DrawCommand {
+			GLuint count = 0;
+			GLuint instance_count = 0;
+			GLuint first_index = 0;
+			GLint base_vertex = 0;
+			GLuint base_instance = 0;
+		};
+
+		// std430 layout of DrawData in main and depth shaders
+		struct DrawData {
+			GLfloat ambient[4] = { 0.0, 0.0, 0.0, 0.0 };
+			GLfloat diffuse[4] = { 0.0, 0.0, 0.0, 0.0 };
+			GLfloat specular[4] = { 0.0, 0.0, 0.0, 0.0 };
+			GLfloat emission[4] = { 0.0, 0.0, 0.0, 0.0 };
+			GLfloat position_offset[4] = { 0.0, 0.0, 0.0, 0.0 };
+			GLfloat position_scale[4] = { 1.0, 1.0, 1.0, 0.0 };
+			GLfloat shininess = 1.0;
+			GLfloat alpha = 1.0;
+			GLint object_id = 0;
+			GLint flags = 0;
+		};
+
+		// std430 layout of CullObject in culling shaders, sphere in model space
+		struct CullObject {
+			GLfloat sphere[4] = { 0.0, 0.0, 0.0, 0.0 };
+			GLuint first_instance = 0;
+			GLuint count_instances = 0;
+			GLuint padding[2] = { 0, 0 };
+		};
+
+		// Vertex format, primitive type, line width, border mask and texture ids
+		using BucketKey = std::tuple<uint8_t, GLenum, GLfloat, uint8_t, GLuint, GLuint, GLuint>;
+
+		struct Bucket {
+			BucketKey key;
+			size_t first_command = 0;
+			size_t count_commands = 0;
+		};
+
+		inline static const GLuint DRAW_DATA_BINDING = 1;
+		inline static const GLuint CULL_OBJECTS_BINDING = 2;
+		inline static const GLuint INPUT_MODELS_BINDING = 3;
+		inline static const GLuint OUTPUT_MODELS_BINDING = 4;
+		inline static const GLuint OUTPUT_MODEL_IDS_BINDING = 5;
+		inline static const GLuint VISIBLE_INSTANCES_BINDING = 6;
+		inline static const GLuint COMMAND_OBJECTS_BINDING = 7;
+		inline static const GLuint DRAW_COMMANDS_BINDING = 8;
+		inline static const GLuint CULL_GROUP_SIZE = 64;
+		inline static const GLint SHADOW_FLAG = 1;
+		inline static const GLint VERTEX_COLOR_FLAG = 2;
+
+		ShaderType pass_ = ShaderType::MAIN;
+
+		GLuint command_buffer_ = 0;
+		GLuint draw_data_buffer_ = 0;
+		GLuint instance_buffer_ = 0;
+
+		GLuint cull_object_buffer_ = 0;
+		GLuint command_object_buffer_ = 0;
+		GLuint visible_instance_buffer_ = 0;
+		GLuint culled_instance_buffer_ = 0;
+		GLuint culled_model_id_buffer_ = 0;
+
+		bool culled_ = false;
+		std::vector<Bucket> buckets_;
+		size_t count_commands_ = 0;
+		size_t count_instances_ = 0;
+		size_t count_cull_objects_ = 0;
+		size_t count_draw_calls_ = 0;
+
+		static void set_vec(GLfloat* destination, const Vec3& source) noexcept {
+			for (size_t i = 0; i < 3; ++i) {
+				destination[i] = static_cast<GLfloat>(source[i]);
+			}
+		}
+
+		static DrawData get_draw_data(const Mesh& mesh, size_t object_id) noexcept {
+			DrawData data;
+			set_vec(data.ambient, mesh.material.get_ambient());
+			set_vec(data.diffuse, mesh.material.get_diffuse());
+			set_vec(data.specular, mesh.material.get_specular());
+			set_vec(data.emission, mesh.material.get_emission());
+			set_vec(data.position_offset, mesh.get_position_offset());
+			set_vec(data.position_scale, mesh.get_position_scale());
+			data.shininess = static_cast<GLfloat>(mesh.material.get_shininess());
+			data.alpha = static_cast<GLfloat>(mesh.material.get_alpha());
+			data.object_id = static_cast<GLint>(object_id);
+			data.flags = (mesh.material.shadow ? SHADOW_FLAG : 0) | (mesh.material.use_vertex_color ? VERTEX_COLOR_FLAG : 0);
+			return data;
+		}
+
+		BucketKey get_bucket_key(const GraphObject& object, const Mesh& mesh) const noexcept {
+			GLenum mode = mesh.frame ? GL_LINE_LOOP : GL_TRIANGLES;
+			if (pass_ == ShaderType::DEPTH) {
+				return BucketKey(mesh.get_quantization(), mode, mesh.get_border_width(), 0, 0, 0, 0);
+			}
+
+			const Material& material = mesh.material;
+			return BucketKey(mesh.get_quantization(), mode, mesh.get_border_width(), object.border_mask, material.diffuse_map.get_id(), material.specular_map.get_id(), material.emission_map.get_id());
+		}
+
+		bool is_drawn(const GraphObject& object, const Mesh& mesh) const noexcept {
+			if (!mesh.is_allocated() || mesh.get_count_indices() == 0) {
+				return false;
+			}
+			if (pass_ == ShaderType::DEPTH) {
+				return mesh.material.shadow;
+			}
+			return !object.transparent;
+		}
+
+		void set_bucket_state(const Bucket& bucket, const Shader<size_t>& shader) const {
+			const auto& [format, mode, border_width, border_mask, diffuse_map, specular_map, emission_map] = bucket.key;
+
+			if (culled_) {
+				GeometryArena::get(format).bind(culled_instance_buffer_, culled_model_id_buffer_);
+			} else {
+				GeometryArena::get(format).bind(instance_buffer_);
+			}
+			glLineWidth(border_width);
+
+			if (pass_ == ShaderType::MAIN) {
+				shader.set_uniform_i("use_diffuse_map", diffuse_map != 0);
+				shader.set_uniform_i("use_specular_map", specular_map != 0);
+				shader.set_uniform_i("use_emission_map", emission_map != 0);
+
+				std::vector<GLuint> textures = { diffuse_map, specular_map, emission_map };
+				for (GLuint i = 0; i < textures.size(); ++i) {
+					glActiveTexture(GL_TEXTURE0 + i);
+					glBindTexture(GL_TEXTURE_2D, textures[i]);
+				}
+				glActiveTexture(GL_TEXTURE0);
+
+				if (border_mask > 0) {
+					glStencilFunc(GL_ALWAYS, border_mask, 0xFF);
+					glStencilMask(border_mask);
+				}
+			}
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void delete_bucket_state(const Bucket& bucket) const {
+			const auto& [format, mode, border_width, border_mask, diffuse_map, specular_map, emission_map] = bucket.key;
+
+			glLineWidth(1.0);
+			if (pass_ == ShaderType::MAIN && border_mask > 0) {
+				glStencilMask(0x00);
+			}
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void create_buffers() {
+			glGenBuffers(1, &command_buffer_);
+			glGenBuffers(1, &draw_data_buffer_);
+			glGenBuffers(1, &instance_buffer_);
+			glGenBuffers(1, &cull_object_buffer_);
+			glGenBuffers(1, &command_object_buffer_);
+			glGenBuffers(1, &visible_instance_buffer_);
+			glGenBuffers(1, &culled_instance_buffer_);
+			glGenBuffers(1, &culled_model_id_buffer_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void deallocate() {
+			glDeleteBuffers(1, &command_buffer_);
+			glDeleteBuffers(1, &draw_data_buffer_);
+			glDeleteBuffers(1, &instance_buffer_);
+			glDeleteBuffers(1, &cull_object_buffer_);
+			glDeleteBuffers(1, &command_object_buffer_);
+			glDeleteBuffers(1, &visible_instance_buffer_);
+			glDeleteBuffers(1, &culled_instance_buffer_);
+			glDeleteBuffers(1, &culled_model_id_buffer_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			command_buffer_ = 0;
+			draw_data_buffer_ = 0;
+			instance_buffer_ = 0;
+			cull_object_buffer_ = 0;
+			command_object_buffer_ = 0;
+			visible_instance_buffer_ = 0;
+			culled_instance_buffer_ = 0;
+			culled_model_id_buffer_ = 0;
+		}
+
+		static CullObject get_cull_object(const GraphObject& object, size_t first_instance) {
+			CullObject cull_object;
+			cull_object.first_instance = static_cast<GLuint>(first_instance);
+			cull_object.count_instances = static_cast<GLuint>(object.models.size());
+
+			Vec3 bounding_min(0.0);
+			Vec3 bounding_max(0.0);
+			object.get_bounding_box(bounding_min, bounding_max);
+
+			set_vec(cull_object.sphere, (bounding_min + bounding_max) / 2.0);
+			cull_object.sphere[3] = static_cast<GLfloat>((bounding_max - bounding_min).length() / 2.0);
+			return cull_object;
+		}
+
+	public:
+		DrawBatcher() noexcept {
+		}
+
+		// pass - MAIN for opaque objects, DEPTH for shadow casters
+		explicit DrawBatcher(ShaderType pass) {
+			if (!glew_is_ok()) {
+				throw GreRuntimeError(__FILE__, __LINE__, "DrawBatcher, failed to initialize GLEW.\n\n");
+			}
+			if (pass != ShaderType::MAIN && pass != ShaderType::DEPTH) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "DrawBatcher, invalid pass type.\n\n");
+			}
+
+			pass_ = pass;
+			create_buffers();
+		}
+
+		DrawBatcher(const DrawBatcher& other) {
+			pass_ = other.pass_;
+			if (other.command_buffer_ != 0) {
+				create_buffers();
+			}
+		}
+
+		DrawBatcher(DrawBatcher&& other) noexcept {
+			swap(other);
+		}
+
+		DrawBatcher& operator=(const DrawBatcher& other)& {
+			DrawBatcher object(other);
+			swap(object);
+			return *this;
+		}
+
+		DrawBatcher& operator=(DrawBatcher&& other)& noexcept {
+			deallocate();
+			swap(other);
+			return *this;
+		}
+
+		// Collects commands of the visible meshes, instance matrices are copied on the GPU
+		DrawBatcher& build(const GraphObjectStorage& objects) {
+			if (command_buffer_ == 0) {
+				throw GreRuntimeError(__FILE__, __LINE__, "build, buffers are not created.\n\n");
+			}
+
+			count_instances_ = 0;
+			for (const auto& [object_id, object] : objects) {
+				count_instances_ += object.models.size();
+			}
+
+			glBindBuffer(GL_COPY_WRITE_BUFFER, instance_buffer_);
+			glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLfloat) * 16 * std::max(count_instances_, static_cast<size_t>(1)), NULL, GL_STREAM_DRAW);
+
+			std::vector<std::tuple<BucketKey, DrawCommand, DrawData, GLuint>> draws;
+			std::vector<CullObject> cull_objects;
+			size_t base_instance = 0;
+			for (const auto& [object_id, object] : objects) {
+				size_t count_models = object.models.size();
+				if (count_models == 0) {
+					continue;
+				}
+
+				GLuint cull_object_index = static_cast<GLuint>(cull_objects.size());
+				cull_objects.push_back(get_cull_object(object, base_instance));
+
+				glBindBuffer(GL_COPY_READ_BUFFER, object.models.get_matrix_buffer());
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, sizeof(GLfloat) * 16 * base_instance, sizeof(GLfloat) * 16 * count_models);
+
+				for (const auto& [mesh_id, mesh] : object.meshes) {
+					if (!is_drawn(object, mesh)) {
+						continue;
+					}
+
+					DrawCommand command;
+					command.count = static_cast<GLuint>(mesh.get_count_indices());
+					command.instance_count = static_cast<GLuint>(count_models);
+					command.first_index = static_cast<GLuint>(mesh.get_first_index());
+					command.base_vertex = static_cast<GLint>(mesh.get_base_vertex());
+					command.base_instance = static_cast<GLuint>(base_instance);
+					draws.emplace_back(get_bucket_key(object, mesh), command, get_draw_data(mesh, object_id), cull_object_index);
+				}
+				base_instance += count_models;
+			}
+
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+			std::stable_sort(draws.begin(), draws.end(), [](const auto& left, const auto& right) { return std::get<0>(left) < std::get<0>(right); });
+
+			buckets_.clear();
+			std::vector<DrawCommand> commands(draws.size());
+			std::vector<DrawData> draw_data(draws.size());
+			std::vector<GLuint> command_objects(draws.size());
+			for (size_t i = 0; i < draws.size(); ++i) {
+				if (buckets_.empty() || buckets_.back().key != std::get<0>(draws[i])) {
+					buckets_.push_back({ std::get<0>(draws[i]), i, 0 });
+				}
+				++buckets_.back().count_commands;
+
+				commands[i] = std::get<1>(draws[i]);
+				draw_data[i] = std::get<2>(draws[i]);
+				command_objects[i] = std::get<3>(draws[i]);
+			}
+			count_commands_ = commands.size();
+			count_cull_objects_ = cull_objects.size();
+			culled_ = false;
+
+			if (!commands.empty()) {
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+				glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * commands.size(), &commands[0], GL_STREAM_DRAW);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, draw_data_buffer_);
+				glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawData) * draw_data.size(), &draw_data[0], GL_STREAM_DRAW);
+
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_object_buffer_);
+				glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * command_objects.size(), &command_objects[0], GL_STREAM_DRAW);
+
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_object_buffer_);
+				glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(CullObject) * cull_objects.size(), &cull_objects[0], GL_STREAM_DRAW);
+
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, visible_instance_buffer_);
+				glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * cull_objects.size(), NULL, GL_STREAM_DRAW);
+
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, culled_instance_buffer_);
+				glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * 16 * count_instances_, NULL, GL_STREAM_DRAW);
+
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, culled_model_id_buffer_);
+				glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * count_instances_, NULL, GL_STREAM_DRAW);
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			}
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return *this;
+		}
+
+		// Frustum culls all instances on the GPU and rewrites instance counts of the built commands
+		DrawBatcher& cull(const Shader<size_t>& cull_shader, const Shader<size_t>& commands_shader, const Matrix& view_projection) {
+			if (cull_shader.description != ShaderType::CULLING || commands_shader.description != ShaderType::CULLING) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "cull, invalid shader type.\n\n");
+			}
+			if (count_commands_ == 0) {
+				return *this;
+			}
+
+			GLuint zero = 0;
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, visible_instance_buffer_);
+			glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_OBJECTS_BINDING, cull_object_buffer_);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INPUT_MODELS_BINDING, instance_buffer_);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OUTPUT_MODELS_BINDING, culled_instance_buffer_);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OUTPUT_MODEL_IDS_BINDING, culled_model_id_buffer_);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_INSTANCES_BINDING, visible_instance_buffer_);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_OBJECTS_BINDING, command_object_buffer_);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COMMANDS_BINDING, command_buffer_);
+
+			cull_shader.set_uniform_ui("number_objects", static_cast<GLuint>(count_cull_objects_));
+			cull_shader.set_uniform_ui("number_instances", static_cast<GLuint>(count_instances_));
+			cull_shader.set_uniform_matrix("view_projection", view_projection);
+			cull_shader.dispatch(static_cast<GLuint>((count_instances_ + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE));
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			commands_shader.set_uniform_ui("number_commands", static_cast<GLuint>(count_commands_));
+			commands_shader.dispatch(static_cast<GLuint>((count_commands_ + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE));
+			glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+			for (GLuint binding = CULL_OBJECTS_BINDING; binding <= DRAW_COMMANDS_BINDING; ++binding) {
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+			}
+
+			culled_ = true;
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return *this;
+		}
+
+		void draw(const Shader<size_t>& shader) {
+			if (shader.description != pass_) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "draw, invalid shader type.\n\n");
+			}
+
+			count_draw_calls_ = 0;
+			if (count_commands_ == 0) {
+				return;
+			}
+
+			shader.set_uniform_i("indirect_draw", true);
+			shader.set_uniform_i("use_instance_model_ids", culled_);
+			shader.set_uniform_i("model_id", -1);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, draw_data_buffer_);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+
+			for (const Bucket& bucket : buckets_) {
+				set_bucket_state(bucket, shader);
+
+				GLenum mode = std::get<1>(bucket.key);
+				if (GLEW_ARB_shader_draw_parameters) {
+					shader.set_uniform_i("draw_offset", static_cast<GLint>(bucket.first_command));
+					glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, reinterpret_cast<GLvoid*>(sizeof(DrawCommand) * bucket.first_command), static_cast<GLsizei>(bucket.count_commands), 0);
+					++count_draw_calls_;
+				} else {
+					// Without gl_DrawIDARB the draw data index is passed through uniform
+					for (size_t i = bucket.first_command; i < bucket.first_command + bucket.count_commands; ++i) {
+						shader.set_uniform_i("draw_offset", static_cast<GLint>(i));
+						glDrawElementsIndirect(mode, GL_UNSIGNED_INT, reinterpret_cast<GLvoid*>(sizeof(DrawCommand) * i));
+						++count_draw_calls_;
+					}
+				}
+
+				delete_bucket_state(bucket);
+			}
+
+			glBindVertexArray(0);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, 0);
+			shader.set_uniform_i("indirect_draw", false);
+			shader.set_uniform_i("use_instance_model_ids", false);
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		size_t get_count_commands() const noexcept {
+			return count_commands_;
+		}
+
+		// Reads back the culling result, stalls until the culling pass is finished
+		size_t get_count_visible_instances() const {
+			if (!culled_) {
+				return count_instances_;
+			}
+
+			std::vector<GLuint> visible_instances(count_cull_objects_);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, visible_instance_buffer_);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * visible_instances.size(), &visible_instances[0]);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return get_value<size_t>(visible_instances.begin(), visible_instances.end(), 0, [](auto element, auto* result) { *result += element; });
+		}
+
+		size_t get_count_instances() const noexcept {
+			return count_instances_;
+		}
+
+		size_t get_count_buckets() const noexcept {
+			return buckets_.size();
+		}
+
+		// Number of API draw calls issued by the last draw
+		size_t get_count_draw_calls() const noexcept {
+			return count_draw_calls_;
+		}
+
+		void swap(DrawBatcher& other) noexcept {
+			std::swap(pass_, other.pass_);
+			std::swap(command_buffer_, other.command_buffer_);
+			std::swap(draw_data_buffer_, other.draw_data_buffer_);
+			std::swap(instance_buffer_, other.instance_buffer_);
+			std::swap(cull_object_buffer_, other.cull_object_buffer_);
+			std::swap(command_object_buffer_, other.command_object_buffer_);
+			std::swap(visible_instance_buffer_, other.visible_instance_buffer_);
+			std::swap(culled_instance_buffer_, other.culled_instance_buffer_);
+			std::swap(culled_model_id_buffer_, other.culled_model_id_buffer_);
+			std::swap(culled_, other.culled_);
+			std::swap(buckets_, other.buckets_);
+			std::swap(count_commands_, other.count_commands_);
+			std::swap(count_instances_, other.count_instances_);
+			std::swap(count_cull_objects_, other.count_cull_objects_);
+			std::swap(count_draw_calls_, other.count_draw_calls_);
+		}
+
+		~DrawBatcher() {
+			deallocate();
+		}
+	};
+}
@@ -2,70 +2,275 @@
 
 #include "CamerasStorage.h"
 #include "DefaultControlSystem.h"
+#include "DrawBatcher.h"
 #include "GraphObjectStorage.h"
+#include "LightClusters.h"
 #include "LightStorage.h"
-#include "../GraphicClasses/Kernel.h"
+#include "LodSelector.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "PostProcessor.h"
+#include "RenderContext.h"
+#include "RenderTarget.h"
+#include "TransparentSorter.h"
+#include "ViewCuller.h"
+#include "../GraphicClasses/FrameReader.h"
+#include "../GraphicClasses/GpuProfiler.h"
+#include "../GraphicClasses/TimerQuery.h"
 
 
 namespace gre {
 	class GraphEngine {
-		class TransparentObject {
-			double distance_;
-
-		public:
-			size_t object_id;
-			size_t model_id;
-			const GraphObject* object;
-
-			TransparentObject(const Vec3& camera_position, const GraphObject* object, size_t object_id, size_t model_id) noexcept {
-				this->object_id = object_id;
-				this->model_id = model_id;
-				this->object = object;
-				distance_ = (camera_position - object->get_center(model_id)).length();
-			}
-
-			bool operator<(const TransparentObject& other) const noexcept {
-				return distance_ < other.distance_;
-			}
+	public:
+		// GPU time of render passes in milliseconds for all cameras and lights
+		struct PassTimes {
+			double shadow = 0.0;
+			double depth_pre_pass = 0.0;
+			double opaque = 0.0;
+			double lighting = 0.0;
+			double transparent = 0.0;
+			double post = 0.0;
 		};
 
-		inline static GLuint screen_vertex_array_ = 0;
+	private:
+		// Render scale changes by steps so that render targets are not recreated every frame
+		inline static const double RENDER_SCALE_STEP = 0.05;
+		// Resolution is raised only if the frame is faster than this part of the target time
+		inline static const double RENDER_SCALE_HYSTERESIS = 0.8;
+		// Frames between changes of the render scale, timer results are read with a delay of several frames
+		inline static const size_t RENDER_SCALE_DELAY = 8;
 
-		GLuint screen_texture_id_ = 0;
-		GLuint depth_stencil_texture_id_ = 0;
-		GLuint primary_frame_buffer_ = 0;
+		inline static GLuint screen_vertex_array_ = 0;
 
 		bool grayscale_ = false;
+		bool indirect_drawing_ = false;
+		bool gpu_culling_ = false;
+		bool occlusion_culling_ = false;
+		bool occlusion_queries_ = false;
+		bool conditional_render_ = true;
+		bool lod_selection_ = false;
+		bool incremental_sorting_ = true;
+		bool weighted_transparency_ = false;
+		bool depth_pre_pass_ = false;
+		bool opaque_sorting_ = false;
+		bool pass_timing_ = false;
+		bool shadow_caching_ = true;
+		bool shadow_fitting_ = false;
+		bool light_clustering_ = true;
+		bool deferred_shading_ = false;
+		bool view_culling_ = false;
+		bool dynamic_resolution_ = false;
+		bool gpu_profiling_ = false;
+		size_t count_triangles_ = 0;
+		size_t count_shadow_casters_ = 0;
+		size_t render_scale_delay_ = 0;
 		uint32_t border_width_ = 7;
+		double render_scale_ = 1.0;
+		double min_render_scale_ = 0.5;
+		double max_render_scale_ = 1.0;
+		double target_frame_time_ = 1000.0 / 60.0;
 		double gamma_ = 2.2;
 		Vec3 border_color_ = Vec3(1.0, 0.0, 0.0);
 		Vec3 clear_color_ = Vec3(0.0);
-		Kernel kernel_ = Kernel();
 
+		// Declared before GL objects, so they are deleted while the context exists
+		std::shared_ptr<RenderContext> context_;
 		Shader<size_t> main_shader_;
 		Shader<size_t> depth_shader_;
 		Shader<size_t> post_shader_;
-		sf::RenderWindow* window_;
+		Shader<size_t> lighting_shader_;
+		Shader<size_t> cull_shader_;
+		Shader<size_t> cull_commands_shader_;
+		Shader<size_t> bounds_shader_;
+		DrawBatcher main_batcher_;
+		DrawBatcher depth_batcher_;
+		PostProcessor post_processor_;
+		std::map<size_t, RenderTarget> render_targets_;
+		std::map<size_t, ViewCuller> view_cullers_;
+		std::map<size_t, OcclusionCuller> occlusion_cullers_;
+		std::map<size_t, OcclusionQueries> camera_queries_;
+		std::map<size_t, OcclusionQueries> light_queries_;
+		std::map<size_t, LodSelector> camera_lods_;
+		// Keys are pairs of light id and cascade, projected sizes differ between cascades
+		std::map<std::pair<size_t, size_t>, LodSelector> light_lods_;
+		std::map<size_t, TransparentSorter> transparent_sorters_;
+		std::map<size_t, LightClusters> light_clusters_;
+		TimerQuery shadow_timer_;
+		TimerQuery depth_pre_pass_timer_;
+		TimerQuery opaque_timer_;
+		TimerQuery lighting_timer_;
+		TimerQuery transparent_timer_;
+		TimerQuery post_timer_;
+		TimerQuery frame_timer_;
+		GpuProfiler gpu_profiler_;
+		FrameReader frame_reader_;
 		
 		void set_active() const {
-			if (!window_->setActive(true)) {
-				throw GreRuntimeError(__FILE__, __LINE__, "set_active, failed to activate window.\n\n");
-			}
+			context_->set_active();
 		}
 
 		void set_uniforms() const {
 			main_shader_.set_uniform_i("diffuse_map", 0);
 			main_shader_.set_uniform_i("specular_map", 1);
 			main_shader_.set_uniform_i("emission_map", 2);
-			main_shader_.set_uniform_i("shadow_maps", 3);
+			main_shader_.set_uniform_i("shadow_atlas", 3);
 			main_shader_.set_uniform_f("gamma", static_cast<GLfloat>(gamma_));
 
+			lighting_shader_.set_uniform_i("ambient_texture", 0);
+			lighting_shader_.set_uniform_i("diffuse_texture", 1);
+			lighting_shader_.set_uniform_i("specular_texture", 2);
+			lighting_shader_.set_uniform_i("emission_texture", 3);
+			lighting_shader_.set_uniform_i("normal_texture", 4);
+			lighting_shader_.set_uniform_i("depth_texture", 5);
+			lighting_shader_.set_uniform_i("shadow_atlas", 6);
+			lighting_shader_.set_uniform_f("gamma", static_cast<GLfloat>(gamma_));
+
 			post_shader_.set_uniform_i("screen_texture", 0);
 			post_shader_.set_uniform_i("stencil_texture", 1);
+			post_shader_.set_uniform_i("accumulation_texture", 2);
+			post_shader_.set_uniform_i("revealage_texture", 3);
+			post_shader_.set_uniform_i("outline_texture", 4);
 			post_shader_.set_uniform_i("grayscale", grayscale_);
-			post_shader_.set_uniform_i("border_width", border_width_);
 			post_shader_.set_uniform_f("border_color", border_color_);
-			kernel_.set_uniforms(post_shader_);
+		}
+
+		OcclusionQueries* begin_occlusion_queries(std::map<size_t, OcclusionQueries>& occlusion_queries, size_t id, const Matrix& view_projection) {
+			if (!occlusion_queries_ || indirect_drawing_) {
+				return nullptr;
+			}
+
+			OcclusionQueries& result = occlusion_queries[id];
+			result.set_conditional_render(conditional_render_);
+			result.begin_frame(objects, view_projection);
+			return &result;
+		}
+
+		template <typename Key>
+		LodSelector* begin_lod_selection(std::map<Key, LodSelector>& lod_selectors, const Key& id, const Matrix& view_projection) {
+			if (!lod_selection_) {
+				return nullptr;
+			}
+
+			LodSelector& result = lod_selectors[id];
+			result.begin_frame(objects, view_projection);
+			return &result;
+		}
+
+		// Profiler scopes are also debug groups for GPU debuggers
+		void begin_profiler_scope(const std::string& name) {
+			push_gl_debug_group(name);
+			if (gpu_profiling_) {
+				gpu_profiler_.begin(name);
+			}
+		}
+
+		void end_profiler_scope() {
+			if (gpu_profiling_) {
+				gpu_profiler_.end();
+			}
+			pop_gl_debug_group();
+		}
+
+		void begin_pass_timer(TimerQuery& timer, const std::string& name) {
+			if (pass_timing_) {
+				timer.begin();
+			}
+			begin_profiler_scope(name);
+		}
+
+		void end_pass_timer(TimerQuery& timer) {
+			if (pass_timing_) {
+				timer.end();
+			}
+			end_profiler_scope();
+		}
+
+		// Resolution is lowered in proportion to the GPU frame time over the target and raised by one step if the frame is fast enough
+		void update_render_scale() {
+			frame_timer_.begin_frame();
+			if (render_scale_delay_ > 0) {
+				--render_scale_delay_;
+				return;
+			}
+
+			double frame_time = frame_timer_.get_elapsed_time();
+			double render_scale = render_scale_;
+			if (target_frame_time_ < frame_time) {
+				render_scale = std::min(render_scale_ - RENDER_SCALE_STEP, std::floor(render_scale_ * std::sqrt(target_frame_time_ / frame_time) / RENDER_SCALE_STEP) * RENDER_SCALE_STEP);
+			} else if (0.0 < frame_time && frame_time < RENDER_SCALE_HYSTERESIS * target_frame_time_) {
+				render_scale = render_scale_ + RENDER_SCALE_STEP;
+			}
+
+			render_scale = std::min(std::max(render_scale, min_render_scale_), max_render_scale_);
+			if (!equality(render_scale, render_scale_)) {
+				render_scale_ = render_scale;
+				render_scale_delay_ = RENDER_SCALE_DELAY;
+			}
+		}
+
+		// Draws models of the object which are not culled, models with equal level of detail are drawn by one instanced call when possible
+		// depth_pre_pass - depth shader draws all opaque meshes instead of shadow casters
+		// frustum - models with bounding boxes outside of this view projection are culled
+		void draw_object(size_t object_id, const GraphObject& object, const Shader<size_t>& shader, const ViewCuller* view_culler, const OcclusionCuller* occlusion_culler, LodSelector* lod_selector, bool depth_pre_pass = false, const Matrix* frustum = nullptr) {
+			auto draw_models = [&](size_t lod) {
+				if (shader.description != ShaderType::DEPTH) {
+					object.draw(shader, lod);
+				} else if (depth_pre_pass) {
+					object.draw_depth_pre_pass(shader, lod);
+				} else {
+					object.draw_depth_map(shader, lod);
+				}
+			};
+			auto draw_model = [&](size_t model_id, size_t lod) {
+				if (shader.description != ShaderType::DEPTH) {
+					object.draw(model_id, shader, lod);
+				} else if (depth_pre_pass) {
+					object.draw_depth_pre_pass(model_id, shader, lod);
+				} else {
+					object.draw_depth_map(model_id, shader, lod);
+				}
+			};
+
+			if (lod_selector == nullptr && frustum == nullptr && (view_culler == nullptr || !view_culler->is_culled(object_id)) && (occlusion_culler == nullptr || !occlusion_culler->is_culled(object_id))) {
+				draw_models(0);
+				count_triangles_ += object.models.size() * object.get_count_triangles();
+				return;
+			}
+
+			Vec3 bounding_min, bounding_max;
+			if (frustum != nullptr && !object.get_bounding_box(bounding_min, bounding_max)) {
+				return;
+			}
+
+			bool single_lod = true;
+			std::vector<std::pair<size_t, size_t>> visible_models;
+			for (const auto& [model_id, model] : object.models) {
+				if (view_culler != nullptr && view_culler->is_culled(object_id, model_id)) {
+					continue;
+				}
+				if (occlusion_culler != nullptr && occlusion_culler->is_culled(object_id, model_id, model)) {
+					continue;
+				}
+				if (frustum != nullptr && !intersects_frustum(*frustum * model, bounding_min, bounding_max)) {
+					continue;
+				}
+
+				size_t lod = lod_selector != nullptr ? lod_selector->select(object_id, model_id, object) : 0;
+				single_lod = single_lod && (visible_models.empty() || visible_models[0].second == lod);
+				visible_models.emplace_back(model_id, lod);
+			}
+
+			if (!visible_models.empty() && single_lod && visible_models.size() == object.models.size()) {
+				size_t lod = visible_models[0].second;
+				draw_models(lod);
+				count_triangles_ += object.models.size() * object.get_count_triangles(lod);
+				return;
+			}
+
+			for (const auto& [model_id, lod] : visible_models) {
+				draw_model(model_id, lod);
+				count_triangles_ += object.get_count_triangles(lod);
+			}
 		}
 
 		void init_gl() const {
@@ -79,114 +284,415 @@ namespace gre {
 			check_gl_errors(__FILE__, __LINE__, __func__);
 		}
 
-		void create_primary_frame_buffer() {
-			glGenTextures(1, &screen_texture_id_);
-			glBindTexture(GL_TEXTURE_2D, screen_texture_id_);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, window_->getSize().x, window_->getSize().y, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glBindTexture(GL_TEXTURE_2D, 0);
+		// Shades pixels of opaque objects from the geometry buffer, lighting runs once per pixel regardless of overdraw
+		void draw_deferred_lighting(const Camera& camera, const RenderTarget& render_target) {
+			glBindFramebuffer(GL_FRAMEBUFFER, render_target.lighting_frame_buffer_);
+			glDisable(GL_DEPTH_TEST);
+
+			Matrix view_projection = camera.get_projection_matrix() * camera.get_view_matrix();
+			lighting_shader_.set_uniform_f("view_pos", camera.position);
+			lighting_shader_.set_uniform_matrix("view_projection", view_projection);
+			lighting_shader_.set_uniform_matrix("inverse_view_projection", view_projection.inverse());
+
+			for (size_t i = 0; i < RenderTarget::COUNT_GEOMETRY_TEXTURES; ++i) {
+				glActiveTexture(static_cast<GLenum>(GL_TEXTURE0 + i));
+				glBindTexture(GL_TEXTURE_2D, render_target.geometry_texture_ids_[i]);
+			}
+			glActiveTexture(GL_TEXTURE5);
+			glBindTexture(GL_TEXTURE_2D, render_target.depth_stencil_texture_id_);
+			glTexParameteri(GL_TEXTURE_2D, GL_DEPTH_STENCIL_TEXTURE_MODE, GL_DEPTH_COMPONENT);
+			glActiveTexture(GL_TEXTURE6);
+			glBindTexture(GL_TEXTURE_2D, lights.depth_map_texture_id_);
+
+			glBindVertexArray(screen_vertex_array_);
+			lighting_shader_.use();
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+			glBindVertexArray(0);
 
-			glGenTextures(1, &depth_stencil_texture_id_);
-			glBindTexture(GL_TEXTURE_2D, depth_stencil_texture_id_);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, window_->getSize().x, window_->getSize().y, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+			glActiveTexture(GL_TEXTURE5);
 			glTexParameteri(GL_TEXTURE_2D, GL_DEPTH_STENCIL_TEXTURE_MODE, GL_STENCIL_INDEX);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-			GLfloat border_olor[] = { 0.0, 0.0, 0.0, 0.0 };
-			glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_olor);
-			glBindTexture(GL_TEXTURE_2D, 0);
+			// Transparent objects are drawn next and sample the shadow atlas from unit 3
+			for (GLenum unit = GL_TEXTURE0; unit <= GL_TEXTURE6; ++unit) {
+				glActiveTexture(unit);
+				glBindTexture(GL_TEXTURE_2D, unit == GL_TEXTURE3 ? lights.depth_map_texture_id_ : 0);
+			}
+			glActiveTexture(GL_TEXTURE0);
+
+			glEnable(GL_DEPTH_TEST);
+			glBindFramebuffer(GL_FRAMEBUFFER, render_target.primary_frame_buffer_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
 
-			glGenFramebuffers(1, &primary_frame_buffer_);
-			glBindFramebuffer(GL_FRAMEBUFFER, primary_frame_buffer_);
+		// Transparent models are drawn in any order into accumulation and revealage targets, depth is tested but not written
+		void draw_transparent_objects(const RenderTarget& render_target, const ViewCuller* view_culler, const OcclusionCuller* occlusion_culler, LodSelector* lod_selector) {
+			glBindFramebuffer(GL_FRAMEBUFFER, render_target.transparent_frame_buffer_);
+			GLfloat accumulation_clear[] = { 0.0, 0.0, 0.0, 0.0 };
+			GLfloat revealage_clear[] = { 1.0, 1.0, 1.0, 1.0 };
+			glClearBufferfv(GL_COLOR, 0, accumulation_clear);
+			glClearBufferfv(GL_COLOR, 1, revealage_clear);
 
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screen_texture_id_, 0);
-			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth_stencil_texture_id_, 0);
+			glDepthMask(GL_FALSE);
+			glBlendFunci(0, GL_ONE, GL_ONE);
+			glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+			main_shader_.set_uniform_i("weighted_transparency", true);
 
-			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-				throw GreRuntimeError(__FILE__, __LINE__, "create_primary_frame_buffer, framebuffer is not complete.\n\n");
+			for (const auto& [object_id, object] : objects) {
+				if (object.transparent) {
+					main_shader_.set_uniform_i("object_id", static_cast<GLint>(object_id));
+					draw_object(object_id, object, main_shader_, view_culler, occlusion_culler, lod_selector);
+				}
 			}
 
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			main_shader_.set_uniform_i("weighted_transparency", false);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			glDepthMask(GL_TRUE);
+
+			glBindFramebuffer(GL_FRAMEBUFFER, render_target.primary_frame_buffer_);
 			check_gl_errors(__FILE__, __LINE__, __func__);
 		}
 
-		void draw_objects(const Camera& camera) const {
-			std::vector<TransparentObject> transparent_objects;
+		// Opaque objects for direct drawing, with opaque sorting nearest objects go first to fail depth test of the rest early
+		std::vector<std::pair<size_t, const GraphObject*>> get_opaque_objects(const Camera& camera) const {
+			if (indirect_drawing_) {
+				return {};
+			}
+
+			std::vector<std::pair<double, std::pair<size_t, const GraphObject*>>> opaque_objects;
+
 			for (const auto& [object_id, object] : objects) {
 				if (object.transparent) {
+					continue;
+				}
+
+				double distance = 0.0;
+				Vec3 bounding_min, bounding_max;
+				if (opaque_sorting_ && object.get_bounding_box(bounding_min, bounding_max)) {
+					distance = std::numeric_limits<double>::infinity();
 					for (const auto& [model_id, model] : object.models) {
-						transparent_objects.emplace_back(camera.position, &object, object_id, model_id);
+						Vec3 offset = model * ((bounding_min + bounding_max) / 2.0) - camera.position;
+						distance = std::min(distance, offset * offset);
 					}
-					continue;
 				}
+				opaque_objects.push_back({ distance, { object_id, &object } });
+			}
 
+			if (opaque_sorting_) {
+				std::stable_sort(opaque_objects.begin(), opaque_objects.end(), [](const auto& left, const auto& right) {
+					return left.first < right.first;
+				});
+			}
+
+			std::vector<std::pair<size_t, const GraphObject*>> result;
+			result.reserve(opaque_objects.size());
+			for (const auto& [distance, object] : opaque_objects) {
+				result.push_back(object);
+			}
+			return result;
+		}
+
+		// Lays down depth of opaque meshes, so the shading pass runs the fragment shader about once per pixel
+		void draw_depth_pre_pass(const Camera& camera, const std::vector<std::pair<size_t, const GraphObject*>>& opaque_objects, const ViewCuller* view_culler, const OcclusionCuller* occlusion_culler, LodSelector* lod_selector) {
+			GLint stencil_mask = 0;
+			glGetIntegerv(GL_STENCIL_WRITEMASK, &stencil_mask);
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			glStencilMask(0x00);
+
+			depth_shader_.set_uniform_matrix("light_space", camera.get_projection_matrix() * camera.get_view_matrix());
+			for (const auto& [object_id, object] : opaque_objects) {
+				draw_object(object_id, *object, depth_shader_, view_culler, occlusion_culler, lod_selector, true);
+			}
+
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glStencilMask(static_cast<GLuint>(stencil_mask));
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void draw_objects(const Camera& camera, const RenderTarget& render_target, const ViewCuller* view_culler, const OcclusionCuller* occlusion_culler, OcclusionQueries* occlusion_queries, LodSelector* lod_selector, TransparentSorter& transparent_sorter) {
+			std::vector<std::pair<size_t, const GraphObject*>> opaque_objects = get_opaque_objects(camera);
+			if (depth_pre_pass_ && !indirect_drawing_) {
+				begin_pass_timer(depth_pre_pass_timer_, "depth pre-pass");
+				draw_depth_pre_pass(camera, opaque_objects, view_culler, occlusion_culler, lod_selector);
+				end_pass_timer(depth_pre_pass_timer_);
+
+				// Not GL_EQUAL: frames and meshes which may discard fragments are not in the pre-pass, their depth is not in the buffer yet
+				glDepthFunc(GL_LEQUAL);
+			}
+
+			begin_pass_timer(opaque_timer_, "opaque");
+			if (deferred_shading_) {
+				// Opaque objects only fill the geometry buffer, blending would mix its channels
+				glBindFramebuffer(GL_FRAMEBUFFER, render_target.geometry_frame_buffer_);
+				glDisable(GL_BLEND);
+				main_shader_.set_uniform_i("deferred_geometry", true);
+			}
+			for (const auto& [object_id, object_ptr] : opaque_objects) {
+				const GraphObject& object = *object_ptr;
 				main_shader_.set_uniform_i("object_id", static_cast<GLint>(object_id));
-				object.draw(main_shader_);
+				if (occlusion_queries != nullptr && (occlusion_culler == nullptr || !occlusion_culler->is_culled(object_id))) {
+					occlusion_queries->draw(object_id, object, bounds_shader_, [&]() {
+						draw_object(object_id, object, main_shader_, view_culler, nullptr, lod_selector);
+					});
+				} else {
+					draw_object(object_id, object, main_shader_, view_culler, occlusion_culler, lod_selector);
+				}
+			}
+
+			if (indirect_drawing_) {
+				main_batcher_.draw(main_shader_);
+			}
+			glDepthFunc(GL_LESS);
+			if (occlusion_queries != nullptr) {
+				occlusion_queries->end_frame(objects, bounds_shader_);
+			}
+			end_pass_timer(opaque_timer_);
+
+			if (deferred_shading_) {
+				main_shader_.set_uniform_i("deferred_geometry", false);
+				glEnable(GL_BLEND);
+
+				begin_pass_timer(lighting_timer_, "lighting");
+				draw_deferred_lighting(camera, render_target);
+				end_pass_timer(lighting_timer_);
+			}
+
+			begin_pass_timer(transparent_timer_, "transparent");
+			if (weighted_transparency_) {
+				draw_transparent_objects(render_target, view_culler, occlusion_culler, lod_selector);
+				end_pass_timer(transparent_timer_);
+				return;
+			}
+
+			transparent_sorter.clear();
+			for (const auto& [object_id, object] : objects) {
+				if (!object.transparent) {
+					continue;
+				}
+
+				for (const auto& [model_id, model] : object.models) {
+					if ((view_culler == nullptr || !view_culler->is_culled(object_id, model_id)) && (occlusion_culler == nullptr || !occlusion_culler->is_culled(object_id, model_id, model))) {
+						transparent_sorter.push(object_id, model_id, object);
+					}
+				}
 			}
 
-			std::sort(transparent_objects.rbegin(), transparent_objects.rend());
-			for (const TransparentObject& object : transparent_objects) {
+			transparent_sorter.set_incremental(incremental_sorting_);
+			for (const TransparentSorter::Item& object : transparent_sorter.sort(objects, camera.position)) {
+				size_t lod = lod_selector != nullptr ? lod_selector->select(object.object_id, object.model_id, *object.object) : 0;
 				main_shader_.set_uniform_i("object_id", static_cast<GLint>(object.object_id));
-				object.object->draw(object.model_id, main_shader_);
+				object.object->draw(object.model_id, main_shader_, lod);
+				count_triangles_ += object.object->get_count_triangles(lod);
+			}
+			end_pass_timer(transparent_timer_);
+		}
+
+		// World bounding boxes of models visible from at least one camera
+		std::vector<std::pair<Vec3, Vec3>> get_shadow_receivers() const {
+			std::vector<Matrix> view_projections;
+			for (const auto& [id, camera] : cameras) {
+				view_projections.push_back(camera.get_projection_matrix() * camera.get_view_matrix());
+			}
+
+			std::vector<std::pair<Vec3, Vec3>> receivers;
+			for (const auto& [object_id, object] : objects) {
+				Vec3 bounding_min, bounding_max;
+				if (!object.get_bounding_box(bounding_min, bounding_max)) {
+					continue;
+				}
+
+				for (const auto& [model_id, model] : object.models) {
+					bool visible = false;
+					for (const Matrix& view_projection : view_projections) {
+						visible = visible || intersects_frustum(view_projection * model, bounding_min, bounding_max);
+					}
+					if (!visible) {
+						continue;
+					}
+
+					std::pair<Vec3, Vec3> receiver;
+					for (size_t mask = 0; mask < 8; ++mask) {
+						Vec3 corner = model * Vec3((mask & 1) ? bounding_max.x : bounding_min.x, (mask & 2) ? bounding_max.y : bounding_min.y, (mask & 4) ? bounding_max.z : bounding_min.z);
+						for (size_t i = 0; i < 3; ++i) {
+							receiver.first[i] = mask == 0 ? corner[i] : std::min(receiver.first[i], corner[i]);
+							receiver.second[i] = mask == 0 ? corner[i] : std::max(receiver.second[i], corner[i]);
+						}
+					}
+					receivers.push_back(receiver);
+				}
+			}
+			return receivers;
+		}
+
+		// Occlusion queries keep their state per light, so only the first cascade uses them
+		void draw_shadow_layer(size_t light_id, size_t cascade) {
+			lights.set_depth_map_texture(light_id, cascade);
+
+			Matrix light_space = lights.get_light_space_matrix(light_id, cascade);
+			depth_shader_.set_uniform_matrix("light_space", light_space);
+			if (indirect_drawing_) {
+				depth_batcher_.draw(depth_shader_);
+				return;
+			}
+
+			OcclusionQueries* occlusion_queries = cascade == 0 ? begin_occlusion_queries(light_queries_, light_id, light_space) : nullptr;
+			LodSelector* lod_selector = begin_lod_selection(light_lods_, std::make_pair(light_id, cascade), light_space);
+			for (const auto& [object_id, object] : objects) {
+				// Bounds of all models are cached by the light storage, single models are tested in draw_object
+				if (!LightStorage::intersects_frustum(light_space, lights.shadow_casters_[object_id])) {
+					continue;
+				}
+
+				++count_shadow_casters_;
+				if (occlusion_queries != nullptr) {
+					occlusion_queries->draw(object_id, object, bounds_shader_, [&]() {
+						draw_object(object_id, object, depth_shader_, nullptr, nullptr, lod_selector, false, &light_space);
+					});
+				} else {
+					draw_object(object_id, object, depth_shader_, nullptr, nullptr, lod_selector, false, &light_space);
+				}
+			}
+			if (occlusion_queries != nullptr) {
+				occlusion_queries->end_frame(objects, bounds_shader_);
 			}
 		}
 
-		void draw_depth_map() const {
+		void draw_depth_map() {
 			lights.set_framebuffer();
 
-			for (const auto& [light_id, light] : lights) {
-				lights.set_depth_map_texture(light_id);
+			count_shadow_casters_ = 0;
+			if (shadow_fitting_) {
+				lights.fit_shadow_crops(get_shadow_receivers());
+			}
+			// Cascades are refitted when their tiles change, texel snapping depends on the tile size
+			std::vector<const Camera*> views;
+			for (const auto& [id, camera] : cameras) {
+				views.push_back(&camera);
+			}
+			lights.fit_cascades(views);
+			if (lights.pack_shadow_atlas(views)) {
+				lights.fit_cascades(views);
+			}
 
-				depth_shader_.set_uniform_matrix("light_space", light->get_light_space_matrix());
-				for (const auto& [object_id, object] : objects) {
-					object.draw_depth_map();
+			if (!shadow_caching_) {
+				lights.invalidate_shadows();
+			}
+			std::vector<bool> dirty_layers = lights.update_shadow_layers(objects);
+			for (const auto& [light_id, light] : lights) {
+				begin_profiler_scope("light " + std::to_string(light_id));
+				for (size_t cascade = 0; cascade < lights.get_count_shadow_layers(light_id); ++cascade) {
+					if (dirty_layers[lights.get_layer(light_id, cascade)]) {
+						draw_shadow_layer(light_id, cascade);
+					}
 				}
+				end_profiler_scope();
 			}
 
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
 			check_gl_errors(__FILE__, __LINE__, __func__);
 		}
 
-		void draw_primary_frame_buffer(const Camera& camera) const {
-			glBindFramebuffer(GL_FRAMEBUFFER, primary_frame_buffer_);
-			camera.set_uniforms(main_shader_);
+		void draw_primary_frame_buffer(const Camera& camera, const RenderTarget& render_target, const ViewCuller* view_culler, const OcclusionCuller* occlusion_culler, OcclusionQueries* occlusion_queries, LodSelector* lod_selector, TransparentSorter& transparent_sorter) {
+			glBindFramebuffer(GL_FRAMEBUFFER, render_target.primary_frame_buffer_);
+			camera.set_uniforms(main_shader_, Vec2(render_target.width_, render_target.height_));
 			
 			glStencilMask(0xFF);
 			glStencilFunc(GL_ALWAYS, 0, 0xFF);
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
 			glActiveTexture(GL_TEXTURE3);
-			glBindTexture(GL_TEXTURE_2D_ARRAY, lights.depth_map_texture_id_);
+			glBindTexture(GL_TEXTURE_2D, lights.depth_map_texture_id_);
 			glActiveTexture(GL_TEXTURE0);
 
-			draw_objects(camera);
+			draw_objects(camera, render_target, view_culler, occlusion_culler, occlusion_queries, lod_selector, transparent_sorter);
 
 			glActiveTexture(GL_TEXTURE3);
-			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			glBindTexture(GL_TEXTURE_2D, 0);
 			glActiveTexture(GL_TEXTURE0);
 
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
 			check_gl_errors(__FILE__, __LINE__, __func__);
 		}
 
-		void draw_mainbuffer(const Camera& camera) const {
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-			camera.set_viewport(post_shader_);
+		// Pixels of the camera render target covered by bounding boxes of objects with border mask and by their borders, returns false if there are no such pixels
+		// border_bits - union of border masks of these objects
+		bool get_outline_rect(const Camera& camera, const RenderTarget& render_target, GLint rect[4], GLuint& border_bits) const {
+			Matrix view_projection = camera.get_projection_matrix() * camera.get_view_matrix();
+			Vec2 rect_min(std::numeric_limits<double>::max()), rect_max(-std::numeric_limits<double>::max());
+			border_bits = 0;
+			for (const auto& [object_id, object] : objects) {
+				Vec3 bounding_min, bounding_max;
+				if (object.border_mask == 0 || !object.get_bounding_box(bounding_min, bounding_max)) {
+					continue;
+				}
+				border_bits |= object.border_mask;
+
+				for (const auto& [model_id, model] : object.models) {
+					Matrix model_view_projection = view_projection * model;
+					for (size_t mask = 0; mask < 8; ++mask) {
+						Vec3 corner((mask & 1) ? bounding_max.x : bounding_min.x, (mask & 2) ? bounding_max.y : bounding_min.y, (mask & 4) ? bounding_max.z : bounding_min.z);
+						double w = model_view_projection[3][3];
+						for (size_t i = 0; i < 3; ++i) {
+							w += model_view_projection[3][i] * corner[i];
+						}
+
+						// Box crossing the camera plane may cover any part of the screen
+						if (less_equality(w, 0.0)) {
+							rect_min = Vec2(std::min(rect_min.x, -1.0), std::min(rect_min.y, -1.0));
+							rect_max = Vec2(std::max(rect_max.x, 1.0), std::max(rect_max.y, 1.0));
+							break;
+						}
+
+						Vec3 point = model_view_projection * corner / w;
+						rect_min = Vec2(std::min(rect_min.x, point.x), std::min(rect_min.y, point.y));
+						rect_max = Vec2(std::max(rect_max.x, point.x), std::max(rect_max.y, point.y));
+					}
+				}
+			}
+
+			GLint border = static_cast<GLint>(get_border_radius()) + 1;
+			for (size_t i = 0; i < 2; ++i) {
+				if (rect_max[i] < -1.0 || 1.0 < rect_min[i]) {
+					return false;
+				}
+
+				GLint size = i == 0 ? render_target.width_ : render_target.height_;
+				GLint left = std::max(static_cast<GLint>(std::floor((std::max(rect_min[i], -1.0) + 1.0) / 2.0 * size)) - border, 0);
+				GLint right = std::min(static_cast<GLint>(std::ceil((std::min(rect_max[i], 1.0) + 1.0) / 2.0 * size)) + border, size);
+				rect[i] = left;
+				rect[i + 2] = right - left;
+			}
+			return rect[2] > 0 && rect[3] > 0;
+		}
+
+		// Transparency is composed here if post processing left the screen texture unchanged, outline_texture_id = 0 - no borders
+		void draw_mainbuffer(const Camera& camera, const RenderTarget& render_target, GLuint screen_texture_id, GLuint outline_texture_id, const GLint outline_rect[4]) const {
+			glBindFramebuffer(GL_FRAMEBUFFER, context_->get_frame_buffer());
+			camera.set_viewport(post_shader_, context_->get_height());
+			post_shader_.set_uniform_i("weighted_transparency", weighted_transparency_ && screen_texture_id == render_target.screen_texture_id_);
+			post_shader_.set_uniform_i("outline", outline_texture_id != 0);
+			post_shader_.set_uniform_i("outline_rect", outline_rect[0], outline_rect[1], outline_rect[2], outline_rect[3]);
 
 			glDisable(GL_DEPTH_TEST);
 
 			glBindVertexArray(screen_vertex_array_);
 
 			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, screen_texture_id_);
+			glBindTexture(GL_TEXTURE_2D, screen_texture_id);
 			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, depth_stencil_texture_id_);
+			glBindTexture(GL_TEXTURE_2D, render_target.depth_stencil_texture_id_);
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_2D, render_target.accumulation_texture_id_);
+			glActiveTexture(GL_TEXTURE3);
+			glBindTexture(GL_TEXTURE_2D, render_target.revealage_texture_id_);
+			glActiveTexture(GL_TEXTURE4);
+			glBindTexture(GL_TEXTURE_2D, outline_texture_id);
 
 			glDrawArrays(GL_TRIANGLES, 0, 6);
 
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE3);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_2D, 0);
 			glActiveTexture(GL_TEXTURE1);
 			glBindTexture(GL_TEXTURE_2D, 0);
 			glActiveTexture(GL_TEXTURE0);
@@ -198,15 +704,26 @@ namespace gre {
 			check_gl_errors(__FILE__, __LINE__, __func__);
 		}
 
-		void deallocate() {
-			glDeleteFramebuffers(1, &primary_frame_buffer_);
-			glDeleteTextures(1, &screen_texture_id_);
-			glDeleteTextures(1, &depth_stencil_texture_id_);
-			check_gl_errors(__FILE__, __LINE__, __func__);
+		// Border width is given in pixels of the window, borders are found in pixels of render targets
+		double get_border_radius() const noexcept {
+			return border_width_ * render_scale_ / 2.0;
+		}
+
+		// Frame buffers are recreated when the viewport of the camera is resized or the render scale is changed
+		const RenderTarget& get_render_target(size_t camera_id, const Camera& camera) {
+			GLsizei width = std::max(static_cast<GLsizei>(camera.get_viewport_size().x * render_scale_), 1);
+			GLsizei height = std::max(static_cast<GLsizei>(camera.get_viewport_size().y * render_scale_), 1);
+			auto render_target = render_targets_.find(camera_id);
+			if (render_target == render_targets_.end()) {
+				render_target = render_targets_.emplace(camera_id, RenderTarget(width, height)).first;
+			} else if (render_target->second.get_width() != width || render_target->second.get_height() != height) {
+				render_target->second = RenderTarget(width, height);
+			}
+			return render_target->second.set_transparent(weighted_transparency_).set_geometry(deferred_shading_);
+		}
 
-			primary_frame_buffer_ = 0;
-			screen_texture_id_ = 0;
-			depth_stencil_texture_id_ = 0;
+		void deallocate() {
+			render_targets_.clear();
 		}
 
 		static void create_screen_vertex_array() {
@@ -246,48 +763,91 @@ namespace gre {
 
 	public:
 		inline static DefaultControlSystem default_control_system;
+		// Does nothing, used by the default camera of contexts without window
+		inline static ControlSystem static_control_system;
 
 		GraphObjectStorage objects;
 		LightStorage lights;
 		CamerasStorage cameras;
 
-		explicit GraphEngine(sf::RenderWindow* window) {
-			window_ = window;
+		explicit GraphEngine(sf::RenderWindow* window) : GraphEngine(std::make_shared<WindowContext>(window)) {
+		}
+
+		// Context may be shared by several engines, it is destroyed with the last of them
+		explicit GraphEngine(std::shared_ptr<RenderContext> context) {
+			if (context == nullptr) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "GraphEngine, invalid render context.\n\n");
+			}
+
+			context_ = std::move(context);
 			set_active();
 
 			if (!glew_is_ok()) {
 				throw GreRuntimeError(__FILE__, __LINE__, "GraphEngine, failed to initialize GLEW.\n\n");
 			}
+			init_gl_debug_output();
 
 			depth_shader_ = gre::Shader<size_t>("GraphEngine/Shaders/Vertex/Depth", "GraphEngine/Shaders/Fragment/Depth", gre::ShaderType::DEPTH);
 			post_shader_ = gre::Shader<size_t>("GraphEngine/Shaders/Vertex/Post", "GraphEngine/Shaders/Fragment/Post", gre::ShaderType::POST);
+			lighting_shader_ = gre::Shader<size_t>("GraphEngine/Shaders/Vertex/Post", "GraphEngine/Shaders/Fragment/Deferred", gre::ShaderType::LIGHTING);
 			main_shader_ = gre::Shader<size_t>("GraphEngine/Shaders/Vertex/Main", "GraphEngine/Shaders/Fragment/Main", gre::ShaderType::MAIN);
+			cull_shader_ = gre::Shader<size_t>::compute("GraphEngine/Shaders/Compute/Cull", gre::ShaderType::CULLING);
+			cull_commands_shader_ = gre::Shader<size_t>::compute("GraphEngine/Shaders/Compute/CullCommands", gre::ShaderType::CULLING);
+			bounds_shader_ = gre::Shader<size_t>("GraphEngine/Shaders/Vertex/Bounds", "GraphEngine/Shaders/Fragment/Depth", gre::ShaderType::BOUNDS);
 			
-			const sf::ContextSettings& settings = window->getSettings();
-			if (!depth_shader_.check_window_settings(settings) || !post_shader_.check_window_settings(settings) || !main_shader_.check_window_settings(settings)) {
+			sf::ContextSettings settings = context_->get_settings();
+			if (!depth_shader_.check_window_settings(settings) || !post_shader_.check_window_settings(settings) || !main_shader_.check_window_settings(settings) || !lighting_shader_.check_window_settings(settings) || !cull_shader_.check_window_settings(settings)) {
 				throw GreRuntimeError(__FILE__, __LINE__, "GraphEngine, invalid OpenGL version.\n\n");
 			}
 			set_uniforms();
 
-			cameras.insert(Camera(window, &default_control_system));
+			post_processor_ = PostProcessor(context_->get_width(), context_->get_height());
+			main_batcher_ = DrawBatcher(ShaderType::MAIN);
+			depth_batcher_ = DrawBatcher(ShaderType::DEPTH);
+
+			if (context_->get_window() != nullptr) {
+				cameras.insert(Camera(context_->get_window(), &default_control_system));
+			} else {
+				cameras.insert(Camera(nullptr, &static_control_system, Vec2(0.0), Vec2(context_->get_width(), context_->get_height()), Vec3(0.0), Vec3(0.0, 0.0, 1.0), PI / 2.0, 1.0, 10.0));
+			}
 
 			init_gl();
-			lights.create_depth_map_frame_buffer(std::stoi(main_shader_.get_value_frag("NR_LIGHTS")));
+			lights.create_depth_map_frame_buffer(std::stoi(main_shader_.get_value_frag("NR_CASCADES")));
 			cameras.create_shader_storage_buffer(std::stoi(main_shader_.get_value_frag("NR_CAMERAS")), main_shader_);
 			create_screen_vertex_array();
-			create_primary_frame_buffer();
 		}
 
 		GraphEngine(const GraphEngine& other) {
-			window_ = other.window_;
+			context_ = other.context_;
 			set_active();
 
 			grayscale_ = other.grayscale_;
+			indirect_drawing_ = other.indirect_drawing_;
+			gpu_culling_ = other.gpu_culling_;
+			occlusion_culling_ = other.occlusion_culling_;
+			occlusion_queries_ = other.occlusion_queries_;
+			conditional_render_ = other.conditional_render_;
+			lod_selection_ = other.lod_selection_;
+			incremental_sorting_ = other.incremental_sorting_;
+			weighted_transparency_ = other.weighted_transparency_;
+			depth_pre_pass_ = other.depth_pre_pass_;
+			opaque_sorting_ = other.opaque_sorting_;
+			pass_timing_ = other.pass_timing_;
+			shadow_caching_ = other.shadow_caching_;
+			shadow_fitting_ = other.shadow_fitting_;
+			light_clustering_ = other.light_clustering_;
+			deferred_shading_ = other.deferred_shading_;
+			view_culling_ = other.view_culling_;
+			dynamic_resolution_ = other.dynamic_resolution_;
+			gpu_profiling_ = other.gpu_profiling_;
 			border_width_ = other.border_width_;
+			render_scale_ = other.render_scale_;
+			min_render_scale_ = other.min_render_scale_;
+			max_render_scale_ = other.max_render_scale_;
+			target_frame_time_ = other.target_frame_time_;
 			gamma_ = other.gamma_;
 			border_color_ = other.border_color_;
 			clear_color_ = other.clear_color_;
-			kernel_ = other.kernel_;
 
 			objects = other.objects;
 			lights = other.lights;
@@ -296,11 +856,17 @@ namespace gre {
 			main_shader_ = other.main_shader_;
 			depth_shader_ = other.depth_shader_;
 			post_shader_ = other.post_shader_;
+			lighting_shader_ = other.lighting_shader_;
+			cull_shader_ = other.cull_shader_;
+			cull_commands_shader_ = other.cull_commands_shader_;
+			bounds_shader_ = other.bounds_shader_;
+			main_batcher_ = other.main_batcher_;
+			depth_batcher_ = other.depth_batcher_;
+			post_processor_ = other.post_processor_;
 			set_uniforms();
 
 			init_gl();
 			create_screen_vertex_array();
-			create_primary_frame_buffer();
 		}
 
 		GraphEngine(GraphEngine&& other) noexcept {
@@ -326,9 +892,169 @@ namespace gre {
 			return *this;
 		}
 
-		GraphEngine& set_border_width(uint32_t border_width) {
+		// Opaque objects and shadow casters are drawn by multi draw indirect calls
+		GraphEngine& set_indirect_drawing(bool indirect_drawing) noexcept {
+			indirect_drawing_ = indirect_drawing;
+			return *this;
+		}
+
+		// Instances outside of the camera frustum are culled by compute shader, works only with indirect drawing
+		GraphEngine& set_gpu_culling(bool gpu_culling) noexcept {
+			gpu_culling_ = gpu_culling;
+			return *this;
+		}
+
+		// Instances hidden behind the largest opaque objects are culled on CPU, works only without indirect drawing
+		GraphEngine& set_occlusion_culling(bool occlusion_culling) {
+			if (!occlusion_culling) {
+				occlusion_cullers_.clear();
+			}
+
+			occlusion_culling_ = occlusion_culling;
+			return *this;
+		}
+
+		// Heavy objects hidden on the previous frame are checked by queries on their bounding boxes, works only without indirect drawing
+		GraphEngine& set_occlusion_queries(bool occlusion_queries) {
 			set_active();
-			post_shader_.set_uniform_i("border_width", border_width);
+			if (!occlusion_queries) {
+				camera_queries_.clear();
+				light_queries_.clear();
+			}
+
+			occlusion_queries_ = occlusion_queries;
+			return *this;
+		}
+
+		// true - hidden objects are drawn under conditional render, false - they are skipped until the next query shows them
+		GraphEngine& set_conditional_render(bool conditional_render) noexcept {
+			conditional_render_ = conditional_render;
+			return *this;
+		}
+
+		// Levels of detail of models are chosen by their projected size for every camera and light, works only without indirect drawing
+		GraphEngine& set_lod_selection(bool lod_selection) noexcept {
+			if (!lod_selection) {
+				camera_lods_.clear();
+				light_lods_.clear();
+			}
+			if (lod_selection != lod_selection_) {
+				lights.invalidate_shadows();
+			}
+
+			lod_selection_ = lod_selection;
+			return *this;
+		}
+
+		// Depth of opaque meshes is drawn by the depth shader before shading, works only without indirect drawing
+		GraphEngine& set_depth_pre_pass(bool depth_pre_pass) noexcept {
+			depth_pre_pass_ = depth_pre_pass;
+			return *this;
+		}
+
+		// Opaque objects are drawn from the nearest model to the farthest one, works only without indirect drawing
+		GraphEngine& set_opaque_sorting(bool opaque_sorting) noexcept {
+			opaque_sorting_ = opaque_sorting;
+			return *this;
+		}
+
+		// true - depth maps are redrawn only for lights which moved or whose casters changed, see LightStorage::invalidate_shadows
+		GraphEngine& set_shadow_caching(bool shadow_caching) noexcept {
+			shadow_caching_ = shadow_caching;
+			return *this;
+		}
+
+		// true - projections of lights are narrowed to the models visible from cameras, depth maps are redrawn when cameras move
+		GraphEngine& set_shadow_fitting(bool shadow_fitting) noexcept {
+			shadow_fitting_ = shadow_fitting;
+			if (!shadow_fitting_) {
+				lights.clear_shadow_crops();
+			}
+			return *this;
+		}
+
+		// true - opaque objects are drawn into the geometry buffer and shaded by one full screen lighting pass, transparent objects stay forward
+		GraphEngine& set_deferred_shading(bool deferred_shading) noexcept {
+			deferred_shading_ = deferred_shading;
+			return *this;
+		}
+
+		// true - models outside of camera frustums are skipped, frustums of all cameras are tested in parallel before drawing, works only without indirect drawing
+		GraphEngine& set_view_culling(bool view_culling) noexcept {
+			view_culling_ = view_culling;
+			return *this;
+		}
+
+		// true - GPU time of passes is measured by nested scopes per light, camera and pass, see get_gpu_profiler
+		GraphEngine& set_gpu_profiling(bool gpu_profiling) noexcept {
+			gpu_profiling_ = gpu_profiling;
+			return *this;
+		}
+
+		// true - render scale is adjusted from the measured GPU frame time to keep it below the target frame time
+		GraphEngine& set_dynamic_resolution(bool dynamic_resolution) noexcept {
+			dynamic_resolution_ = dynamic_resolution;
+			render_scale_delay_ = 0;
+			return *this;
+		}
+
+		// Part of the viewport size used for render targets, images are upscaled to the viewport in the final pass
+		GraphEngine& set_render_scale(double render_scale) {
+			if (less_equality(render_scale, 0.0) || 1.0 < render_scale) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_render_scale, invalid render scale.\n\n");
+			}
+
+			render_scale_ = render_scale;
+			return *this;
+		}
+
+		// Bounds of the render scale for dynamic resolution
+		GraphEngine& set_render_scale_bounds(double min_render_scale, double max_render_scale) {
+			if (less_equality(min_render_scale, 0.0) || max_render_scale < min_render_scale || 1.0 < max_render_scale) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_render_scale_bounds, invalid render scale bounds.\n\n");
+			}
+
+			min_render_scale_ = min_render_scale;
+			max_render_scale_ = max_render_scale;
+			return *this;
+		}
+
+		// Target GPU time of one frame in milliseconds for dynamic resolution
+		GraphEngine& set_target_frame_time(double target_frame_time) {
+			if (less_equality(target_frame_time, 0.0)) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_target_frame_time, not positive target frame time.\n\n");
+			}
+
+			target_frame_time_ = target_frame_time;
+			return *this;
+		}
+
+		// true - lights are binned into view space clusters and fragments iterate only over lights of their cluster, false - over all lights
+		GraphEngine& set_light_clustering(bool light_clustering) noexcept {
+			light_clustering_ = light_clustering;
+			return *this;
+		}
+
+		// GPU time of render passes is measured by timer queries, see get_pass_times
+		GraphEngine& set_pass_timing(bool pass_timing) noexcept {
+			post_processor_.set_pass_timing(pass_timing);
+			pass_timing_ = pass_timing;
+			return *this;
+		}
+
+		// true - transparent models are drawn unsorted by weighted blended order independent transparency
+		GraphEngine& set_weighted_transparency(bool weighted_transparency) noexcept {
+			weighted_transparency_ = weighted_transparency;
+			return *this;
+		}
+
+		// true - order of transparent models is corrected from the previous frame instead of sorting from scratch
+		GraphEngine& set_incremental_sorting(bool incremental_sorting) noexcept {
+			incremental_sorting_ = incremental_sorting;
+			return *this;
+		}
+
+		GraphEngine& set_border_width(uint32_t border_width) noexcept {
 			border_width_ = border_width;
 			return *this;
 		}
@@ -339,7 +1065,8 @@ namespace gre {
 			}
 
 			set_active();
-			post_shader_.set_uniform_f("gamma", static_cast<GLfloat>(gamma));
+			main_shader_.set_uniform_f("gamma", static_cast<GLfloat>(gamma));
+			lighting_shader_.set_uniform_f("gamma", static_cast<GLfloat>(gamma));
 			gamma_ = gamma;
 			return *this;
 		}
@@ -370,10 +1097,9 @@ namespace gre {
 			return *this;
 		}
 
+		// Identity kernel skips convolution, separable kernels are applied by two passes of three taps, others by one compute pass
 		GraphEngine& set_kernel(const Kernel& kernel) {
-			set_active();
-			kernel.set_uniforms(post_shader_);
-			kernel_ = kernel;
+			post_processor_.set_kernel(kernel);
 			return *this;
 		}
 
@@ -381,6 +1107,188 @@ namespace gre {
 			return grayscale_;
 		}
 
+		bool get_indirect_drawing() const noexcept {
+			return indirect_drawing_;
+		}
+
+		bool get_gpu_culling() const noexcept {
+			return gpu_culling_;
+		}
+
+		bool get_occlusion_culling() const noexcept {
+			return occlusion_culling_;
+		}
+
+		bool get_occlusion_queries() const noexcept {
+			return occlusion_queries_;
+		}
+
+		bool get_conditional_render() const noexcept {
+			return conditional_render_;
+		}
+
+		bool get_lod_selection() const noexcept {
+			return lod_selection_;
+		}
+
+		bool get_depth_pre_pass() const noexcept {
+			return depth_pre_pass_;
+		}
+
+		bool get_opaque_sorting() const noexcept {
+			return opaque_sorting_;
+		}
+
+		bool get_shadow_caching() const noexcept {
+			return shadow_caching_;
+		}
+
+		bool get_shadow_fitting() const noexcept {
+			return shadow_fitting_;
+		}
+
+		bool get_deferred_shading() const noexcept {
+			return deferred_shading_;
+		}
+
+		bool get_view_culling() const noexcept {
+			return view_culling_;
+		}
+
+		bool get_gpu_profiling() const noexcept {
+			return gpu_profiling_;
+		}
+
+		// Scopes of the frame drawn several frames ago, filled only with GPU profiling
+		const GpuProfiler& get_gpu_profiler() const noexcept {
+			return gpu_profiler_;
+		}
+
+		const RenderContext& get_context() const noexcept {
+			return *context_;
+		}
+
+		size_t get_count_requested_frames() const noexcept {
+			return frame_reader_.get_count_requested();
+		}
+
+		bool get_dynamic_resolution() const noexcept {
+			return dynamic_resolution_;
+		}
+
+		double get_render_scale() const noexcept {
+			return render_scale_;
+		}
+
+		double get_min_render_scale() const noexcept {
+			return min_render_scale_;
+		}
+
+		double get_max_render_scale() const noexcept {
+			return max_render_scale_;
+		}
+
+		double get_target_frame_time() const noexcept {
+			return target_frame_time_;
+		}
+
+		// GPU time of the whole frame in milliseconds, measured only with dynamic resolution
+		double get_frame_time() const noexcept {
+			return frame_timer_.get_elapsed_time();
+		}
+
+		bool get_light_clustering() const noexcept {
+			return light_clustering_;
+		}
+
+		bool get_pass_timing() const noexcept {
+			return pass_timing_;
+		}
+
+		// Times of a frame drawn a few frames ago, all zero until pass timing is enabled
+		PassTimes get_pass_times() const noexcept {
+			PassTimes pass_times;
+			pass_times.shadow = shadow_timer_.get_elapsed_time();
+			pass_times.depth_pre_pass = depth_pre_pass_timer_.get_elapsed_time();
+			pass_times.opaque = opaque_timer_.get_elapsed_time();
+			pass_times.lighting = lighting_timer_.get_elapsed_time();
+			pass_times.transparent = transparent_timer_.get_elapsed_time();
+			pass_times.post = post_timer_.get_elapsed_time();
+			return pass_times;
+		}
+
+		// Times of post processing passes included in the post time
+		PostProcessor::PassTimes get_post_pass_times() const noexcept {
+			return post_processor_.get_pass_times();
+		}
+
+		// Post processing passes drawn in the last frame before the final pass of every camera
+		size_t get_count_post_passes() const noexcept {
+			return post_processor_.get_count_passes();
+		}
+
+		bool get_weighted_transparency() const noexcept {
+			return weighted_transparency_;
+		}
+
+		bool get_incremental_sorting() const noexcept {
+			return incremental_sorting_;
+		}
+
+		// Triangles submitted by direct draw calls in the last frame for all cameras and lights
+		size_t get_count_triangles() const noexcept {
+			return count_triangles_;
+		}
+
+		// Objects drawn into depth maps in the last frame, summed over lights
+		size_t get_count_shadow_casters() const noexcept {
+			return count_shadow_casters_;
+		}
+
+		// Counters of occlusion queries issued in the last frame for all cameras and lights
+		OcclusionQueries::Statistics get_occlusion_query_statistics() const noexcept {
+			OcclusionQueries::Statistics statistics;
+			for (const auto& [camera_id, occlusion_queries] : camera_queries_) {
+				statistics += occlusion_queries.get_statistics();
+			}
+			for (const auto& [light_id, occlusion_queries] : light_queries_) {
+				statistics += occlusion_queries.get_statistics();
+			}
+			return statistics;
+		}
+
+		// Light lists built for all cameras in the last frame
+		LightClusters::Statistics get_light_cluster_statistics() const noexcept {
+			LightClusters::Statistics statistics;
+			for (const auto& [camera_id, light_clusters] : light_clusters_) {
+				statistics += light_clusters.get_statistics();
+			}
+			return statistics;
+		}
+
+		// Summary of the last frustum culling results of all cameras
+		ViewCuller::Statistics get_view_cull_statistics() const noexcept {
+			ViewCuller::Statistics statistics;
+			for (const auto& [camera_id, view_culler] : view_cullers_) {
+				statistics += view_culler.get_statistics();
+			}
+			return statistics;
+		}
+
+		// Summary of the last occlusion culling results of all cameras
+		OcclusionCuller::Statistics get_occlusion_statistics() const noexcept {
+			OcclusionCuller::Statistics statistics;
+			for (const auto& [camera_id, occlusion_culler] : occlusion_cullers_) {
+				statistics += occlusion_culler.get_statistics();
+			}
+			return statistics;
+		}
+
+		// Number of draw calls issued for opaque objects in the last frame
+		size_t get_count_indirect_draw_calls() const noexcept {
+			return main_batcher_.get_count_draw_calls();
+		}
+
 		uint32_t get_border_width() const noexcept {
 			return border_width_;
 		}
@@ -398,7 +1306,7 @@ namespace gre {
 		}
 
 		Kernel get_kernel() const noexcept {
-			return kernel_;
+			return post_processor_.get_kernel();
 		}
 
 		ObjectDesc get_check_object(size_t camera_id, Vec3& intersect_point) {
@@ -423,16 +1331,50 @@ namespace gre {
 			return result;
 		}
 
+		// Copies the last drawn frame of the context, the copy is read later by read_frame without waiting for the GPU
+		void request_frame() {
+			frame_reader_.request(context_->get_frame_buffer(), context_->get_width(), context_->get_height());
+		}
+
+		// RGBA pixels of the first requested frame with rows from top to bottom, returns false if the GPU has not finished it, wait = true blocks until it is finished
+		bool read_frame(std::vector<uint8_t>& pixels, GLsizei& width, GLsizei& height, bool wait = false) {
+			return frame_reader_.read(pixels, width, height, wait);
+		}
+
 		void swap(GraphEngine& other) {
-			std::swap(window_, other.window_);
+			std::swap(context_, other.context_);
 			set_active();
 
 			std::swap(grayscale_, other.grayscale_);
+			std::swap(indirect_drawing_, other.indirect_drawing_);
+			std::swap(gpu_culling_, other.gpu_culling_);
+			std::swap(occlusion_culling_, other.occlusion_culling_);
+			std::swap(occlusion_queries_, other.occlusion_queries_);
+			std::swap(conditional_render_, other.conditional_render_);
+			std::swap(lod_selection_, other.lod_selection_);
+			std::swap(incremental_sorting_, other.incremental_sorting_);
+			std::swap(weighted_transparency_, other.weighted_transparency_);
+			std::swap(depth_pre_pass_, other.depth_pre_pass_);
+			std::swap(opaque_sorting_, other.opaque_sorting_);
+			std::swap(pass_timing_, other.pass_timing_);
+			std::swap(shadow_caching_, other.shadow_caching_);
+			std::swap(shadow_fitting_, other.shadow_fitting_);
+			std::swap(light_clustering_, other.light_clustering_);
+			std::swap(deferred_shading_, other.deferred_shading_);
+			std::swap(view_culling_, other.view_culling_);
+			std::swap(dynamic_resolution_, other.dynamic_resolution_);
+			std::swap(gpu_profiling_, other.gpu_profiling_);
+			std::swap(count_triangles_, other.count_triangles_);
+			std::swap(count_shadow_casters_, other.count_shadow_casters_);
+			std::swap(render_scale_delay_, other.render_scale_delay_);
 			std::swap(border_width_, other.border_width_);
+			std::swap(render_scale_, other.render_scale_);
+			std::swap(min_render_scale_, other.min_render_scale_);
+			std::swap(max_render_scale_, other.max_render_scale_);
+			std::swap(target_frame_time_, other.target_frame_time_);
 			std::swap(gamma_, other.gamma_);
 			std::swap(border_color_, other.border_color_);
 			std::swap(clear_color_, other.clear_color_);
-			std::swap(kernel_, other.kernel_);
 
 			objects.swap(other.objects);
 			lights.swap(other.lights);
@@ -441,30 +1383,166 @@ namespace gre {
 			main_shader_.swap(other.main_shader_);
 			depth_shader_.swap(other.depth_shader_);
 			post_shader_.swap(other.post_shader_);
+			lighting_shader_.swap(other.lighting_shader_);
+			cull_shader_.swap(other.cull_shader_);
+			cull_commands_shader_.swap(other.cull_commands_shader_);
+			bounds_shader_.swap(other.bounds_shader_);
+			main_batcher_.swap(other.main_batcher_);
+			depth_batcher_.swap(other.depth_batcher_);
+			post_processor_.swap(other.post_processor_);
+			std::swap(view_cullers_, other.view_cullers_);
+			std::swap(occlusion_cullers_, other.occlusion_cullers_);
+			std::swap(camera_queries_, other.camera_queries_);
+			std::swap(light_queries_, other.light_queries_);
+			std::swap(camera_lods_, other.camera_lods_);
+			std::swap(light_lods_, other.light_lods_);
+			std::swap(transparent_sorters_, other.transparent_sorters_);
+			std::swap(light_clusters_, other.light_clusters_);
+			shadow_timer_.swap(other.shadow_timer_);
+			depth_pre_pass_timer_.swap(other.depth_pre_pass_timer_);
+			opaque_timer_.swap(other.opaque_timer_);
+			lighting_timer_.swap(other.lighting_timer_);
+			transparent_timer_.swap(other.transparent_timer_);
+			post_timer_.swap(other.post_timer_);
+			frame_timer_.swap(other.frame_timer_);
+			gpu_profiler_.swap(other.gpu_profiler_);
+			frame_reader_.swap(other.frame_reader_);
 			set_uniforms();
 
-			std::swap(screen_texture_id_, other.screen_texture_id_);
-			std::swap(depth_stencil_texture_id_, other.depth_stencil_texture_id_);
-			std::swap(primary_frame_buffer_, other.primary_frame_buffer_);
+			std::swap(render_targets_, other.render_targets_);
 			init_gl();
 		}
 
 		void draw() {
+			GRE_PROFILE_ZONE("GraphEngine::draw");
 			set_active();
 
-			draw_depth_map();
+			count_triangles_ = 0;
+			if (pass_timing_) {
+				for (TimerQuery* timer : { &shadow_timer_, &depth_pre_pass_timer_, &opaque_timer_, &lighting_timer_, &transparent_timer_, &post_timer_ }) {
+					timer->begin_frame();
+				}
+			}
+			post_processor_.begin_frame();
+			if (gpu_profiling_) {
+				gpu_profiler_.begin_frame();
+			}
+			if (dynamic_resolution_) {
+				update_render_scale();
+				frame_timer_.begin();
+			}
+			if (indirect_drawing_) {
+				main_batcher_.build(objects);
+				depth_batcher_.build(objects);
+			}
+			for (auto occlusion_queries = camera_queries_.begin(); occlusion_queries != camera_queries_.end();) {
+				occlusion_queries = cameras.contains(occlusion_queries->first) ? std::next(occlusion_queries) : camera_queries_.erase(occlusion_queries);
+			}
+			for (auto occlusion_queries = light_queries_.begin(); occlusion_queries != light_queries_.end();) {
+				occlusion_queries = lights.contains(occlusion_queries->first) ? std::next(occlusion_queries) : light_queries_.erase(occlusion_queries);
+			}
+			for (auto lod_selector = camera_lods_.begin(); lod_selector != camera_lods_.end();) {
+				lod_selector = cameras.contains(lod_selector->first) ? std::next(lod_selector) : camera_lods_.erase(lod_selector);
+			}
+			for (auto lod_selector = light_lods_.begin(); lod_selector != light_lods_.end();) {
+				const auto& [light_id, cascade] = lod_selector->first;
+				lod_selector = lights.contains(light_id) && cascade < lights.get_count_shadow_layers(light_id) ? std::next(lod_selector) : light_lods_.erase(lod_selector);
+			}
+			for (auto transparent_sorter = transparent_sorters_.begin(); transparent_sorter != transparent_sorters_.end();) {
+				transparent_sorter = cameras.contains(transparent_sorter->first) ? std::next(transparent_sorter) : transparent_sorters_.erase(transparent_sorter);
+			}
+			for (auto light_clusters = light_clusters_.begin(); light_clusters != light_clusters_.end();) {
+				light_clusters = cameras.contains(light_clusters->first) ? std::next(light_clusters) : light_clusters_.erase(light_clusters);
+			}
+			for (auto render_target = render_targets_.begin(); render_target != render_targets_.end();) {
+				render_target = cameras.contains(render_target->first) ? std::next(render_target) : render_targets_.erase(render_target);
+			}
+			for (auto view_culler = view_cullers_.begin(); view_culler != view_cullers_.end();) {
+				view_culler = view_culling_ && !indirect_drawing_ && cameras.contains(view_culler->first) ? std::next(view_culler) : view_cullers_.erase(view_culler);
+			}
+
+			// Frustums of all cameras are culled on worker threads while shadow maps, shared by all cameras, are drawn
+			std::vector<std::future<void>> view_culling_jobs;
+			if (view_culling_ && !indirect_drawing_) {
+				for (const auto& [id, camera] : cameras) {
+					view_culling_jobs.push_back(std::async(std::launch::async, [this, view_culler = &view_cullers_[id], view_projection = camera.get_projection_matrix() * camera.get_view_matrix()]() {
+						GRE_PROFILE_ZONE("ViewCuller::update");
+						view_culler->update(objects, view_projection);
+					}));
+				}
+			}
 
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			begin_pass_timer(shadow_timer_, "shadows");
+			{
+				GRE_PROFILE_ZONE("GraphEngine::draw_depth_map");
+				draw_depth_map();
+			}
+			end_pass_timer(shadow_timer_);
+			for (std::future<void>& job : view_culling_jobs) {
+				job.get();
+			}
+
+			glBindFramebuffer(GL_FRAMEBUFFER, context_->get_frame_buffer());
 			glClear(GL_COLOR_BUFFER_BIT);
 			check_gl_errors(__FILE__, __LINE__, __func__);
 
 			cameras.update_storage();
 			lights.set_uniforms(main_shader_);
 			for (const auto& [id, camera] : cameras) {
+				GRE_PROFILE_ZONE("GraphEngine::draw camera");
+				begin_profiler_scope("camera " + std::to_string(id));
 				main_shader_.set_uniform_i("camera_id", static_cast<GLint>(cameras.get_memory_id(id)));
+				if (indirect_drawing_ && gpu_culling_) {
+					main_batcher_.cull(cull_shader_, cull_commands_shader_, camera.get_projection_matrix() * camera.get_view_matrix());
+				}
+
+				const RenderTarget& render_target = get_render_target(id, camera);
+				const ViewCuller* view_culler = view_cullers_.contains(id) ? &view_cullers_[id] : nullptr;
+				const OcclusionCuller* occlusion_culler = nullptr;
+				if (occlusion_culling_ && !indirect_drawing_) {
+					occlusion_cullers_[id].update(objects, camera);
+					occlusion_culler = &occlusion_cullers_[id];
+				}
+
+				Matrix view_projection = camera.get_projection_matrix() * camera.get_view_matrix();
+				OcclusionQueries* occlusion_queries = begin_occlusion_queries(camera_queries_, id, view_projection);
+				LodSelector* lod_selector = begin_lod_selection(camera_lods_, id, view_projection);
+				light_clusters_[id].update(lights, camera, light_clustering_);
+				light_clusters_[id].set_uniforms(main_shader_);
+				if (deferred_shading_) {
+					light_clusters_[id].set_uniforms(lighting_shader_);
+				}
+				draw_primary_frame_buffer(camera, render_target, view_culler, occlusion_culler, occlusion_queries, lod_selector, transparent_sorters_[id]);
+				begin_pass_timer(post_timer_, "post");
+				GLint outline_rect[4] = { 0, 0, 0, 0 };
+				GLuint outline_texture_id = 0;
+				GLuint border_bits = 0;
+				if (border_width_ > 0 && get_outline_rect(camera, render_target, outline_rect, border_bits)) {
+					begin_profiler_scope("outline");
+					outline_texture_id = post_processor_.process_outline(render_target.depth_stencil_texture_id_, outline_rect, get_border_radius(), border_bits);
+					end_profiler_scope();
+				}
+				begin_profiler_scope("filter");
+				GLuint screen_texture_id = post_processor_.process(render_target.width_, render_target.height_, render_target.screen_texture_id_, render_target.accumulation_texture_id_, render_target.revealage_texture_id_, weighted_transparency_, screen_vertex_array_);
+				end_profiler_scope();
+				begin_profiler_scope("final");
+				draw_mainbuffer(camera, render_target, screen_texture_id, outline_texture_id, outline_rect);
+				end_profiler_scope();
+				end_pass_timer(post_timer_);
+				end_profiler_scope();
+			}
+			if (dynamic_resolution_) {
+				frame_timer_.end();
+			}
 
-				draw_primary_frame_buffer(camera);
-				draw_mainbuffer(camera);
+			// Culling for the next frame runs on worker threads while the current one is presented
+			if (occlusion_culling_ && !indirect_drawing_) {
+				for (auto occlusion_culler = occlusion_cullers_.begin(); occlusion_culler != occlusion_cullers_.end();) {
+					occlusion_culler = cameras.contains(occlusion_culler->first) ? std::next(occlusion_culler) : occlusion_cullers_.erase(occlusion_culler);
+				}
+				for (const auto& [id, camera] : cameras) {
+					occlusion_cullers_[id].start(objects, camera);
+				}
 			}
 		}
 
@@ -472,8 +1550,13 @@ namespace gre {
 			deallocate();
 		}
 
+		// Debug context is requested while errors are checked, debug messages are guaranteed only in it
 		static sf::RenderWindow create_fullscreen_window(const std::string& title) {
-			return sf::RenderWindow(sf::VideoMode::getFullscreenModes()[0], title, sf::Style::None);
+			sf::ContextSettings settings;
+			if (GL_ERROR_POLICY != GlErrorPolicy::NO_CHECKS) {
+				settings.attributeFlags = sf::ContextSettings::Debug;
+			}
+			return sf::RenderWindow(sf::VideoMode::getFullscreenModes()[0], title, sf::Style::None, settings);
 		}
 	};
 }
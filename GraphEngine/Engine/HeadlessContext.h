@@ -0,0 +1,218 @@
+#pragma once
+
+// Define GRE_HEADLESS before including the engine to create contexts without window by EGL, it requires EGL headers and libEGL
+#ifdef GRE_HEADLESS
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <sstream>
+#include "RenderContext.h"
+
+
+namespace gre {
+	// EGL context without window and display server, images of cameras are drawn into its own frame buffer
+	// Works on render nodes and with Mesa llvmpipe on machines without GPU
+	class HeadlessContext : public RenderContext {
+		GLsizei width_ = 0;
+		GLsizei height_ = 0;
+		sf::ContextSettings settings_;
+
+		EGLDisplay display_ = EGL_NO_DISPLAY;
+		EGLSurface surface_ = EGL_NO_SURFACE;
+		EGLContext context_ = EGL_NO_CONTEXT;
+		GLuint color_renderbuffer_ = 0;
+		GLuint frame_buffer_ = 0;
+
+		static bool has_extension(const char* extensions, const std::string& name) {
+			if (extensions == nullptr) {
+				return false;
+			}
+
+			std::istringstream extensions_stream(extensions);
+			for (std::string extension; extensions_stream >> extension;) {
+				if (extension == name) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Surfaceless platform of Mesa does not need X server or GPU device, other drivers use their default display
+		static EGLDisplay get_display() {
+			if (has_extension(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS), "EGL_MESA_platform_surfaceless")) {
+				return eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			}
+			return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		}
+
+		void create_context(int major_version, int minor_version, bool pbuffer) {
+			display_ = get_display();
+			if (display_ == EGL_NO_DISPLAY || !eglInitialize(display_, nullptr, nullptr)) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_context, failed to initialize EGL display.\n\n");
+			}
+			if (!eglBindAPI(EGL_OPENGL_API)) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_context, EGL display does not support OpenGL.\n\n");
+			}
+
+			EGLint config_attributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+			EGLConfig config;
+			EGLint count_configs = 0;
+			if (!eglChooseConfig(display_, config_attributes, &config, 1, &count_configs) || count_configs == 0) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_context, failed to choose EGL config.\n\n");
+			}
+
+			// The engine never draws into the pbuffer, it is needed only by drivers without surfaceless contexts
+			if (pbuffer || !has_extension(eglQueryString(display_, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+				EGLint surface_attributes[] = { EGL_WIDTH, width_, EGL_HEIGHT, height_, EGL_NONE };
+				surface_ = eglCreatePbufferSurface(display_, config, surface_attributes);
+				if (surface_ == EGL_NO_SURFACE) {
+					throw GreRuntimeError(__FILE__, __LINE__, "create_context, failed to create pbuffer surface.\n\n");
+				}
+			}
+
+			// Debug context is requested while errors are checked, debug messages are guaranteed only in it
+			EGLint debug = GL_ERROR_POLICY != GlErrorPolicy::NO_CHECKS ? EGL_TRUE : EGL_FALSE;
+			EGLint context_attributes[] = { EGL_CONTEXT_MAJOR_VERSION, major_version, EGL_CONTEXT_MINOR_VERSION, minor_version, EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_CONTEXT_OPENGL_DEBUG, debug, EGL_NONE };
+			context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, context_attributes);
+			if (context_ == EGL_NO_CONTEXT) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_context, failed to create OpenGL " + std::to_string(major_version) + "." + std::to_string(minor_version) + " context.\n\n");
+			}
+			set_active();
+
+			if (!glew_is_ok()) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_context, failed to initialize GLEW.\n\n");
+			}
+
+			GLint version[2] = { 0, 0 };
+			glGetIntegerv(GL_MAJOR_VERSION, &version[0]);
+			glGetIntegerv(GL_MINOR_VERSION, &version[1]);
+			settings_.majorVersion = static_cast<unsigned int>(version[0]);
+			settings_.minorVersion = static_cast<unsigned int>(version[1]);
+		}
+
+		void create_frame_buffer() {
+			glGenRenderbuffers(1, &color_renderbuffer_);
+			glBindRenderbuffer(GL_RENDERBUFFER, color_renderbuffer_);
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+			glGenFramebuffers(1, &frame_buffer_);
+			glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer_);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer_);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_frame_buffer, framebuffer is not complete.\n\n");
+			}
+			set_gl_object_label(GL_RENDERBUFFER, color_renderbuffer_, "headless color renderbuffer");
+			set_gl_object_label(GL_FRAMEBUFFER, frame_buffer_, "headless frame buffer");
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		// The display is not terminated, other contexts of the process may use it
+		void deallocate() {
+			if (context_ != EGL_NO_CONTEXT) {
+				set_active();
+				if (color_renderbuffer_ != 0) {
+					glDeleteFramebuffers(1, &frame_buffer_);
+					glDeleteRenderbuffers(1, &color_renderbuffer_);
+					check_gl_errors(__FILE__, __LINE__, __func__);
+				}
+
+				eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+				eglDestroyContext(display_, context_);
+			}
+			if (surface_ != EGL_NO_SURFACE) {
+				eglDestroySurface(display_, surface_);
+			}
+
+			display_ = EGL_NO_DISPLAY;
+			surface_ = EGL_NO_SURFACE;
+			context_ = EGL_NO_CONTEXT;
+			color_renderbuffer_ = 0;
+			frame_buffer_ = 0;
+		}
+
+	public:
+		// pbuffer = true creates a pbuffer surface even if the driver supports surfaceless contexts
+		HeadlessContext(GLsizei width, GLsizei height, int major_version = 4, int minor_version = 3, bool pbuffer = false) {
+			if (width <= 0 || height <= 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "HeadlessContext, invalid frame size.\n\n");
+			}
+
+			width_ = width;
+			height_ = height;
+			try {
+				create_context(major_version, minor_version, pbuffer);
+				create_frame_buffer();
+			}
+			catch (...) {
+				deallocate();
+				throw;
+			}
+		}
+
+		// EGL contexts can not be copied, GraphEngine shares one context between its copies
+		HeadlessContext(const HeadlessContext& other) = delete;
+
+		HeadlessContext(HeadlessContext&& other) noexcept {
+			swap(other);
+		}
+
+		HeadlessContext& operator=(const HeadlessContext& other) = delete;
+
+		HeadlessContext& operator=(HeadlessContext&& other)& {
+			deallocate();
+			swap(other);
+			return *this;
+		}
+
+		void set_active() const override {
+			if (eglGetCurrentContext() != context_ && !eglMakeCurrent(display_, surface_, surface_, context_)) {
+				throw GreRuntimeError(__FILE__, __LINE__, "set_active, failed to activate EGL context.\n\n");
+			}
+		}
+
+		GLsizei get_width() const noexcept override {
+			return width_;
+		}
+
+		GLsizei get_height() const noexcept override {
+			return height_;
+		}
+
+		GLuint get_frame_buffer() const noexcept override {
+			return frame_buffer_;
+		}
+
+		sf::ContextSettings get_settings() const override {
+			return settings_;
+		}
+
+		sf::RenderWindow* get_window() const noexcept override {
+			return nullptr;
+		}
+
+		bool is_surfaceless() const noexcept {
+			return surface_ == EGL_NO_SURFACE;
+		}
+
+		void swap(HeadlessContext& other) noexcept {
+			std::swap(width_, other.width_);
+			std::swap(height_, other.height_);
+			std::swap(settings_, other.settings_);
+			std::swap(display_, other.display_);
+			std::swap(surface_, other.surface_);
+			std::swap(context_, other.context_);
+			std::swap(color_renderbuffer_, other.color_renderbuffer_);
+			std::swap(frame_buffer_, other.frame_buffer_);
+		}
+
+		~HeadlessContext() {
+			deallocate();
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "Camera.h"
+#include "LightStorage.h"
+
+
+namespace gre {
+	// Lists of lights affecting view space clusters of the camera frustum, one instance per camera
+	class LightClusters {
+	public:
+		struct Statistics {
+			size_t count_lights = 0;
+			size_t count_clusters = 0;
+			size_t count_references = 0;
+			size_t max_cluster_lights = 0;
+
+			Statistics& operator+=(const Statistics& other) noexcept {
+				count_lights += other.count_lights;
+				count_clusters += other.count_clusters;
+				count_references += other.count_references;
+				max_cluster_lights = std::max(max_cluster_lights, other.max_cluster_lights);
+				return *this;
+			}
+		};
+
+	private:
+		struct Range {
+			size_t memory_id = 0;
+			size_t min[3] = { 0, 0, 0 };
+			size_t max[3] = { 0, 0, 0 };
+		};
+
+		inline static const GLuint CLUSTERS_BINDING = 10;
+		inline static const GLuint LIGHT_INDICES_BINDING = 11;
+
+		size_t grid_size_[3] = { 16, 9, 24 };
+		size_t used_grid_size_[3] = { 1, 1, 1 };
+		double near_ = 1.0;
+		double far_ = 2.0;
+		Vec3 direction_ = Vec3(0.0, 0.0, 1.0);
+
+		GLuint clusters_buffer_ = 0;
+		GLuint light_indices_buffer_ = 0;
+		std::vector<Range> ranges_;
+		// Offset and number of light indices of every cluster
+		std::vector<GLuint> clusters_;
+		std::vector<GLuint> light_indices_;
+		Statistics statistics_;
+
+		// Depth slices grow exponentially from the near to the far plane
+		size_t get_slice(double depth) const noexcept {
+			if (depth <= near_) {
+				return 0;
+			}
+
+			double slice = std::log(depth / near_) / std::log(far_ / near_) * static_cast<double>(used_grid_size_[2]);
+			return std::min(static_cast<size_t>(slice), used_grid_size_[2] - 1);
+		}
+
+		// Cluster range covered by the sphere, returns false if the sphere is outside of the frustum
+		bool get_range(const Camera& camera, const Matrix& view_projection, const Vec3& center, double radius, Range& range) const {
+			double depth = (center - camera.position) * direction_;
+			if (depth + radius < near_ || far_ < depth - radius) {
+				return false;
+			}
+			range.min[2] = get_slice(depth - radius);
+			range.max[2] = get_slice(depth + radius);
+
+			// Screen rectangle of the bounding box, whole screen if the box crosses the camera plane
+			Vec2 rect_min(-1.0), rect_max(1.0);
+			bool visible_corners = true;
+			Vec2 corners_min(std::numeric_limits<double>::max()), corners_max(-std::numeric_limits<double>::max());
+			for (size_t mask = 0; mask < 8 && visible_corners; ++mask) {
+				Vec3 corner = center + Vec3((mask & 1) ? radius : -radius, (mask & 2) ? radius : -radius, (mask & 4) ? radius : -radius);
+				double w = view_projection[3][3];
+				for (size_t i = 0; i < 3; ++i) {
+					w += view_projection[3][i] * corner[i];
+				}
+				if (less_equality(w, 0.0)) {
+					visible_corners = false;
+					break;
+				}
+
+				Vec3 point = view_projection * corner / w;
+				corners_min = Vec2(std::min(corners_min.x, point.x), std::min(corners_min.y, point.y));
+				corners_max = Vec2(std::max(corners_max.x, point.x), std::max(corners_max.y, point.y));
+			}
+			if (visible_corners) {
+				if (corners_max.x < -1.0 || corners_max.y < -1.0 || 1.0 < corners_min.x || 1.0 < corners_min.y) {
+					return false;
+				}
+				rect_min = Vec2(std::max(corners_min.x, -1.0), std::max(corners_min.y, -1.0));
+				rect_max = Vec2(std::min(corners_max.x, 1.0), std::min(corners_max.y, 1.0));
+			}
+
+			for (size_t i = 0; i < 2; ++i) {
+				double size = static_cast<double>(used_grid_size_[i]);
+				range.min[i] = std::min(static_cast<size_t>((rect_min[i] + 1.0) / 2.0 * size), used_grid_size_[i] - 1);
+				range.max[i] = std::min(static_cast<size_t>((rect_max[i] + 1.0) / 2.0 * size), used_grid_size_[i] - 1);
+			}
+			return true;
+		}
+
+		void upload_buffer(GLuint& buffer, const std::vector<GLuint>& data) {
+			if (buffer == 0) {
+				glGenBuffers(1, &buffer);
+			}
+
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(data.size(), static_cast<size_t>(1)) * sizeof(GLuint), data.empty() ? nullptr : &data[0], GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void deallocate() {
+			glDeleteBuffers(1, &clusters_buffer_);
+			glDeleteBuffers(1, &light_indices_buffer_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			clusters_buffer_ = 0;
+			light_indices_buffer_ = 0;
+		}
+
+	public:
+		LightClusters() noexcept {
+		}
+
+		// Buffers are not copied, they are filled again on the next update
+		LightClusters(const LightClusters& other) noexcept {
+			std::copy(other.grid_size_, other.grid_size_ + 3, grid_size_);
+		}
+
+		LightClusters(LightClusters&& other) noexcept {
+			swap(other);
+		}
+
+		LightClusters& operator=(const LightClusters& other)& {
+			LightClusters object(other);
+			swap(object);
+			return *this;
+		}
+
+		LightClusters& operator=(LightClusters&& other)& {
+			deallocate();
+			swap(other);
+			return *this;
+		}
+
+		// Number of clusters along the width, the height and the depth of the frustum
+		LightClusters& set_grid_size(size_t size_x, size_t size_y, size_t size_z) {
+			if (size_x == 0 || size_y == 0 || size_z == 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_grid_size, invalid grid size.\n\n");
+			}
+
+			grid_size_[0] = size_x;
+			grid_size_[1] = size_y;
+			grid_size_[2] = size_z;
+			return *this;
+		}
+
+		size_t get_grid_size(size_t axis) const {
+			if (3 <= axis) {
+				throw GreOutOfRange(__FILE__, __LINE__, "get_grid_size, invalid axis index.\n\n");
+			}
+
+			return grid_size_[axis];
+		}
+
+		const Statistics& get_statistics() const noexcept {
+			return statistics_;
+		}
+
+		// clustered = false puts all lights into one cluster, every fragment iterates over all lights
+		void update(const LightStorage& lights, const Camera& camera, bool clustered) {
+			for (size_t i = 0; i < 3; ++i) {
+				used_grid_size_[i] = clustered ? grid_size_[i] : 1;
+			}
+			near_ = camera.get_min_distance();
+			far_ = std::max(camera.get_max_distance(), 2.0 * near_);
+			direction_ = camera.get_direction().normalize();
+			Matrix view_projection = camera.get_projection_matrix() * camera.get_view_matrix();
+
+			ranges_.clear();
+			for (size_t memory_id = 0; memory_id < lights.size(); ++memory_id) {
+				Range range;
+				range.memory_id = memory_id;
+				for (size_t i = 0; i < 3; ++i) {
+					range.max[i] = used_grid_size_[i] - 1;
+				}
+
+				Vec3 center;
+				double radius = 0.0;
+				if (!clustered || !lights[lights.get_id(memory_id)]->get_bounding_sphere(center, radius) || get_range(camera, view_projection, center, radius, range)) {
+					ranges_.push_back(range);
+				}
+			}
+
+			size_t count_clusters = used_grid_size_[0] * used_grid_size_[1] * used_grid_size_[2];
+			clusters_.assign(2 * count_clusters, 0);
+			for (const Range& range : ranges_) {
+				for (size_t z = range.min[2]; z <= range.max[2]; ++z) {
+					for (size_t y = range.min[1]; y <= range.max[1]; ++y) {
+						for (size_t x = range.min[0]; x <= range.max[0]; ++x) {
+							++clusters_[2 * ((z * used_grid_size_[1] + y) * used_grid_size_[0] + x) + 1];
+						}
+					}
+				}
+			}
+
+			statistics_ = Statistics();
+			statistics_.count_lights = ranges_.size();
+			statistics_.count_clusters = count_clusters;
+			for (size_t cluster = 0; cluster < count_clusters; ++cluster) {
+				clusters_[2 * cluster] = static_cast<GLuint>(statistics_.count_references);
+				statistics_.count_references += clusters_[2 * cluster + 1];
+				statistics_.max_cluster_lights = std::max(statistics_.max_cluster_lights, static_cast<size_t>(clusters_[2 * cluster + 1]));
+				clusters_[2 * cluster + 1] = 0;
+			}
+
+			light_indices_.resize(statistics_.count_references);
+			for (const Range& range : ranges_) {
+				for (size_t z = range.min[2]; z <= range.max[2]; ++z) {
+					for (size_t y = range.min[1]; y <= range.max[1]; ++y) {
+						for (size_t x = range.min[0]; x <= range.max[0]; ++x) {
+							GLuint* cluster = &clusters_[2 * ((z * used_grid_size_[1] + y) * used_grid_size_[0] + x)];
+							light_indices_[cluster[0] + cluster[1]++] = static_cast<GLuint>(range.memory_id);
+						}
+					}
+				}
+			}
+
+			upload_buffer(clusters_buffer_, clusters_);
+			upload_buffer(light_indices_buffer_, light_indices_);
+		}
+
+		void set_uniforms(const Shader<size_t>& shader) const {
+			if (shader.description != ShaderType::MAIN && shader.description != ShaderType::LIGHTING) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_uniforms, invalid shader type.\n\n");
+			}
+
+			shader.set_uniform_i("cluster_size", static_cast<GLint>(used_grid_size_[0]), static_cast<GLint>(used_grid_size_[1]), static_cast<GLint>(used_grid_size_[2]));
+			shader.set_uniform_f("cluster_direction", direction_);
+			shader.set_uniform_f("cluster_distance", static_cast<GLfloat>(near_), static_cast<GLfloat>(far_));
+
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTERS_BINDING, clusters_buffer_);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_INDICES_BINDING, light_indices_buffer_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void swap(LightClusters& other) noexcept {
+			std::swap(grid_size_, other.grid_size_);
+			std::swap(used_grid_size_, other.used_grid_size_);
+			std::swap(near_, other.near_);
+			std::swap(far_, other.far_);
+			std::swap(direction_, other.direction_);
+			std::swap(clusters_buffer_, other.clusters_buffer_);
+			std::swap(light_indices_buffer_, other.light_indices_buffer_);
+			std::swap(ranges_, other.ranges_);
+			std::swap(clusters_, other.clusters_);
+			std::swap(light_indices_, other.light_indices_);
+			std::swap(statistics_, other.statistics_);
+		}
+
+		~LightClusters() {
+			deallocate();
+		}
+	};
+}
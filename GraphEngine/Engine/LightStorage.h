@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Camera.h"
+#include "GraphObjectStorage.h"
 #include "../Light/Light.h"
 
 
@@ -7,30 +9,369 @@ namespace gre {
 	class LightStorage {
 		friend class GraphEngine;
 
+		// Square of the shadow atlas in texels, empty for layers of lights without shadows
+		struct ShadowTile {
+			size_t light_id = 0;
+			size_t cascade = 0;
+			size_t x = 0;
+			size_t y = 0;
+			size_t size = 0;
+
+			bool operator==(const ShadowTile& other) const noexcept {
+				return light_id == other.light_id && cascade == other.cascade && x == other.x && y == other.y && size == other.size;
+			}
+		};
+
+		// Light, its cascade, tile and transform last drawn into the depth map layer
+		struct ShadowLayer {
+			bool valid = false;
+			bool shadow = false;
+			size_t light_id = 0;
+			size_t cascade = 0;
+			ShadowTile tile;
+			Matrix light_space = Matrix(4, 4);
+		};
+
+		struct ShadowCaster {
+			size_t hash = 0;
+			bool empty = true;
+			Vec3 bounding_min;
+			Vec3 bounding_max;
+		};
+
+		// Fitted rectangles smaller than this part of the clip space are not used
+		inline static const double MIN_SHADOW_CROP = 1e-3;
+		// Weight of logarithmic cascade splits, the rest is uniform
+		inline static const double CASCADE_SPLIT_LAMBDA = 0.75;
+		inline static const size_t MIN_SHADOW_TILE_SIZE = 64;
+		// Part of the view height assumed for lights covering less of the screen
+		inline static const double MIN_SHADOW_COVERAGE = 0.05;
+
+		inline static const GLuint LIGHTS_BINDING = 9;
+
 		GLuint depth_map_frame_buffer_ = 0;
 		GLuint depth_map_texture_id_ = 0;
+		GLuint light_buffer_ = 0;
+
+		size_t shadow_atlas_size_ = 2048;
 
-		size_t shadow_width_ = 1024;
-		size_t shadow_height_ = 1024;
+		size_t count_cascades_ = 1;
+		size_t max_count_cascades_ = 1;
+		double cascade_distance_ = 50.0;
 
-		size_t max_count_lights_;
 		std::vector<size_t> lights_index_;
 		std::vector<size_t> free_light_id_;
 		std::vector<std::pair<size_t, Light*>> lights_;
 
+		size_t count_shadow_updates_ = 0;
+		size_t count_dropped_shadow_layers_ = 0;
+		std::vector<ShadowLayer> shadow_layers_;
+		std::vector<ShadowTile> shadow_tiles_;
+		std::vector<Matrix> shadow_crops_;
+		std::vector<std::vector<Matrix>> cascades_;
+		std::unordered_map<size_t, ShadowCaster> shadow_casters_;
+
+		static void hash_combine(size_t& hash, double value) noexcept {
+			hash ^= std::hash<double>()(value) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+		}
+
+		// Everything of the object that affects depth maps
+		static size_t get_shadow_hash(const GraphObject& object) {
+			size_t hash = 0;
+			for (double value : object.get_geometry_signature()) {
+				hash_combine(hash, value);
+			}
+			for (const auto& [mesh_id, mesh] : object.meshes) {
+				hash_combine(hash, mesh.material.shadow);
+			}
+			for (const auto& [model_id, model] : object.models) {
+				hash_combine(hash, static_cast<double>(model_id));
+				for (size_t i = 0; i < 3; ++i) {
+					for (size_t j = 0; j < 4; ++j) {
+						hash_combine(hash, model[i][j]);
+					}
+				}
+			}
+			return hash;
+		}
+
+		static ShadowCaster get_shadow_caster(const GraphObject& object, size_t hash) {
+			ShadowCaster caster;
+			caster.hash = hash;
+
+			Vec3 bounding_min, bounding_max;
+			if (!object.get_bounding_box(bounding_min, bounding_max)) {
+				return caster;
+			}
+
+			for (const auto& [model_id, model] : object.models) {
+				for (size_t mask = 0; mask < 8; ++mask) {
+					Vec3 corner = model * Vec3((mask & 1) ? bounding_max.x : bounding_min.x, (mask & 2) ? bounding_max.y : bounding_min.y, (mask & 4) ? bounding_max.z : bounding_min.z);
+					caster.bounding_min = caster.empty ? corner : Vec3(std::min(caster.bounding_min.x, corner.x), std::min(caster.bounding_min.y, corner.y), std::min(caster.bounding_min.z, corner.z));
+					caster.bounding_max = caster.empty ? corner : Vec3(std::max(caster.bounding_max.x, corner.x), std::max(caster.bounding_max.y, corner.y), std::max(caster.bounding_max.z, corner.z));
+					caster.empty = false;
+				}
+			}
+			return caster;
+		}
+
+		static bool intersects_frustum(const Matrix& light_space, const ShadowCaster& caster) {
+			return !caster.empty && gre::intersects_frustum(light_space, caster.bounding_min, caster.bounding_max);
+		}
+
+		// Clip space rectangle of the light covering all boxes, boxes crossing the light plane cover the whole map
+		static Matrix get_shadow_crop(const Matrix& light_space, const std::vector<std::pair<Vec3, Vec3>>& boxes, size_t resolution) {
+			Vec2 crop_min(1.0, 1.0), crop_max(-1.0, -1.0);
+			for (const auto& [bounding_min, bounding_max] : boxes) {
+				for (size_t mask = 0; mask < 8; ++mask) {
+					Vec3 corner((mask & 1) ? bounding_max.x : bounding_min.x, (mask & 2) ? bounding_max.y : bounding_min.y, (mask & 4) ? bounding_max.z : bounding_min.z);
+					double clip[4];
+					for (size_t i = 0; i < 4; ++i) {
+						clip[i] = light_space[i][0] * corner.x + light_space[i][1] * corner.y + light_space[i][2] * corner.z + light_space[i][3];
+					}
+					if (less_equality(clip[3], 0.0)) {
+						return Matrix::one_matrix(4);
+					}
+
+					for (size_t i = 0; i < 2; ++i) {
+						crop_min[i] = std::min(crop_min[i], std::max(clip[i] / clip[3], -1.0));
+						crop_max[i] = std::max(crop_max[i], std::min(clip[i] / clip[3], 1.0));
+					}
+				}
+			}
+
+			// Border of two texels keeps filtering inside the rectangle
+			Matrix crop = Matrix::one_matrix(4);
+			for (size_t i = 0; i < 2; ++i) {
+				double border = 2.0 * (crop_max[i] - crop_min[i]) / static_cast<double>(resolution);
+				crop_min[i] = std::max(crop_min[i] - border, -1.0);
+				crop_max[i] = std::min(crop_max[i] + border, 1.0);
+				if (crop_max[i] - crop_min[i] < MIN_SHADOW_CROP) {
+					return crop;
+				}
+
+				crop[i][i] = 2.0 / (crop_max[i] - crop_min[i]);
+				crop[i][3] = -(crop_max[i] + crop_min[i]) / (crop_max[i] - crop_min[i]);
+			}
+			return crop;
+		}
+
+		// Part of the camera view height covered by the bounding sphere of the light volume, one if the camera is inside
+		static double get_screen_coverage(const Matrix& light_space, const Matrix& view_projection) {
+			Matrix inverse = light_space.inverse();
+			std::vector<Vec3> corners;
+			Vec3 center(0.0);
+			for (size_t mask = 0; mask < 8; ++mask) {
+				Vec3 point((mask & 1) ? 1.0 : -1.0, (mask & 2) ? 1.0 : -1.0, (mask & 4) ? 1.0 : -1.0);
+				double w = inverse[3][3];
+				for (size_t i = 0; i < 3; ++i) {
+					w += inverse[3][i] * point[i];
+				}
+				corners.push_back(inverse * point / w);
+				center += corners.back() / 8.0;
+			}
+
+			double radius = 0.0;
+			for (const Vec3& corner : corners) {
+				radius = std::max(radius, (corner - center).length());
+			}
+
+			double w = view_projection[3][3];
+			Vec3 row_y(view_projection[1][0], view_projection[1][1], view_projection[1][2]);
+			for (size_t i = 0; i < 3; ++i) {
+				w += view_projection[3][i] * center[i];
+			}
+			if (less_equality(w, radius * Vec3(view_projection[3][0], view_projection[3][1], view_projection[3][2]).length())) {
+				return 1.0;
+			}
+			return std::min(radius * row_y.length() / w, 1.0);
+		}
+
+		// Interleaved bits of the code, even bits give x and odd bits give y
+		static std::pair<size_t, size_t> decode_morton(size_t code) noexcept {
+			std::pair<size_t, size_t> result(0, 0);
+			for (size_t bit = 0; 2 * bit < 8 * sizeof(size_t); ++bit) {
+				result.first |= ((code >> (2 * bit)) & 1) << bit;
+				result.second |= ((code >> (2 * bit + 1)) & 1) << bit;
+			}
+			return result;
+		}
+
+		const ShadowTile& get_shadow_tile(size_t id, size_t cascade) const {
+			static const ShadowTile empty_tile;
+			size_t layer_id = get_layer(id, cascade);
+			return layer_id < shadow_tiles_.size() && shadow_tiles_[layer_id].light_id == id && shadow_tiles_[layer_id].cascade == cascade ? shadow_tiles_[layer_id] : empty_tile;
+		}
+
+		// Gives every shadow layer a power of two tile with area proportional to the light importance and screen coverage summed over cameras
+		// Tiles keep their size while the wanted size stays near it, returns true if any tile changed
+		bool pack_shadow_atlas(const std::vector<const Camera*>& cameras) {
+			struct Request {
+				size_t layer_id = 0;
+				double weight = 0.0;
+				ShadowTile tile;
+			};
+
+			std::vector<Request> requests;
+			double total_weight = 0.0;
+			for (const auto& [light_id, light] : lights_) {
+				if (!light->shadow) {
+					continue;
+				}
+
+				double coverage = 1.0;
+				if (!cameras.empty() && get_count_shadow_layers(light_id) == 1) {
+					coverage = 0.0;
+					for (const Camera* camera : cameras) {
+						coverage += get_screen_coverage(light->get_light_space_matrix(), camera->get_projection_matrix() * camera->get_view_matrix());
+					}
+					coverage = std::max(coverage, MIN_SHADOW_COVERAGE);
+				}
+				for (size_t cascade = 0; cascade < get_count_shadow_layers(light_id); ++cascade) {
+					Request request;
+					request.layer_id = get_layer(light_id, cascade);
+					request.weight = std::max(light->shadow_importance, 0.0) * coverage;
+					request.tile.light_id = light_id;
+					request.tile.cascade = cascade;
+					requests.push_back(request);
+					total_weight += request.weight;
+				}
+			}
+
+			size_t min_tile_size = std::min(MIN_SHADOW_TILE_SIZE, shadow_atlas_size_);
+			double atlas_area = 0.0;
+			for (Request& request : requests) {
+				double part = equality(total_weight, 0.0) ? 1.0 / static_cast<double>(requests.size()) : request.weight / total_weight;
+				double wanted = std::log2(static_cast<double>(shadow_atlas_size_) * std::sqrt(part));
+				const ShadowTile& previous = get_shadow_tile(request.tile.light_id, request.tile.cascade);
+				double level = std::floor(wanted);
+				if (previous.size > 0 && wanted >= std::log2(static_cast<double>(previous.size)) - 0.25 && wanted < std::log2(static_cast<double>(previous.size)) + 1.25) {
+					level = std::log2(static_cast<double>(previous.size));
+				}
+
+				request.tile.size = std::clamp(static_cast<size_t>(1) << static_cast<size_t>(std::max(level, 0.0)), min_tile_size, shadow_atlas_size_);
+				atlas_area += static_cast<double>(request.tile.size * request.tile.size);
+			}
+
+			// The largest tiles are halved until all tiles fit into the atlas, tiles are not made smaller than min_tile_size
+			while (atlas_area > static_cast<double>(shadow_atlas_size_ * shadow_atlas_size_)) {
+				auto largest = std::max_element(requests.begin(), requests.end(), [](const Request& left, const Request& right) {
+					return left.tile.size < right.tile.size;
+				});
+				if (largest->tile.size <= min_tile_size) {
+					break;
+				}
+
+				atlas_area -= 0.75 * static_cast<double>(largest->tile.size * largest->tile.size);
+				largest->tile.size /= 2;
+			}
+
+			// If the smallest tiles still do not fit, layers with the lowest weight get no tile and cast no shadows
+			std::stable_sort(requests.begin(), requests.end(), [](const Request& left, const Request& right) {
+				return left.weight > right.weight;
+			});
+			count_dropped_shadow_layers_ = 0;
+			while (atlas_area > static_cast<double>(shadow_atlas_size_ * shadow_atlas_size_)) {
+				atlas_area -= static_cast<double>(requests.back().tile.size * requests.back().tile.size);
+				requests.pop_back();
+				++count_dropped_shadow_layers_;
+			}
+			std::stable_sort(requests.begin(), requests.end(), [](const Request& left, const Request& right) {
+				return left.tile.size > right.tile.size;
+			});
+
+			// Offsets of squares sorted by decreasing power of two sizes are aligned to their areas, so Morton order packs them without gaps
+			std::vector<ShadowTile> shadow_tiles(lights_.size() * count_cascades_);
+			size_t offset = 0;
+			for (Request& request : requests) {
+				std::tie(request.tile.x, request.tile.y) = decode_morton(offset);
+				offset += request.tile.size * request.tile.size;
+				shadow_tiles[request.layer_id] = request.tile;
+			}
+
+			bool changed = shadow_tiles != shadow_tiles_;
+			shadow_tiles_.swap(shadow_tiles);
+			return changed;
+		}
+
+		// Compares lights and shadow casters with the previous call, result[get_layer(id, cascade)] is true if the layer must be redrawn
+		std::vector<bool> update_shadow_layers(const GraphObjectStorage& objects) {
+			shadow_layers_.resize(lights_.size() * count_cascades_);
+
+			std::vector<bool> dirty(lights_.size() * count_cascades_, false);
+			std::vector<bool> used(dirty.size(), false);
+			for (const auto& [light_id, light] : lights_) {
+				for (size_t cascade = 0; cascade < get_count_shadow_layers(light_id); ++cascade) {
+					size_t layer_id = get_layer(light_id, cascade);
+					const ShadowLayer& layer = shadow_layers_[layer_id];
+					const ShadowTile& tile = get_shadow_tile(light_id, cascade);
+					used[layer_id] = tile.size > 0;
+					dirty[layer_id] = used[layer_id] && (!layer.valid || layer.light_id != light_id || layer.cascade != cascade || layer.shadow != light->shadow || !(layer.tile == tile) || layer.light_space != get_light_space_matrix(light_id, cascade));
+				}
+			}
+
+			auto mark_lights = [&](const ShadowCaster& caster) {
+				for (size_t layer_id = 0; layer_id < dirty.size(); ++layer_id) {
+					if (used[layer_id] && !dirty[layer_id] && intersects_frustum(shadow_layers_[layer_id].light_space, caster)) {
+						dirty[layer_id] = true;
+					}
+				}
+			};
+
+			for (auto caster = shadow_casters_.begin(); caster != shadow_casters_.end();) {
+				if (objects.contains(caster->first)) {
+					++caster;
+					continue;
+				}
+
+				mark_lights(caster->second);
+				caster = shadow_casters_.erase(caster);
+			}
+
+			for (const auto& [object_id, object] : objects) {
+				size_t hash = get_shadow_hash(object);
+				auto caster = shadow_casters_.find(object_id);
+				if (caster != shadow_casters_.end() && caster->second.hash == hash) {
+					continue;
+				}
+
+				if (caster != shadow_casters_.end()) {
+					mark_lights(caster->second);
+				}
+				ShadowCaster new_caster = get_shadow_caster(object, hash);
+				mark_lights(new_caster);
+				shadow_casters_[object_id] = new_caster;
+			}
+
+			count_shadow_updates_ = 0;
+			for (const auto& [light_id, light] : lights_) {
+				for (size_t cascade = 0; cascade < get_count_shadow_layers(light_id); ++cascade) {
+					size_t layer_id = get_layer(light_id, cascade);
+					if (dirty[layer_id]) {
+						shadow_layers_[layer_id] = { true, light->shadow, light_id, cascade, get_shadow_tile(light_id, cascade), get_light_space_matrix(light_id, cascade) };
+						++count_shadow_updates_;
+					}
+				}
+			}
+			return dirty;
+		}
+
 		LightStorage() noexcept {
-			max_count_lights_ = 0;
 		}
 
 		LightStorage(const LightStorage& other) {
-			shadow_width_ = other.shadow_width_;
-			shadow_height_ = other.shadow_height_;
-			max_count_lights_ = other.max_count_lights_;
+			shadow_atlas_size_ = other.shadow_atlas_size_;
+			count_cascades_ = other.count_cascades_;
+			max_count_cascades_ = other.max_count_cascades_;
+			cascade_distance_ = other.cascade_distance_;
 			lights_index_ = other.lights_index_;
 			free_light_id_ = other.free_light_id_;
 			lights_ = other.lights_;
 
-			create_depth_map_frame_buffer(max_count_lights_);
+			if (other.depth_map_frame_buffer_ != 0) {
+				create_depth_map_frame_buffer(max_count_cascades_);
+			}
+			invalidate_shadows();
 		}
 
 		LightStorage(LightStorage&& other) noexcept {
@@ -49,57 +390,161 @@ namespace gre {
 			return *this;
 		}
 
-		void set_uniforms(const Shader<size_t>& shader) const {
+		// Lights buffer is indexed by memory ids of lights
+		void set_uniforms(const Shader<size_t>& shader) {
 			if (shader.description != ShaderType::MAIN) {
 				throw GreInvalidArgument(__FILE__, __LINE__, "set_uniforms, invalid shader type.\n\n");
 			}
 
-			shader.set_uniform_i("number_lights", static_cast<GLint>(lights_.size()));
+			std::vector<LightData> data;
+			data.reserve(lights_.size());
 			for (const auto& [id, light] : lights_) {
-				light->set_uniforms(lights_index_[id], shader);
+				data.push_back(light->get_data());
+
+				size_t count_layers = get_count_shadow_layers(id);
+				data.back().cascades = static_cast<GLint>(count_layers > 1 ? count_layers : 0);
+				if (!light->shadow) {
+					continue;
+				}
+
+				LightData::copy(get_shadow_matrix(id), data.back().light_space);
+				for (size_t cascade = 0; cascade < count_layers; ++cascade) {
+					const ShadowTile& tile = get_shadow_tile(id, cascade);
+					GLfloat atlas_size = static_cast<GLfloat>(shadow_atlas_size_);
+					GLfloat* shadow_tile = data.back().shadow_tiles[cascade];
+					shadow_tile[0] = tile.x / atlas_size;
+					shadow_tile[1] = tile.y / atlas_size;
+					shadow_tile[2] = (tile.x + tile.size) / atlas_size;
+					shadow_tile[3] = (tile.y + tile.size) / atlas_size;
+					if (count_layers > 1) {
+						LightData::copy(get_shadow_matrix(id, cascade), data.back().cascade_spaces[cascade]);
+					}
+				}
+			}
+
+			if (light_buffer_ == 0) {
+				glGenBuffers(1, &light_buffer_);
+			}
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, light_buffer_);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(data.size(), static_cast<size_t>(1)) * sizeof(LightData), data.empty() ? nullptr : &data[0], GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHTS_BINDING, light_buffer_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		// Splits frustums of cameras up to the cascade distance between cascades of lights which support them
+		// Every cascade covers its parts of all frustums, so one depth map serves all cameras
+		void fit_cascades(const std::vector<const Camera*>& cameras) {
+			cascades_.clear();
+			cascades_.resize(lights_.size());
+			if (count_cascades_ == 1 || cameras.empty()) {
+				return;
+			}
+
+			std::vector<std::vector<Vec3>> cascade_corners(count_cascades_);
+			for (const Camera* camera : cameras) {
+				Matrix inverse = (camera->get_projection_matrix() * camera->get_view_matrix()).inverse();
+				std::vector<Vec3> near_corners, far_corners;
+				for (size_t mask = 0; mask < 8; ++mask) {
+					Vec3 point((mask & 1) ? 1.0 : -1.0, (mask & 2) ? 1.0 : -1.0, (mask & 4) ? 1.0 : -1.0);
+					double w = inverse[3][3];
+					for (size_t i = 0; i < 3; ++i) {
+						w += inverse[3][i] * point[i];
+					}
+					((mask & 4) ? far_corners : near_corners).push_back(inverse * point / w);
+				}
+
+				double min_distance = camera->get_min_distance(), max_distance = camera->get_max_distance();
+				double distance = std::min(cascade_distance_, max_distance);
+				for (size_t cascade = 0; cascade < count_cascades_; ++cascade) {
+					for (size_t side = 0; side < 2; ++side) {
+						double part = static_cast<double>(cascade + side) / static_cast<double>(count_cascades_);
+						double split = CASCADE_SPLIT_LAMBDA * min_distance * std::pow(distance / min_distance, part) + (1.0 - CASCADE_SPLIT_LAMBDA) * (min_distance + (distance - min_distance) * part);
+						double t = (split - min_distance) / (max_distance - min_distance);
+						for (size_t i = 0; i < 4; ++i) {
+							cascade_corners[cascade].push_back(near_corners[i] + (far_corners[i] - near_corners[i]) * t);
+						}
+					}
+				}
 			}
+
+			for (size_t memory_id = 0; memory_id < lights_.size(); ++memory_id) {
+				for (size_t cascade = 0; cascade < count_cascades_; ++cascade) {
+					size_t resolution = get_shadow_tile(lights_[memory_id].first, cascade).size;
+					resolution = resolution > 0 ? resolution : shadow_atlas_size_;
+
+					Matrix light_space(4, 4);
+					if (!lights_[memory_id].second->get_cascade_matrix(cascade_corners[cascade], Vec2(static_cast<double>(resolution)), light_space)) {
+						cascades_[memory_id].clear();
+						break;
+					}
+					cascades_[memory_id].push_back(light_space);
+				}
+			}
+		}
+
+		// Projections of lights are fitted to the boxes of visible receivers, see get_shadow_crop
+		void fit_shadow_crops(const std::vector<std::pair<Vec3, Vec3>>& receivers) {
+			shadow_crops_.clear();
+			for (size_t memory_id = 0; memory_id < lights_.size(); ++memory_id) {
+				size_t resolution = get_shadow_tile(lights_[memory_id].first, 0).size;
+				shadow_crops_.push_back(get_shadow_crop(lights_[memory_id].second->get_light_space_matrix(), receivers, resolution > 0 ? resolution : shadow_atlas_size_));
+			}
+		}
+
+		void clear_shadow_crops() noexcept {
+			shadow_crops_.clear();
 		}
 
 		void set_framebuffer() const {
 			glBindFramebuffer(GL_FRAMEBUFFER, depth_map_frame_buffer_);
-			glViewport(0, 0, static_cast<GLsizei>(shadow_width_), static_cast<GLsizei>(shadow_height_));
 			check_gl_errors(__FILE__, __LINE__, __func__);
 		}
 
-		void set_depth_map_texture(size_t id) const {
-			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, static_cast<GLint>(depth_map_texture_id_), 0, static_cast<GLint>(lights_index_[id]));
+		// Viewport is set to the tile of the layer, only the tile is cleared
+		void set_depth_map_texture(size_t id, size_t cascade = 0) const {
+			const ShadowTile& tile = get_shadow_tile(id, cascade);
+			glViewport(static_cast<GLint>(tile.x), static_cast<GLint>(tile.y), static_cast<GLsizei>(tile.size), static_cast<GLsizei>(tile.size));
+			glScissor(static_cast<GLint>(tile.x), static_cast<GLint>(tile.y), static_cast<GLsizei>(tile.size), static_cast<GLsizei>(tile.size));
+			glEnable(GL_SCISSOR_TEST);
 			glClear(GL_DEPTH_BUFFER_BIT);
+			glDisable(GL_SCISSOR_TEST);
 			check_gl_errors(__FILE__, __LINE__, __func__);
 		}
 
-		void create_depth_map_frame_buffer(size_t max_count_lights) {
-			max_count_lights_ = max_count_lights;
-
-			if (max_count_lights_ == 0) {
-				return;
+		void create_depth_map_frame_buffer(size_t max_count_cascades) {
+			if (max_count_cascades == 0 || LightData::MAX_COUNT_CASCADES < max_count_cascades) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "create_depth_map_frame_buffer, invalid number of cascades.\n\n");
 			}
 
+			max_count_cascades_ = max_count_cascades;
+			count_cascades_ = std::min(count_cascades_, max_count_cascades_);
+
 			glGenTextures(1, &depth_map_texture_id_);
-			glBindTexture(GL_TEXTURE_2D_ARRAY, depth_map_texture_id_);
-			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, static_cast<GLsizei>(shadow_width_), static_cast<GLsizei>(shadow_height_), static_cast<GLsizei>(max_count_lights_), 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+			glBindTexture(GL_TEXTURE_2D, depth_map_texture_id_);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, static_cast<GLsizei>(shadow_atlas_size_), static_cast<GLsizei>(shadow_atlas_size_), 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 			GLfloat border_olor[] = { 1.0, 1.0, 1.0, 1.0 };
-			glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_olor);
-			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+			glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_olor);
+			glBindTexture(GL_TEXTURE_2D, 0);
 
 			glGenFramebuffers(1, &depth_map_frame_buffer_);
 			glBindFramebuffer(GL_FRAMEBUFFER, depth_map_frame_buffer_);
 
-			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_map_texture_id_, 0, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_map_texture_id_, 0);
 			glDrawBuffer(GL_NONE);
 			glReadBuffer(GL_NONE);
 
 			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
 				throw GreRuntimeError(__FILE__, __LINE__, "create_depth_map_frame_buffer, framebuffer is not complete.\n\n");
 			}
+			set_gl_object_label(GL_TEXTURE, depth_map_texture_id_, "shadow atlas");
+			set_gl_object_label(GL_FRAMEBUFFER, depth_map_frame_buffer_, "shadow atlas frame buffer");
 
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
 			check_gl_errors(__FILE__, __LINE__, __func__);
@@ -108,21 +553,32 @@ namespace gre {
 		void swap(LightStorage& other) noexcept {
 			std::swap(depth_map_frame_buffer_, other.depth_map_frame_buffer_);
 			std::swap(depth_map_texture_id_, other.depth_map_texture_id_);
-			std::swap(shadow_width_, other.shadow_width_);
-			std::swap(shadow_height_, other.shadow_height_);
-			std::swap(max_count_lights_, other.max_count_lights_);
+			std::swap(light_buffer_, other.light_buffer_);
+			std::swap(shadow_atlas_size_, other.shadow_atlas_size_);
+			std::swap(count_cascades_, other.count_cascades_);
+			std::swap(max_count_cascades_, other.max_count_cascades_);
+			std::swap(cascade_distance_, other.cascade_distance_);
 			std::swap(lights_index_, other.lights_index_);
 			std::swap(free_light_id_, other.free_light_id_);
 			std::swap(lights_, other.lights_);
+			std::swap(count_shadow_updates_, other.count_shadow_updates_);
+			std::swap(count_dropped_shadow_layers_, other.count_dropped_shadow_layers_);
+			std::swap(shadow_layers_, other.shadow_layers_);
+			std::swap(shadow_tiles_, other.shadow_tiles_);
+			std::swap(shadow_crops_, other.shadow_crops_);
+			std::swap(cascades_, other.cascades_);
+			std::swap(shadow_casters_, other.shadow_casters_);
 		}
 
 		void deallocate() {
 			glDeleteFramebuffers(1, &depth_map_frame_buffer_);
 			glDeleteTextures(1, &depth_map_texture_id_);
+			glDeleteBuffers(1, &light_buffer_);
 			check_gl_errors(__FILE__, __LINE__, __func__);
 
 			depth_map_frame_buffer_ = 0;
 			depth_map_texture_id_ = 0;
+			light_buffer_ = 0;
 		}
 
 	public:
@@ -145,14 +601,50 @@ namespace gre {
 			return lights_[lights_index_[id]].second;
 		}
 
-		LightStorage& set_shadow_resolution(size_t width, size_t height) {
-			glBindTexture(GL_TEXTURE_2D_ARRAY, depth_map_texture_id_);
-			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, static_cast<GLsizei>(width), static_cast<GLsizei>(height), static_cast<GLsizei>(max_count_lights_), 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-			glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		// Side of the square depth texture shared by all lights, the only limit of shadow memory
+		LightStorage& set_shadow_atlas_size(size_t shadow_atlas_size) {
+			if (shadow_atlas_size == 0 || (shadow_atlas_size & (shadow_atlas_size - 1)) != 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_shadow_atlas_size, size is not a power of two.\n\n");
+			}
+
+			glBindTexture(GL_TEXTURE_2D, depth_map_texture_id_);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, static_cast<GLsizei>(shadow_atlas_size), static_cast<GLsizei>(shadow_atlas_size), 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+			glBindTexture(GL_TEXTURE_2D, 0);
 			check_gl_errors(__FILE__, __LINE__, __func__);
 
-			shadow_width_ = width;
-			shadow_height_ = height;
+			shadow_atlas_size_ = shadow_atlas_size;
+			shadow_tiles_.clear();
+			invalidate_shadows();
+			return *this;
+		}
+
+		// More than one cascade splits the view of the first camera between layers of every directional light, each layer gets its own atlas tile
+		LightStorage& set_count_cascades(size_t count_cascades) {
+			if (count_cascades == 0 || max_count_cascades_ < count_cascades) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_count_cascades, invalid number of cascades.\n\n");
+			}
+
+			count_cascades_ = count_cascades;
+			cascades_.clear();
+			shadow_tiles_.clear();
+			invalidate_shadows();
+			return *this;
+		}
+
+		// Distance from the camera covered by cascades
+		LightStorage& set_cascade_distance(double cascade_distance) {
+			if (less_equality(cascade_distance, 0.0)) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_cascade_distance, not a positive distance.\n\n");
+			}
+
+			cascade_distance_ = cascade_distance;
+			return *this;
+		}
+
+		// Depth maps of all lights are redrawn on the next frame
+		LightStorage& invalidate_shadows() noexcept {
+			shadow_layers_.clear();
+			shadow_casters_.clear();
 			return *this;
 		}
 
@@ -172,12 +664,78 @@ namespace gre {
 			return lights_[memory_id].first;
 		}
 
-		size_t get_max_count_lights() const noexcept {
-			return max_count_lights_;
+		// Light space matrix used for the depth map layer, includes the fitted crop of the light projection
+		Matrix get_light_space_matrix(size_t id, size_t cascade = 0) const {
+			if (get_count_shadow_layers(id) <= cascade) {
+				throw GreOutOfRange(__FILE__, __LINE__, "get_light_space_matrix, invalid cascade.\n\n");
+			}
+
+			size_t memory_id = lights_index_[id];
+			if (memory_id < cascades_.size() && !cascades_[memory_id].empty()) {
+				return cascades_[memory_id][cascade];
+			}
+
+			Matrix light_space = lights_[memory_id].second->get_light_space_matrix();
+			return memory_id < shadow_crops_.size() ? shadow_crops_[memory_id] * light_space : light_space;
+		}
+
+		// Light space matrix of the layer mapped into its atlas tile, used for sampling
+		Matrix get_shadow_matrix(size_t id, size_t cascade = 0) const {
+			const ShadowTile& tile = get_shadow_tile(id, cascade);
+			double scale = static_cast<double>(tile.size) / static_cast<double>(shadow_atlas_size_);
+
+			Matrix tile_matrix = Matrix::one_matrix(4);
+			tile_matrix[0][0] = scale;
+			tile_matrix[1][1] = scale;
+			tile_matrix[0][3] = 2.0 * static_cast<double>(tile.x) / static_cast<double>(shadow_atlas_size_) + scale - 1.0;
+			tile_matrix[1][3] = 2.0 * static_cast<double>(tile.y) / static_cast<double>(shadow_atlas_size_) + scale - 1.0;
+			return tile_matrix * get_light_space_matrix(id, cascade);
+		}
+
+		// Side of the atlas tile of the layer in texels, zero for lights without shadows
+		size_t get_shadow_tile_size(size_t id, size_t cascade = 0) const {
+			return get_shadow_tile(id, cascade).size;
+		}
+
+		// Number of depth map layers of the light, more than one for lights split into cascades
+		size_t get_count_shadow_layers(size_t id) const {
+			if (!contains(id)) {
+				throw GreOutOfRange(__FILE__, __LINE__, "get_count_shadow_layers, invalid light id.\n\n");
+			}
+
+			size_t memory_id = lights_index_[id];
+			return memory_id < cascades_.size() && !cascades_[memory_id].empty() ? cascades_[memory_id].size() : 1;
+		}
+
+		// Index of the shadow layer, its tile in the atlas is stored by this index
+		size_t get_layer(size_t id, size_t cascade = 0) const {
+			if (!contains(id) || count_cascades_ <= cascade) {
+				throw GreOutOfRange(__FILE__, __LINE__, "get_layer, invalid light id or cascade.\n\n");
+			}
+
+			return lights_index_[id] * count_cascades_ + cascade;
+		}
+
+		size_t get_count_cascades() const noexcept {
+			return count_cascades_;
 		}
 
-		Vec2 get_shadow_resolution() const noexcept {
-			return Vec2(static_cast<double>(shadow_width_), static_cast<double>(shadow_height_));
+		double get_cascade_distance() const noexcept {
+			return cascade_distance_;
+		}
+
+		// Number of depth map layers redrawn in the last frame
+		size_t get_count_shadow_updates() const noexcept {
+			return count_shadow_updates_;
+		}
+
+		// Number of shadow layers left without atlas tile in the last frame, they do not fit even with the smallest tiles
+		size_t get_count_dropped_shadow_layers() const noexcept {
+			return count_dropped_shadow_layers_;
+		}
+
+		size_t get_shadow_atlas_size() const noexcept {
+			return shadow_atlas_size_;
 		}
 
 		bool contains(size_t id) const noexcept {
@@ -235,10 +793,6 @@ namespace gre {
 		}
 
 		size_t insert(Light* light) {
-			if (lights_.size() == max_count_lights_) {
-				throw GreRuntimeError(__FILE__, __LINE__, "insert, too many lights created.\n\n");
-			}
-
 			size_t free_light_id = lights_index_.size();
 			if (free_light_id_.empty()) {
 				lights_index_.push_back(lights_.size());
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "GraphObjectStorage.h"
+
+
+namespace gre {
+	// Chooses level of detail for every model by its projected size, one instance per camera or light
+	class LodSelector {
+		double detail_threshold_ = 0.5;
+		double hysteresis_ = 0.1;
+
+		Matrix view_projection_ = Matrix(4, 4);
+		std::unordered_map<size_t, std::unordered_map<size_t, size_t>> lods_;
+
+		// Part of the half view height covered by the bounding sphere of the model
+		double get_projected_size(const GraphObject& object, const Matrix& model) const {
+			Vec3 bounding_min, bounding_max;
+			if (!object.get_bounding_box(bounding_min, bounding_max)) {
+				return 0.0;
+			}
+
+			Vec3 center = model * ((bounding_min + bounding_max) / 2.0);
+			double radius = 0.0;
+			for (size_t mask = 0; mask < 8; ++mask) {
+				Vec3 corner((mask & 1) ? bounding_max.x : bounding_min.x, (mask & 2) ? bounding_max.y : bounding_min.y, (mask & 4) ? bounding_max.z : bounding_min.z);
+				radius = std::max(radius, (model * corner - center).length());
+			}
+
+			double w = view_projection_[3][3];
+			Vec3 row_y(view_projection_[1][0], view_projection_[1][1], view_projection_[1][2]);
+			for (size_t i = 0; i < 3; ++i) {
+				w += view_projection_[3][i] * center[i];
+			}
+			if (less_equality(w, 0.0)) {
+				return std::numeric_limits<double>::infinity();
+			}
+			return radius * row_y.length() / w;
+		}
+
+		size_t get_lod(double projected_size, size_t count_lods) const noexcept {
+			size_t lod = 0;
+			for (double threshold = detail_threshold_; lod + 1 < count_lods && projected_size < threshold; threshold /= 2.0) {
+				++lod;
+			}
+			return lod;
+		}
+
+	public:
+		LodSelector() noexcept {
+		}
+
+		// Models smaller than detail_threshold of the half view height use the first simplified level, each next level begins at half the size
+		LodSelector& set_detail_threshold(double detail_threshold) {
+			if (less_equality(detail_threshold, 0.0)) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_detail_threshold, invalid threshold value.\n\n");
+			}
+
+			detail_threshold_ = detail_threshold;
+			return *this;
+		}
+
+		// Relative change of the projected size required to switch level back, prevents popping on boundaries
+		LodSelector& set_hysteresis(double hysteresis) {
+			if (hysteresis < 0.0 || less_equality(1.0, hysteresis)) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_hysteresis, invalid hysteresis value.\n\n");
+			}
+
+			hysteresis_ = hysteresis;
+			return *this;
+		}
+
+		double get_detail_threshold() const noexcept {
+			return detail_threshold_;
+		}
+
+		double get_hysteresis() const noexcept {
+			return hysteresis_;
+		}
+
+		void begin_frame(const GraphObjectStorage& objects, const Matrix& view_projection) {
+			view_projection_ = view_projection;
+			for (auto object_lods = lods_.begin(); object_lods != lods_.end();) {
+				if (!objects.contains(object_lods->first)) {
+					object_lods = lods_.erase(object_lods);
+					continue;
+				}
+
+				const GraphObject& object = objects[object_lods->first];
+				for (auto model_lod = object_lods->second.begin(); model_lod != object_lods->second.end();) {
+					model_lod = object.models.contains(model_lod->first) ? std::next(model_lod) : object_lods->second.erase(model_lod);
+				}
+				++object_lods;
+			}
+		}
+
+		size_t select(size_t object_id, size_t model_id, const GraphObject& object) {
+			size_t count_lods = object.get_count_lods();
+			if (count_lods == 1) {
+				return 0;
+			}
+
+			double projected_size = get_projected_size(object, object.models[model_id]);
+			auto [state, inserted] = lods_[object_id].insert({ model_id, get_lod(projected_size, count_lods) });
+			if (inserted) {
+				return state->second;
+			}
+
+			size_t& lod = state->second;
+			lod = std::min(lod, count_lods - 1);
+			if (get_lod(projected_size * (1.0 + hysteresis_), count_lods) > lod) {
+				lod = get_lod(projected_size * (1.0 + hysteresis_), count_lods);
+			} else if (get_lod(projected_size * (1.0 - hysteresis_), count_lods) < lod) {
+				lod = get_lod(projected_size * (1.0 - hysteresis_), count_lods);
+			}
+			return lod;
+		}
+	};
+}
@@ -0,0 +1,656 @@
+#pragma once
+
+#include <array>
+#include <future>
+#include <thread>
+#include "Camera.h"
+#include "GraphObjectStorage.h"
+
+
+namespace gre {
+	// Software occlusion culling, the largest opaque objects are rasterized into low resolution depth buffer on worker threads
+	class OcclusionCuller {
+	public:
+		struct Statistics {
+			size_t count_occluders = 0;
+			size_t count_occluder_triangles = 0;
+			size_t count_tested = 0;
+			size_t count_culled = 0;
+			// Views which used the previous result reprojected to the moved camera
+			size_t count_reprojected = 0;
+			// Views which culled nothing because the previous result was missing or its occluders were moved
+			size_t count_discarded = 0;
+
+			Statistics& operator+=(const Statistics& other) noexcept {
+				count_occluders += other.count_occluders;
+				count_occluder_triangles += other.count_occluder_triangles;
+				count_tested += other.count_tested;
+				count_culled += other.count_culled;
+				count_reprojected += other.count_reprojected;
+				count_discarded += other.count_discarded;
+				return *this;
+			}
+
+			double get_cull_rate() const noexcept {
+				return count_tested == 0 ? 0.0 : static_cast<double>(count_culled) / static_cast<double>(count_tested);
+			}
+		};
+
+	private:
+		using Transform = std::array<GLfloat, 16>;
+
+		// Triangle list of object meshes in model space, read back once per object
+		struct Geometry {
+			std::vector<double> signature;
+			std::shared_ptr<const std::vector<GLfloat>> triangles;
+		};
+
+		struct Instance {
+			size_t object_id = 0;
+			size_t model_id = 0;
+			Transform transform;
+			std::array<GLfloat, 3> bounding_min;
+			std::array<GLfloat, 3> bounding_max;
+		};
+
+		struct Occluder {
+			Transform transform;
+			std::shared_ptr<const std::vector<GLfloat>> triangles;
+		};
+
+		// Everything worker threads need, objects storage is not touched after start
+		struct Snapshot {
+			size_t width = 0;
+			size_t height = 0;
+			std::vector<Instance> instances;
+			std::vector<Occluder> occluders;
+		};
+
+		struct Result {
+			std::vector<std::vector<GLfloat>> depth_levels;
+			std::vector<bool> culled;
+			Statistics statistics;
+		};
+
+		// Screen space vertex, x and y in pixels, z in [0, 1]
+		struct ScreenVertex {
+			GLfloat x = 0.0;
+			GLfloat y = 0.0;
+			GLfloat z = 0.0;
+		};
+
+		inline static const GLfloat EPSILON = 1e-6f;
+
+		size_t width_ = 256;
+		size_t height_ = 128;
+		size_t max_occluders_ = 64;
+		size_t max_occluder_triangles_ = 16384;
+
+		Matrix view_projection_ = Matrix(4, 4);
+		std::vector<std::pair<size_t, size_t>> occluder_models_;
+		std::vector<Matrix> occluder_transforms_;
+		std::vector<Instance> instances_;
+		std::vector<Matrix> instance_transforms_;
+		std::unordered_map<size_t, Geometry> geometry_;
+
+		std::future<Result> job_;
+		bool pending_ = false;
+		bool actual_ = false;
+		std::vector<std::vector<GLfloat>> depth_levels_;
+		std::unordered_map<size_t, std::unordered_map<size_t, Matrix>> culled_;
+		Statistics statistics_;
+
+		static Transform get_transform(const Matrix& matrix) {
+			Transform result;
+			for (size_t i = 0; i < 4; ++i) {
+				for (size_t j = 0; j < 4; ++j) {
+					result[4 * i + j] = static_cast<GLfloat>(matrix[i][j]);
+				}
+			}
+			return result;
+		}
+
+		static std::array<GLfloat, 4> apply_transform(const Transform& transform, GLfloat x, GLfloat y, GLfloat z) noexcept {
+			std::array<GLfloat, 4> result;
+			for (size_t i = 0; i < 4; ++i) {
+				result[i] = transform[4 * i] * x + transform[4 * i + 1] * y + transform[4 * i + 2] * z + transform[4 * i + 3];
+			}
+			return result;
+		}
+
+		// Calls func(begin, end) on disjoint parts of [0, count) in parallel
+		template <typename Func>
+		static void parallel_for(size_t count, Func func) {
+			size_t count_parts = std::min(count, static_cast<size_t>(std::max(std::thread::hardware_concurrency(), 1u)));
+			std::vector<std::future<void>> parts;
+			for (size_t i = 1; i < count_parts; ++i) {
+				parts.push_back(std::async(std::launch::async, func, count * i / count_parts, count * (i + 1) / count_parts));
+			}
+			if (count_parts > 0) {
+				func(0, count / count_parts);
+			}
+			for (auto& part : parts) {
+				part.get();
+			}
+		}
+
+		static std::vector<GLfloat> get_triangles(const GraphObject& object) {
+			std::vector<GLfloat> triangles;
+			for (const auto& [mesh_id, mesh] : object.meshes) {
+				if (mesh.frame || !mesh.material.is_opaque() || mesh.get_count_indices() < 3) {
+					continue;
+				}
+
+				std::vector<Vec3> positions = mesh.get_positions();
+				std::vector<GLuint> indices = mesh.get_indices();
+				for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+					for (size_t j = 0; j < 3; ++j) {
+						const Vec3& position = positions[indices[i + j]];
+						triangles.insert(triangles.end(), { static_cast<GLfloat>(position.x), static_cast<GLfloat>(position.y), static_cast<GLfloat>(position.z) });
+					}
+				}
+			}
+			return triangles;
+		}
+
+		const Geometry& get_geometry(size_t object_id, const GraphObject& object) {
+			std::vector<double> signature = object.get_geometry_signature();
+			auto geometry = geometry_.find(object_id);
+			if (geometry == geometry_.end() || geometry->second.signature != signature) {
+				geometry_[object_id] = { signature, std::make_shared<const std::vector<GLfloat>>(get_triangles(object)) };
+			}
+			return geometry_[object_id];
+		}
+
+		static ScreenVertex to_screen(const std::array<GLfloat, 4>& clip, size_t width, size_t height) noexcept {
+			ScreenVertex result;
+			result.x = (clip[0] / clip[3] * 0.5f + 0.5f) * static_cast<GLfloat>(width);
+			result.y = (clip[1] / clip[3] * 0.5f + 0.5f) * static_cast<GLfloat>(height);
+			result.z = clip[2] / clip[3] * 0.5f + 0.5f;
+			return result;
+		}
+
+		// Triangles crossing the near plane are skipped, it only loses occlusion
+		static std::vector<ScreenVertex> transform_occluders(const Snapshot& snapshot, size_t& count_triangles) {
+			std::vector<ScreenVertex> vertices;
+			for (const Occluder& occluder : snapshot.occluders) {
+				const std::vector<GLfloat>& triangles = *occluder.triangles;
+				for (size_t i = 0; i + 8 < triangles.size(); i += 9) {
+					std::array<ScreenVertex, 3> triangle;
+					bool clipped = false;
+					for (size_t j = 0; j < 3 && !clipped; ++j) {
+						std::array<GLfloat, 4> clip = apply_transform(occluder.transform, triangles[i + 3 * j], triangles[i + 3 * j + 1], triangles[i + 3 * j + 2]);
+						clipped = clip[3] <= EPSILON || clip[2] < -clip[3];
+						triangle[j] = to_screen(clip, snapshot.width, snapshot.height);
+					}
+
+					if (!clipped) {
+						vertices.insert(vertices.end(), triangle.begin(), triangle.end());
+					}
+				}
+			}
+			count_triangles = vertices.size() / 3;
+			return vertices;
+		}
+
+		// Rows [first_row, last_row) are owned by one worker, inner loop is written without branches to be vectorized
+		static void rasterize(const std::vector<ScreenVertex>& vertices, size_t width, size_t first_row, size_t last_row, std::vector<GLfloat>& depth) {
+			for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+				ScreenVertex v0 = vertices[i], v1 = vertices[i + 1], v2 = vertices[i + 2];
+				GLfloat area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+				if (std::abs(area) < EPSILON) {
+					continue;
+				}
+				if (area < 0.0f) {
+					std::swap(v1, v2);
+					area = -area;
+				}
+
+				int64_t x_begin = std::max(static_cast<int64_t>(std::floor(std::min({ v0.x, v1.x, v2.x }))), int64_t(0));
+				int64_t x_end = std::min(static_cast<int64_t>(std::ceil(std::max({ v0.x, v1.x, v2.x }))), static_cast<int64_t>(width));
+				int64_t y_begin = std::max(static_cast<int64_t>(std::floor(std::min({ v0.y, v1.y, v2.y }))), static_cast<int64_t>(first_row));
+				int64_t y_end = std::min(static_cast<int64_t>(std::ceil(std::max({ v0.y, v1.y, v2.y }))), static_cast<int64_t>(last_row));
+				if (x_begin >= x_end || y_begin >= y_end) {
+					continue;
+				}
+
+				// Edge functions e(x, y) = a * x + b * y + c, positive inside of the triangle
+				GLfloat a0 = v1.y - v2.y, b0 = v2.x - v1.x, c0 = v1.x * v2.y - v1.y * v2.x;
+				GLfloat a1 = v2.y - v0.y, b1 = v0.x - v2.x, c1 = v2.x * v0.y - v2.y * v0.x;
+				GLfloat a2 = v0.y - v1.y, b2 = v1.x - v0.x, c2 = v0.x * v1.y - v0.y * v1.x;
+				GLfloat inv_area = 1.0f / area;
+				GLfloat dz = (a0 * v0.z + a1 * v1.z + a2 * v2.z) * inv_area;
+
+				for (int64_t y = y_begin; y < y_end; ++y) {
+					GLfloat px = static_cast<GLfloat>(x_begin) + 0.5f;
+					GLfloat py = static_cast<GLfloat>(y) + 0.5f;
+					GLfloat e0 = a0 * px + b0 * py + c0;
+					GLfloat e1 = a1 * px + b1 * py + c1;
+					GLfloat e2 = a2 * px + b2 * py + c2;
+					GLfloat z = (e0 * v0.z + e1 * v1.z + e2 * v2.z) * inv_area;
+
+					GLfloat* row = &depth[y * width];
+					for (int64_t x = x_begin; x < x_end; ++x) {
+						GLfloat offset = static_cast<GLfloat>(x - x_begin);
+						bool inside = (e0 + a0 * offset >= 0.0f) & (e1 + a1 * offset >= 0.0f) & (e2 + a2 * offset >= 0.0f);
+						GLfloat value = z + dz * offset;
+						row[x] = inside && value < row[x] ? value : row[x];
+					}
+				}
+			}
+		}
+
+		// Each texel of the next level keeps the farthest depth of four texels of the previous one
+		static std::vector<std::vector<GLfloat>> build_pyramid(std::vector<GLfloat>&& depth, size_t width, size_t height) {
+			std::vector<std::vector<GLfloat>> levels;
+			levels.push_back(std::move(depth));
+			while (width > 1 || height > 1) {
+				size_t level_width = (width + 1) / 2;
+				size_t level_height = (height + 1) / 2;
+				const std::vector<GLfloat>& previous = levels.back();
+
+				std::vector<GLfloat> level(level_width * level_height);
+				for (size_t y = 0; y < level_height; ++y) {
+					size_t y0 = 2 * y, y1 = std::min(2 * y + 1, height - 1);
+					for (size_t x = 0; x < level_width; ++x) {
+						size_t x0 = 2 * x, x1 = std::min(2 * x + 1, width - 1);
+						level[y * level_width + x] = std::max({ previous[y0 * width + x0], previous[y0 * width + x1], previous[y1 * width + x0], previous[y1 * width + x1] });
+					}
+				}
+
+				levels.push_back(std::move(level));
+				width = level_width;
+				height = level_height;
+			}
+			return levels;
+		}
+
+		static bool is_occluded(const Instance& instance, const std::vector<std::vector<GLfloat>>& levels, size_t width, size_t height) noexcept {
+			GLfloat x_min = std::numeric_limits<GLfloat>::max(), y_min = x_min, z_min = x_min;
+			GLfloat x_max = std::numeric_limits<GLfloat>::lowest(), y_max = x_max;
+			for (size_t i = 0; i < 8; ++i) {
+				std::array<GLfloat, 4> clip = apply_transform(instance.transform,
+					i & 1 ? instance.bounding_max[0] : instance.bounding_min[0],
+					i & 2 ? instance.bounding_max[1] : instance.bounding_min[1],
+					i & 4 ? instance.bounding_max[2] : instance.bounding_min[2]
+				);
+				if (clip[3] <= EPSILON || clip[2] < -clip[3]) {
+					return false;
+				}
+
+				ScreenVertex vertex = to_screen(clip, width, height);
+				x_min = std::min(x_min, vertex.x);
+				x_max = std::max(x_max, vertex.x);
+				y_min = std::min(y_min, vertex.y);
+				y_max = std::max(y_max, vertex.y);
+				z_min = std::min(z_min, vertex.z);
+			}
+			if (x_max < 0.0f || y_max < 0.0f || x_min >= static_cast<GLfloat>(width) || y_min >= static_cast<GLfloat>(height)) {
+				return false;
+			}
+
+			size_t x_begin = static_cast<size_t>(std::max(x_min, 0.0f));
+			size_t x_end = std::min(static_cast<size_t>(x_max), width - 1);
+			size_t y_begin = static_cast<size_t>(std::max(y_min, 0.0f));
+			size_t y_end = std::min(static_cast<size_t>(y_max), height - 1);
+
+			size_t level = 0;
+			while (level + 1 < levels.size() && std::max(x_end - x_begin, y_end - y_begin) >> level >= 2) {
+				++level;
+			}
+
+			size_t level_width = width;
+			for (size_t i = 0; i < level; ++i) {
+				level_width = (level_width + 1) / 2;
+			}
+			for (size_t y = y_begin >> level; y <= y_end >> level; ++y) {
+				for (size_t x = x_begin >> level; x <= x_end >> level; ++x) {
+					if (z_min <= levels[level][y * level_width + x]) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		// Moves depth texels into the new screen space by transform from the old clip space to the new one
+		// Each texel keeps the farthest depth of texels moved into it, texels without them stay at the far plane and occlude nothing
+		static std::vector<GLfloat> reproject(const std::vector<GLfloat>& depth, const Transform& transform, size_t width, size_t height) {
+			const GLfloat EMPTY = std::numeric_limits<GLfloat>::lowest();
+			std::vector<GLfloat> moved(width * height, EMPTY);
+			for (size_t y = 0; y < height; ++y) {
+				for (size_t x = 0; x < width; ++x) {
+					GLfloat z = depth[y * width + x];
+					if (z >= 1.0f) {
+						continue;
+					}
+
+					std::array<GLfloat, 4> clip = apply_transform(transform,
+						(static_cast<GLfloat>(x) + 0.5f) / static_cast<GLfloat>(width) * 2.0f - 1.0f,
+						(static_cast<GLfloat>(y) + 0.5f) / static_cast<GLfloat>(height) * 2.0f - 1.0f,
+						z * 2.0f - 1.0f
+					);
+					if (clip[3] <= EPSILON || clip[2] < -clip[3]) {
+						continue;
+					}
+
+					ScreenVertex vertex = to_screen(clip, width, height);
+					if (vertex.x < 0.0f || vertex.y < 0.0f || vertex.x >= static_cast<GLfloat>(width) || vertex.y >= static_cast<GLfloat>(height)) {
+						continue;
+					}
+
+					GLfloat& texel = moved[static_cast<size_t>(vertex.y) * width + static_cast<size_t>(vertex.x)];
+					texel = std::max(texel, std::min(vertex.z, 1.0f));
+				}
+			}
+
+			// Gaps one texel wide appear when the camera comes closer, they get the farthest depth of two neighbours, first across columns then across rows
+			for (size_t step : { size_t(1), width }) {
+				std::vector<GLfloat> filled = moved;
+				for (size_t y = 1; y + 1 < height; ++y) {
+					for (size_t x = 1; x + 1 < width; ++x) {
+						size_t index = y * width + x;
+						if (moved[index] == EMPTY && moved[index - step] != EMPTY && moved[index + step] != EMPTY) {
+							filled[index] = std::max(moved[index - step], moved[index + step]);
+						}
+					}
+				}
+				moved = std::move(filled);
+			}
+
+			std::vector<GLfloat> result(width * height);
+			for (size_t i = 0; i < result.size(); ++i) {
+				result[i] = moved[i] == EMPTY ? 1.0f : moved[i];
+			}
+			return result;
+		}
+
+		static Result compute(const Snapshot& snapshot) {
+			Result result;
+			result.statistics.count_occluders = snapshot.occluders.size();
+			std::vector<ScreenVertex> vertices = transform_occluders(snapshot, result.statistics.count_occluder_triangles);
+
+			std::vector<GLfloat> depth(snapshot.width * snapshot.height, 1.0f);
+			parallel_for(snapshot.height, [&](size_t first_row, size_t last_row) {
+				rasterize(vertices, snapshot.width, first_row, last_row, depth);
+			});
+			result.depth_levels = build_pyramid(std::move(depth), snapshot.width, snapshot.height);
+
+			std::vector<char> culled(snapshot.instances.size(), 0);
+			parallel_for(snapshot.instances.size(), [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					culled[i] = is_occluded(snapshot.instances[i], result.depth_levels, snapshot.width, snapshot.height);
+				}
+			});
+
+			result.culled.assign(culled.begin(), culled.end());
+			result.statistics.count_tested = snapshot.instances.size();
+			result.statistics.count_culled = std::count(culled.begin(), culled.end(), 1);
+			return result;
+		}
+
+		void receive_result() {
+			if (!pending_) {
+				return;
+			}
+
+			Result result = job_.get();
+			pending_ = false;
+
+			depth_levels_ = std::move(result.depth_levels);
+			statistics_ = result.statistics;
+			culled_.clear();
+			for (size_t i = 0; i < instances_.size(); ++i) {
+				if (result.culled[i]) {
+					culled_[instances_[i].object_id].emplace(instances_[i].model_id, instance_transforms_[i]);
+				}
+			}
+		}
+
+		bool is_occluders_actual(const GraphObjectStorage& objects) const {
+			if (!actual_) {
+				return false;
+			}
+
+			for (size_t i = 0; i < occluder_models_.size(); ++i) {
+				const auto& [object_id, model_id] = occluder_models_[i];
+				if (!objects.contains(object_id) || !objects[object_id].models.contains(model_id) || objects[object_id].models[model_id] != occluder_transforms_[i]) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+	public:
+		OcclusionCuller() noexcept {
+		}
+
+		OcclusionCuller(size_t width, size_t height) {
+			if (width == 0 || height == 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "OcclusionCuller, invalid depth buffer size.\n\n");
+			}
+
+			width_ = width;
+			height_ = height;
+		}
+
+		// Only settings are copied, culling results are computed again
+		OcclusionCuller(const OcclusionCuller& other) noexcept {
+			width_ = other.width_;
+			height_ = other.height_;
+			max_occluders_ = other.max_occluders_;
+			max_occluder_triangles_ = other.max_occluder_triangles_;
+		}
+
+		OcclusionCuller(OcclusionCuller&& other) noexcept {
+			swap(other);
+		}
+
+		OcclusionCuller& operator=(const OcclusionCuller& other)& {
+			OcclusionCuller culler(other);
+			swap(culler);
+			return *this;
+		}
+
+		OcclusionCuller& operator=(OcclusionCuller&& other)& noexcept {
+			swap(other);
+			return *this;
+		}
+
+		OcclusionCuller& set_max_occluders(size_t max_occluders) noexcept {
+			max_occluders_ = max_occluders;
+			return *this;
+		}
+
+		OcclusionCuller& set_max_occluder_triangles(size_t max_occluder_triangles) noexcept {
+			max_occluder_triangles_ = max_occluder_triangles;
+			return *this;
+		}
+
+		size_t get_max_occluders() const noexcept {
+			return max_occluders_;
+		}
+
+		size_t get_max_occluder_triangles() const noexcept {
+			return max_occluder_triangles_;
+		}
+
+		size_t get_width() const noexcept {
+			return width_;
+		}
+
+		size_t get_height() const noexcept {
+			return height_;
+		}
+
+		// Statistics of the last received result
+		const Statistics& get_statistics() const noexcept {
+			return statistics_;
+		}
+
+		// Farthest depth in [0, 1] of each texel of the pyramid level, level 0 has depth buffer size
+		const std::vector<GLfloat>& get_depth_level(size_t level) const {
+			if (depth_levels_.size() <= level) {
+				throw GreOutOfRange(__FILE__, __LINE__, "get_depth_level, invalid level.\n\n");
+			}
+
+			return depth_levels_[level];
+		}
+
+		// Model stays culled only while its transform is the same as at the start of the culling
+		bool is_culled(size_t object_id, size_t model_id, const Matrix& model) const {
+			auto object = culled_.find(object_id);
+			if (object == culled_.end()) {
+				return false;
+			}
+
+			auto instance = object->second.find(model_id);
+			return instance != object->second.end() && instance->second == model;
+		}
+
+		bool is_culled(size_t object_id) const noexcept {
+			return culled_.count(object_id) == 1;
+		}
+
+		// Takes snapshot of the scene and starts culling on worker threads, must be called from the thread owning GL context
+		void start(const GraphObjectStorage& objects, const Camera& camera) {
+			receive_result();
+
+			view_projection_ = camera.get_projection_matrix() * camera.get_view_matrix();
+			Snapshot snapshot;
+			snapshot.width = width_;
+			snapshot.height = height_;
+
+			instances_.clear();
+			instance_transforms_.clear();
+			std::vector<std::pair<double, size_t>> candidates;
+			for (const auto& [object_id, object] : objects) {
+				Vec3 bounding_min(0.0);
+				Vec3 bounding_max(0.0);
+				if (!object.get_bounding_box(bounding_min, bounding_max)) {
+					continue;
+				}
+
+				double radius = (bounding_max - bounding_min).length() / 2.0;
+				for (const auto& [model_id, model] : object.models) {
+					Instance instance;
+					instance.object_id = object_id;
+					instance.model_id = model_id;
+					instance.transform = get_transform(view_projection_ * model);
+					for (size_t i = 0; i < 3; ++i) {
+						instance.bounding_min[i] = static_cast<GLfloat>(bounding_min[i]);
+						instance.bounding_max[i] = static_cast<GLfloat>(bounding_max[i]);
+					}
+
+					if (!object.transparent) {
+						double scale = std::max({ Vec3(model[0][0], model[1][0], model[2][0]).length(), Vec3(model[0][1], model[1][1], model[2][1]).length(), Vec3(model[0][2], model[1][2], model[2][2]).length() });
+						double distance = std::max((model * ((bounding_min + bounding_max) / 2.0) - camera.position).length(), static_cast<double>(EPSILON));
+						candidates.emplace_back(radius * scale / distance, instances_.size());
+					}
+
+					instances_.push_back(instance);
+					instance_transforms_.push_back(model);
+				}
+			}
+
+			// The largest on the screen opaque instances become occluders while the triangle budget allows
+			std::sort(candidates.rbegin(), candidates.rend());
+			occluder_models_.clear();
+			occluder_transforms_.clear();
+			size_t count_triangles = 0;
+			for (const auto& [size, index] : candidates) {
+				if (occluder_models_.size() == max_occluders_) {
+					break;
+				}
+
+				const Instance& instance = instances_[index];
+				const Geometry& geometry = get_geometry(instance.object_id, objects[instance.object_id]);
+				size_t count_object_triangles = geometry.triangles->size() / 9;
+				if (count_object_triangles == 0 || count_triangles + count_object_triangles > max_occluder_triangles_) {
+					continue;
+				}
+
+				count_triangles += count_object_triangles;
+				snapshot.occluders.push_back({ instance.transform, geometry.triangles });
+				occluder_models_.emplace_back(instance.object_id, instance.model_id);
+				occluder_transforms_.push_back(instance_transforms_[index]);
+			}
+
+			for (auto geometry = geometry_.begin(); geometry != geometry_.end();) {
+				geometry = objects.contains(geometry->first) ? std::next(geometry) : geometry_.erase(geometry);
+			}
+
+			snapshot.instances = instances_;
+			job_ = std::async(std::launch::async, [snapshot = std::move(snapshot)]() {
+				return compute(snapshot);
+			});
+			pending_ = true;
+			actual_ = true;
+		}
+
+		// Receives result started on the previous frame, it is never restarted on the current one
+		// If the camera was moved since, the depth buffer is reprojected and instances are tested again on the calling thread
+		// If occluders were moved or there is no result, nothing is culled on the current frame
+		void update(const GraphObjectStorage& objects, const Camera& camera) {
+			receive_result();
+			if (!is_occluders_actual(objects)) {
+				depth_levels_.clear();
+				culled_.clear();
+				statistics_ = Statistics();
+				statistics_.count_discarded = 1;
+				return;
+			}
+
+			Matrix view_projection = camera.get_projection_matrix() * camera.get_view_matrix();
+			if (view_projection == view_projection_) {
+				return;
+			}
+
+			std::vector<GLfloat> depth = reproject(depth_levels_[0], get_transform(view_projection * view_projection_.inverse()), width_, height_);
+			depth_levels_ = build_pyramid(std::move(depth), width_, height_);
+
+			std::vector<char> culled(instances_.size(), 0);
+			parallel_for(instances_.size(), [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					Instance instance = instances_[i];
+					instance.transform = get_transform(view_projection * instance_transforms_[i]);
+					culled[i] = is_occluded(instance, depth_levels_, width_, height_);
+				}
+			});
+
+			culled_.clear();
+			for (size_t i = 0; i < instances_.size(); ++i) {
+				if (culled[i]) {
+					culled_[instances_[i].object_id].emplace(instances_[i].model_id, instance_transforms_[i]);
+				}
+			}
+			statistics_.count_culled = std::count(culled.begin(), culled.end(), 1);
+			statistics_.count_reprojected = 1;
+		}
+
+		void swap(OcclusionCuller& other) noexcept {
+			std::swap(width_, other.width_);
+			std::swap(height_, other.height_);
+			std::swap(max_occluders_, other.max_occluders_);
+			std::swap(max_occluder_triangles_, other.max_occluder_triangles_);
+			std::swap(view_projection_, other.view_projection_);
+			std::swap(occluder_models_, other.occluder_models_);
+			std::swap(occluder_transforms_, other.occluder_transforms_);
+			std::swap(instances_, other.instances_);
+			std::swap(instance_transforms_, other.instance_transforms_);
+			std::swap(geometry_, other.geometry_);
+			std::swap(job_, other.job_);
+			std::swap(pending_, other.pending_);
+			std::swap(actual_, other.actual_);
+			std::swap(depth_levels_, other.depth_levels_);
+			std::swap(culled_, other.culled_);
+			std::swap(statistics_, other.statistics_);
+		}
+
+		~OcclusionCuller() {
+			if (pending_) {
+				job_.wait();
+			}
+		}
+	};
+}
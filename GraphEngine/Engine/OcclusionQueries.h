@@ -0,0 +1,349 @@
+#pragma once
+
+#include "GraphObjectStorage.h"
+
+
+namespace gre {
+	// Hardware occlusion queries on bounding boxes of heavy objects, one instance per camera or light
+	class OcclusionQueries {
+	public:
+		struct Statistics {
+			size_t count_queries = 0;
+			size_t count_conditional_draws = 0;
+			size_t count_skipped_draws = 0;
+
+			Statistics& operator+=(const Statistics& other) noexcept {
+				count_queries += other.count_queries;
+				count_conditional_draws += other.count_conditional_draws;
+				count_skipped_draws += other.count_skipped_draws;
+				return *this;
+			}
+		};
+
+	private:
+		struct ObjectQuery {
+			GLuint query_id = 0;
+			bool visible = true;
+			bool pending = false;
+			bool conditional = false;
+		};
+
+		inline static const GLuint BOX_BINDING = 0;
+		inline static const GLuint MATRIX_BINDING = 1;
+		inline static const double BOX_PADDING = 0.01;
+
+		inline static GLuint box_vertex_array_ = 0;
+
+		size_t min_triangles_ = 1024;
+		size_t query_interval_ = 8;
+		bool conditional_render_ = true;
+
+		size_t frame_ = 0;
+		Matrix view_projection_ = Matrix(4, 4);
+		std::unordered_map<size_t, ObjectQuery> queries_;
+		std::vector<size_t> deferred_;
+		Statistics statistics_;
+
+		static void create_box_vertex_array() {
+			if (box_vertex_array_ != 0) {
+				return;
+			}
+
+			GLfloat vertices[36 * 3];
+			size_t faces[6][4] = { { 0, 2, 3, 1 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 4, 6, 2 }, { 1, 3, 7, 5 } };
+			size_t order[6] = { 0, 1, 2, 0, 2, 3 };
+			for (size_t i = 0; i < 36; ++i) {
+				size_t corner = faces[i / 6][order[i % 6]];
+				for (size_t j = 0; j < 3; ++j) {
+					vertices[3 * i + j] = static_cast<GLfloat>((corner >> j) & 1);
+				}
+			}
+
+			glGenVertexArrays(1, &box_vertex_array_);
+			glBindVertexArray(box_vertex_array_);
+
+			GLuint vertex_buffer;
+			glGenBuffers(1, &vertex_buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			glBindVertexBuffer(BOX_BINDING, vertex_buffer, 0, 3 * sizeof(GLfloat));
+			glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+			glVertexAttribBinding(0, BOX_BINDING);
+			glEnableVertexAttribArray(0);
+
+			for (GLuint i = 0; i < 4; ++i) {
+				glVertexAttribFormat(4 + i, 4, GL_FLOAT, GL_FALSE, static_cast<GLuint>(4 * i * sizeof(GLfloat)));
+				glVertexAttribBinding(4 + i, MATRIX_BINDING);
+				glEnableVertexAttribArray(4 + i);
+			}
+			glVertexBindingDivisor(MATRIX_BINDING, 1);
+
+			glBindVertexArray(0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		static size_t get_count_triangles(const GraphObject& object) noexcept {
+			size_t count_triangles = 0;
+			for (const auto& [mesh_id, mesh] : object.meshes) {
+				count_triangles += mesh.get_count_indices() / 3;
+			}
+			return count_triangles;
+		}
+
+		// Box clipped by the near plane can be hidden while the object is visible, such objects are not queried
+		bool crosses_near_plane(const GraphObject& object, const Vec3& bounding_min, const Vec3& bounding_max) const {
+			for (const auto& [model_id, model] : object.models) {
+				Matrix transform = view_projection_ * model;
+				for (size_t i = 0; i < 8; ++i) {
+					Vec3 corner(i & 1 ? bounding_max.x : bounding_min.x, i & 2 ? bounding_max.y : bounding_min.y, i & 4 ? bounding_max.z : bounding_min.z);
+					double w = transform[3][0] * corner.x + transform[3][1] * corner.y + transform[3][2] * corner.z + transform[3][3];
+					double z = transform[2][0] * corner.x + transform[2][1] * corner.y + transform[2][2] * corner.z + transform[2][3];
+					if (w <= EPS || z < -w) {
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		// Draws bounding boxes of all instances without writing color, depth and stencil
+		bool query(ObjectQuery& object_query, const GraphObject& object, const Shader<size_t>& bounds_shader) {
+			Vec3 bounding_min(0.0);
+			Vec3 bounding_max(0.0);
+			if (!object.get_bounding_box(bounding_min, bounding_max) || crosses_near_plane(object, bounding_min, bounding_max)) {
+				object_query.visible = true;
+				return false;
+			}
+
+			// Padded box is not hidden by the object itself
+			Vec3 padding((bounding_max - bounding_min).length() * BOX_PADDING + EPS);
+			bounding_min -= padding;
+			bounding_max += padding;
+
+			bounds_shader.set_uniform_matrix("view_projection", view_projection_);
+			bounds_shader.set_uniform_f("bounding_min", bounding_min);
+			bounds_shader.set_uniform_f("bounding_max", bounding_max);
+
+			GLint stencil_mask = 0;
+			glGetIntegerv(GL_STENCIL_WRITEMASK, &stencil_mask);
+			GLboolean cull_face = glIsEnabled(GL_CULL_FACE);
+			glDisable(GL_CULL_FACE);
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			glDepthMask(GL_FALSE);
+			glStencilMask(0x00);
+
+			glBindVertexArray(box_vertex_array_);
+			glBindVertexBuffer(MATRIX_BINDING, object.models.get_matrix_buffer(), 0, 16 * sizeof(GLfloat));
+			glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, object_query.query_id);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 36, static_cast<GLsizei>(object.models.size()));
+			glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+			glBindVertexArray(0);
+
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			glDepthMask(GL_TRUE);
+			glStencilMask(static_cast<GLuint>(stencil_mask));
+			if (cull_face) {
+				glEnable(GL_CULL_FACE);
+			}
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			object_query.pending = true;
+			++statistics_.count_queries;
+			return true;
+		}
+
+		void deallocate() {
+			for (const auto& [object_id, object_query] : queries_) {
+				glDeleteQueries(1, &object_query.query_id);
+			}
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			queries_.clear();
+		}
+
+	public:
+		OcclusionQueries() noexcept {
+		}
+
+		// Only settings are copied, query results are collected again
+		OcclusionQueries(const OcclusionQueries& other) noexcept {
+			min_triangles_ = other.min_triangles_;
+			query_interval_ = other.query_interval_;
+			conditional_render_ = other.conditional_render_;
+		}
+
+		OcclusionQueries(OcclusionQueries&& other) noexcept {
+			swap(other);
+		}
+
+		OcclusionQueries& operator=(const OcclusionQueries& other)& {
+			OcclusionQueries queries(other);
+			swap(queries);
+			return *this;
+		}
+
+		OcclusionQueries& operator=(OcclusionQueries&& other)& {
+			deallocate();
+			swap(other);
+			return *this;
+		}
+
+		// Objects with fewer triangles are always drawn without queries
+		OcclusionQueries& set_min_triangles(size_t min_triangles) noexcept {
+			min_triangles_ = min_triangles;
+			return *this;
+		}
+
+		// Visible objects are queried again once in query_interval frames
+		OcclusionQueries& set_query_interval(size_t query_interval) {
+			if (query_interval == 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "set_query_interval, invalid interval value.\n\n");
+			}
+
+			query_interval_ = query_interval;
+			return *this;
+		}
+
+		// true - hidden objects are drawn under conditional render of the query issued just before
+		// false - hidden objects are skipped by the result of the previous frame
+		OcclusionQueries& set_conditional_render(bool conditional_render) noexcept {
+			conditional_render_ = conditional_render;
+			return *this;
+		}
+
+		size_t get_min_triangles() const noexcept {
+			return min_triangles_;
+		}
+
+		size_t get_query_interval() const noexcept {
+			return query_interval_;
+		}
+
+		bool get_conditional_render() const noexcept {
+			return conditional_render_;
+		}
+
+		// Counters of the current frame, draws skipped under conditional render are counted when their query result is received
+		const Statistics& get_statistics() const noexcept {
+			return statistics_;
+		}
+
+		bool is_visible(size_t object_id) const noexcept {
+			auto object_query = queries_.find(object_id);
+			return object_query == queries_.end() || object_query->second.visible;
+		}
+
+		// Collects finished queries without waiting for the rest
+		void begin_frame(const GraphObjectStorage& objects, const Matrix& view_projection) {
+			create_box_vertex_array();
+
+			++frame_;
+			view_projection_ = view_projection;
+			statistics_ = Statistics();
+			deferred_.clear();
+
+			for (auto object_query = queries_.begin(); object_query != queries_.end();) {
+				if (!objects.contains(object_query->first)) {
+					glDeleteQueries(1, &object_query->second.query_id);
+					object_query = queries_.erase(object_query);
+					continue;
+				}
+
+				ObjectQuery& state = object_query->second;
+				GLuint available = GL_FALSE;
+				if (state.pending) {
+					glGetQueryObjectuiv(state.query_id, GL_QUERY_RESULT_AVAILABLE, &available);
+				}
+				if (available) {
+					GLuint any_samples_passed = GL_TRUE;
+					glGetQueryObjectuiv(state.query_id, GL_QUERY_RESULT, &any_samples_passed);
+					state.visible = any_samples_passed == GL_TRUE;
+					state.pending = false;
+					if (state.conditional && !state.visible) {
+						++statistics_.count_skipped_draws;
+					}
+				}
+				++object_query;
+			}
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		// draw_object - callable drawing the object with main or depth shader
+		template <typename Func>
+		void draw(size_t object_id, const GraphObject& object, const Shader<size_t>& bounds_shader, Func draw_object) {
+			if (bounds_shader.description != ShaderType::BOUNDS) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "draw, invalid bounds shader type.\n\n");
+			}
+
+			if (object.models.empty() || get_count_triangles(object) < min_triangles_) {
+				draw_object();
+				return;
+			}
+
+			ObjectQuery& object_query = queries_[object_id];
+			if (object_query.query_id == 0) {
+				glGenQueries(1, &object_query.query_id);
+			}
+
+			object_query.conditional = false;
+			if (object_query.visible || object_query.pending) {
+				if (!object_query.pending && (frame_ + object_id) % query_interval_ == 0) {
+					deferred_.push_back(object_id);
+				}
+				if (object_query.visible || conditional_render_) {
+					draw_object();
+				} else {
+					++statistics_.count_skipped_draws;
+				}
+				return;
+			}
+
+			if (!conditional_render_) {
+				deferred_.push_back(object_id);
+				++statistics_.count_skipped_draws;
+				return;
+			}
+
+			if (!query(object_query, object, bounds_shader)) {
+				draw_object();
+				return;
+			}
+
+			object_query.conditional = true;
+			++statistics_.count_conditional_draws;
+			glBeginConditionalRender(object_query.query_id, GL_QUERY_WAIT);
+			draw_object();
+			glEndConditionalRender();
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		// Issues queries postponed to the end of the pass, when the depth buffer contains all occluders
+		void end_frame(const GraphObjectStorage& objects, const Shader<size_t>& bounds_shader) {
+			if (bounds_shader.description != ShaderType::BOUNDS) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "end_frame, invalid bounds shader type.\n\n");
+			}
+
+			for (size_t object_id : deferred_) {
+				query(queries_[object_id], objects[object_id], bounds_shader);
+			}
+			deferred_.clear();
+		}
+
+		void swap(OcclusionQueries& other) noexcept {
+			std::swap(min_triangles_, other.min_triangles_);
+			std::swap(query_interval_, other.query_interval_);
+			std::swap(conditional_render_, other.conditional_render_);
+			std::swap(frame_, other.frame_);
+			std::swap(view_projection_, other.view_projection_);
+			std::swap(queries_, other.queries_);
+			std::swap(deferred_, other.deferred_);
+			std::swap(statistics_, other.statistics_);
+		}
+
+		~OcclusionQueries() {
+			deallocate();
+		}
+	};
+}
@@ -0,0 +1,432 @@
+#pragma once
+
+#include "../GraphicClasses/Shader.h"
+#include "../GraphicClasses/Kernel.h"
+#include "../GraphicClasses/TimerQuery.h"
+
+
+namespace gre {
+	// Passes between the primary frame buffer and the window, passes which do not change the image are skipped
+	class PostProcessor {
+	public:
+		// GPU time of post processing passes in milliseconds for all cameras
+		struct PassTimes {
+			double compose = 0.0;
+			double separable = 0.0;
+			double tile = 0.0;
+			double outline = 0.0;
+		};
+
+	private:
+		inline static const size_t COUNT_TARGETS = 2;
+		inline static const GLuint INPUT_IMAGE_BINDING = 0;
+		inline static const GLuint OUTPUT_IMAGE_BINDING = 1;
+		inline static const GLuint BORDER_IMAGE_BINDING = 2;
+		// Stencil bits of border masks, every bit is flooded separately
+		inline static const size_t COUNT_BORDER_BITS = 8;
+
+		bool pass_timing_ = false;
+		size_t count_passes_ = 0;
+		GLsizei width_ = 0;
+		GLsizei height_ = 0;
+		GLuint tile_size_ = 1;
+		Kernel kernel_ = Kernel();
+
+		GLuint texture_ids_[COUNT_TARGETS] = { 0, 0 };
+		GLuint frame_buffers_[COUNT_TARGETS] = { 0, 0 };
+		// Nearest pixels with one border mask bit, ping pong targets of jump flooding
+		GLuint outline_texture_ids_[COUNT_TARGETS] = { 0, 0 };
+		// Non zero for pixels near to other pixels with border mask bits which the pixel lacks
+		GLuint border_texture_id_ = 0;
+		Shader<size_t> compose_shader_;
+		Shader<size_t> separable_shader_;
+		Shader<size_t> tile_shader_;
+		Shader<size_t> jump_flood_shader_;
+		TimerQuery compose_timer_;
+		TimerQuery separable_timer_;
+		TimerQuery tile_timer_;
+		TimerQuery outline_timer_;
+
+		void set_uniforms() const {
+			compose_shader_.set_uniform_i("screen_texture", 0);
+			compose_shader_.set_uniform_i("accumulation_texture", 1);
+			compose_shader_.set_uniform_i("revealage_texture", 2);
+
+			separable_shader_.set_uniform_i("input_texture", 0);
+
+			tile_shader_.set_uniform_i("input_texture", 0);
+
+			jump_flood_shader_.set_uniform_i("stencil_texture", 0);
+		}
+
+		// Half float targets keep negative values between passes of separable kernels
+		void create_frame_buffers() {
+			glGenTextures(static_cast<GLsizei>(COUNT_TARGETS), texture_ids_);
+			glGenFramebuffers(static_cast<GLsizei>(COUNT_TARGETS), frame_buffers_);
+			for (size_t i = 0; i < COUNT_TARGETS; ++i) {
+				glBindTexture(GL_TEXTURE_2D, texture_ids_[i]);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width_, height_, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				glBindTexture(GL_TEXTURE_2D, 0);
+
+				glBindFramebuffer(GL_FRAMEBUFFER, frame_buffers_[i]);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_ids_[i], 0);
+
+				if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+					throw GreRuntimeError(__FILE__, __LINE__, "create_frame_buffers, framebuffer is not complete.\n\n");
+				}
+				set_gl_object_label(GL_TEXTURE, texture_ids_[i], "post processing texture " + std::to_string(i));
+				set_gl_object_label(GL_FRAMEBUFFER, frame_buffers_[i], "post processing frame buffer " + std::to_string(i));
+			}
+
+			glGenTextures(static_cast<GLsizei>(COUNT_TARGETS), outline_texture_ids_);
+			for (size_t i = 0; i < COUNT_TARGETS; ++i) {
+				glBindTexture(GL_TEXTURE_2D, outline_texture_ids_[i]);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16I, width_, height_, 0, GL_RG_INTEGER, GL_SHORT, NULL);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				set_gl_object_label(GL_TEXTURE, outline_texture_ids_[i], "outline texture " + std::to_string(i));
+			}
+
+			glGenTextures(1, &border_texture_id_);
+			glBindTexture(GL_TEXTURE_2D, border_texture_id_);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, width_, height_, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			set_gl_object_label(GL_TEXTURE, border_texture_id_, "border texture");
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void begin_pass_timer(TimerQuery& timer) {
+			if (pass_timing_) {
+				timer.begin();
+			}
+		}
+
+		void end_pass_timer(TimerQuery& timer) {
+			if (pass_timing_) {
+				timer.end();
+			}
+		}
+
+		void draw_compose_pass(GLuint screen_texture_id, GLuint accumulation_texture_id, GLuint revealage_texture_id, size_t target) {
+			glBindFramebuffer(GL_FRAMEBUFFER, frame_buffers_[target]);
+			compose_shader_.use();
+
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, screen_texture_id);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, accumulation_texture_id);
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_2D, revealage_texture_id);
+
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glActiveTexture(GL_TEXTURE0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		// Three taps along the direction, weights are ordered from the negative to the positive direction
+		void draw_separable_pass(GLuint input_texture_id, const std::vector<GLfloat>& weights, GLint direction_x, GLint direction_y, GLsizei width, GLsizei height, size_t target) {
+			glBindFramebuffer(GL_FRAMEBUFFER, frame_buffers_[target]);
+			separable_shader_.set_uniform_i("direction", direction_x, direction_y);
+			separable_shader_.set_uniform_i("image_size", width, height);
+			separable_shader_.set_uniform_fv<1>("weights", 3, &weights[0]);
+
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, input_texture_id);
+
+			glDrawArrays(GL_TRIANGLES, 0, 6);
+
+			glBindTexture(GL_TEXTURE_2D, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		// Work groups read their tile with the kernel apron into shared memory once instead of nine texture reads per pixel
+		void dispatch_tile_pass(GLuint input_texture_id, GLsizei width, GLsizei height, size_t target) {
+			kernel_.set_uniforms(tile_shader_);
+			tile_shader_.set_uniform_i("image_size", width, height);
+
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, input_texture_id);
+			glBindImageTexture(OUTPUT_IMAGE_BINDING, texture_ids_[target], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+			tile_shader_.dispatch(get_count_groups(width), get_count_groups(height));
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+			glBindImageTexture(OUTPUT_IMAGE_BINDING, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		GLuint get_count_groups(GLsizei size) const noexcept {
+			return (static_cast<GLuint>(size) + tile_size_ - 1) / tile_size_;
+		}
+
+		static bool is_identity(const std::vector<GLfloat>& weights) noexcept {
+			return equality(weights[0], 0.0f) && equality(weights[1], 1.0f) && equality(weights[2], 0.0f);
+		}
+
+		void deallocate() {
+			glDeleteFramebuffers(static_cast<GLsizei>(COUNT_TARGETS), frame_buffers_);
+			glDeleteTextures(static_cast<GLsizei>(COUNT_TARGETS), texture_ids_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			glDeleteTextures(static_cast<GLsizei>(COUNT_TARGETS), outline_texture_ids_);
+			glDeleteTextures(1, &border_texture_id_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			std::fill(frame_buffers_, frame_buffers_ + COUNT_TARGETS, 0);
+			std::fill(texture_ids_, texture_ids_ + COUNT_TARGETS, 0);
+			std::fill(outline_texture_ids_, outline_texture_ids_ + COUNT_TARGETS, 0);
+			border_texture_id_ = 0;
+		}
+
+	public:
+		PostProcessor() {
+		}
+
+		// Targets have the size of the window, every camera uses their part of its viewport size
+		PostProcessor(GLsizei width, GLsizei height) {
+			if (width <= 0 || height <= 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "PostProcessor, invalid target size.\n\n");
+			}
+
+			width_ = width;
+			height_ = height;
+			compose_shader_ = Shader<size_t>("GraphEngine/Shaders/Vertex/Post", "GraphEngine/Shaders/Fragment/Compose", ShaderType::POST);
+			separable_shader_ = Shader<size_t>("GraphEngine/Shaders/Vertex/Post", "GraphEngine/Shaders/Fragment/Separable", ShaderType::POST);
+			tile_shader_ = Shader<size_t>::compute("GraphEngine/Shaders/Compute/Convolution", ShaderType::POST);
+			jump_flood_shader_ = Shader<size_t>::compute("GraphEngine/Shaders/Compute/JumpFlood", ShaderType::POST);
+			tile_size_ = static_cast<GLuint>(std::stoi(tile_shader_.get_value_comp("TILE_SIZE")));
+			set_uniforms();
+			create_frame_buffers();
+		}
+
+		// Targets are created again, their content is not copied
+		PostProcessor(const PostProcessor& other) {
+			pass_timing_ = other.pass_timing_;
+			width_ = other.width_;
+			height_ = other.height_;
+			tile_size_ = other.tile_size_;
+			kernel_ = other.kernel_;
+
+			compose_shader_ = other.compose_shader_;
+			separable_shader_ = other.separable_shader_;
+			tile_shader_ = other.tile_shader_;
+			jump_flood_shader_ = other.jump_flood_shader_;
+			if (width_ > 0 && height_ > 0) {
+				set_uniforms();
+				create_frame_buffers();
+			}
+		}
+
+		PostProcessor(PostProcessor&& other) noexcept {
+			swap(other);
+		}
+
+		PostProcessor& operator=(const PostProcessor& other)& {
+			PostProcessor object(other);
+			swap(object);
+			return *this;
+		}
+
+		PostProcessor& operator=(PostProcessor&& other)& {
+			deallocate();
+			swap(other);
+			return *this;
+		}
+
+		PostProcessor& set_kernel(const Kernel& kernel) {
+			kernel_ = kernel;
+			return *this;
+		}
+
+		// GPU time of every pass is measured by timer queries, see get_pass_times
+		PostProcessor& set_pass_timing(bool pass_timing) noexcept {
+			pass_timing_ = pass_timing;
+			return *this;
+		}
+
+		const Kernel& get_kernel() const noexcept {
+			return kernel_;
+		}
+
+		bool get_pass_timing() const noexcept {
+			return pass_timing_;
+		}
+
+		// Passes drawn in the last frame for all cameras
+		size_t get_count_passes() const noexcept {
+			return count_passes_;
+		}
+
+		// Times of a frame drawn a few frames ago, all zero until pass timing is enabled
+		PassTimes get_pass_times() const noexcept {
+			PassTimes pass_times;
+			pass_times.compose = compose_timer_.get_elapsed_time();
+			pass_times.separable = separable_timer_.get_elapsed_time();
+			pass_times.tile = tile_timer_.get_elapsed_time();
+			pass_times.outline = outline_timer_.get_elapsed_time();
+			return pass_times;
+		}
+
+		void begin_frame() {
+			count_passes_ = 0;
+			if (pass_timing_) {
+				for (TimerQuery* timer : { &compose_timer_, &separable_timer_, &tile_timer_, &outline_timer_ }) {
+					timer->begin_frame();
+				}
+			}
+		}
+
+		// width, height - size of the camera render target, returns the texture with its processed pixels, the screen texture if all passes are skipped and transparency is left to the final pass
+		GLuint process(GLsizei width, GLsizei height, GLuint screen_texture_id, GLuint accumulation_texture_id, GLuint revealage_texture_id, bool weighted_transparency, GLuint screen_vertex_array) {
+			if (kernel_.is_identity()) {
+				return screen_texture_id;
+			}
+
+			width = std::min(width, width_);
+			height = std::min(height, height_);
+			glViewport(0, 0, width, height);
+			glDisable(GL_DEPTH_TEST);
+			glBindVertexArray(screen_vertex_array);
+
+			GLuint input_texture_id = screen_texture_id;
+			size_t target = 0;
+			if (weighted_transparency) {
+				begin_pass_timer(compose_timer_);
+				draw_compose_pass(screen_texture_id, accumulation_texture_id, revealage_texture_id, target);
+				end_pass_timer(compose_timer_);
+
+				input_texture_id = texture_ids_[target];
+				target = (target + 1) % COUNT_TARGETS;
+				++count_passes_;
+			}
+
+			std::vector<GLfloat> horizontal, vertical;
+			if (kernel_.get_separable(horizontal, vertical)) {
+				GLint offset = static_cast<GLint>(kernel_.get_offset());
+				begin_pass_timer(separable_timer_);
+				for (const auto& [weights, direction_x, direction_y] : { std::make_tuple(&horizontal, offset, 0), std::make_tuple(&vertical, 0, -offset) }) {
+					if (is_identity(*weights)) {
+						continue;
+					}
+
+					draw_separable_pass(input_texture_id, *weights, direction_x, direction_y, width, height, target);
+					input_texture_id = texture_ids_[target];
+					target = (target + 1) % COUNT_TARGETS;
+					++count_passes_;
+				}
+				end_pass_timer(separable_timer_);
+			} else {
+				begin_pass_timer(tile_timer_);
+				dispatch_tile_pass(input_texture_id, width, height, target);
+				end_pass_timer(tile_timer_);
+
+				input_texture_id = texture_ids_[target];
+				++count_passes_;
+			}
+
+			glBindVertexArray(0);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glEnable(GL_DEPTH_TEST);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return input_texture_id;
+		}
+
+		// rect - x, y, width and height of the viewport part with selected objects, border_bits - union of their border masks
+		// A pixel is a border pixel if some pixel within the radius has a bit which the pixel lacks, returns the texture of border pixels
+		GLuint process_outline(GLuint depth_stencil_texture_id, const GLint rect[4], double radius, GLuint border_bits) {
+			if (rect[2] <= 0 || rect[3] <= 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "process_outline, empty outline rect.\n\n");
+			}
+			if (border_bits == 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "process_outline, empty border mask.\n\n");
+			}
+
+			begin_pass_timer(outline_timer_);
+			jump_flood_shader_.set_uniform_i("rect", rect[0], rect[1], rect[2], rect[3]);
+			jump_flood_shader_.set_uniform_f("radius", static_cast<GLfloat>(radius));
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, depth_stencil_texture_id);
+
+			// Seeds reach pixels at distance 2 * step - 1, the last pass of step one corrects most errors of jump flooding
+			GLint max_step = 1;
+			while (2.0 * max_step - 1.0 < radius) {
+				max_step *= 2;
+			}
+			std::vector<GLint> steps = { 0 };
+			for (GLint step = max_step; step > 0; step /= 2) {
+				steps.push_back(step);
+			}
+			steps.push_back(1);
+			// Resolves borders of the flooded bit
+			steps.push_back(-1);
+
+			// Nearest pixel of all bits can not be used, for pixels with some bits it is the pixel itself
+			glBindImageTexture(BORDER_IMAGE_BINDING, border_texture_id_, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R8UI);
+			bool first_bit = true;
+			for (size_t bit = 0; bit < COUNT_BORDER_BITS; ++bit) {
+				if ((border_bits & (1 << bit)) == 0) {
+					continue;
+				}
+
+				jump_flood_shader_.set_uniform_i("seed_bit", 1 << bit);
+				jump_flood_shader_.set_uniform_i("first_bit", first_bit);
+				size_t target = 0;
+				for (GLint step : steps) {
+					jump_flood_shader_.set_uniform_i("step", step);
+					glBindImageTexture(INPUT_IMAGE_BINDING, outline_texture_ids_[(target + 1) % COUNT_TARGETS], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG16I);
+					glBindImageTexture(OUTPUT_IMAGE_BINDING, outline_texture_ids_[target], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16I);
+					jump_flood_shader_.dispatch(get_count_groups(rect[2]), get_count_groups(rect[3]));
+					glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+					target = (target + 1) % COUNT_TARGETS;
+					++count_passes_;
+				}
+				first_bit = false;
+			}
+
+			glBindImageTexture(INPUT_IMAGE_BINDING, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG16I);
+			glBindImageTexture(OUTPUT_IMAGE_BINDING, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16I);
+			glBindImageTexture(BORDER_IMAGE_BINDING, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R8UI);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			end_pass_timer(outline_timer_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return border_texture_id_;
+		}
+
+		void swap(PostProcessor& other) noexcept {
+			std::swap(pass_timing_, other.pass_timing_);
+			std::swap(count_passes_, other.count_passes_);
+			std::swap(width_, other.width_);
+			std::swap(height_, other.height_);
+			std::swap(tile_size_, other.tile_size_);
+			std::swap(kernel_, other.kernel_);
+			std::swap(texture_ids_, other.texture_ids_);
+			std::swap(frame_buffers_, other.frame_buffers_);
+			std::swap(outline_texture_ids_, other.outline_texture_ids_);
+			std::swap(border_texture_id_, other.border_texture_id_);
+			compose_shader_.swap(other.compose_shader_);
+			separable_shader_.swap(other.separable_shader_);
+			tile_shader_.swap(other.tile_shader_);
+			jump_flood_shader_.swap(other.jump_flood_shader_);
+			compose_timer_.swap(other.compose_timer_);
+			separable_timer_.swap(other.separable_timer_);
+			tile_timer_.swap(other.tile_timer_);
+			outline_timer_.swap(other.outline_timer_);
+		}
+
+		~PostProcessor() {
+			deallocate();
+		}
+	};
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../GraphicClasses/GraphicFunctions.h"
+
+
+namespace gre {
+	// GL context of the engine and the frame buffer which receives images of all cameras
+	class RenderContext {
+	public:
+		virtual void set_active() const = 0;
+
+		virtual GLsizei get_width() const = 0;
+
+		virtual GLsizei get_height() const = 0;
+
+		// 0 - default frame buffer of the window
+		virtual GLuint get_frame_buffer() const noexcept = 0;
+
+		virtual sf::ContextSettings get_settings() const = 0;
+
+		// nullptr for contexts without window, their cameras are moved only by code
+		virtual sf::RenderWindow* get_window() const noexcept = 0;
+
+		virtual ~RenderContext() {
+		}
+	};
+
+
+	class WindowContext : public RenderContext {
+		sf::RenderWindow* window_;
+
+	public:
+		explicit WindowContext(sf::RenderWindow* window) noexcept : window_(window) {
+		}
+
+		void set_active() const override {
+			if (!window_->setActive(true)) {
+				throw GreRuntimeError(__FILE__, __LINE__, "set_active, failed to activate window.\n\n");
+			}
+		}
+
+		GLsizei get_width() const override {
+			return static_cast<GLsizei>(window_->getSize().x);
+		}
+
+		GLsizei get_height() const override {
+			return static_cast<GLsizei>(window_->getSize().y);
+		}
+
+		GLuint get_frame_buffer() const noexcept override {
+			return 0;
+		}
+
+		sf::ContextSettings get_settings() const override {
+			return window_->getSettings();
+		}
+
+		sf::RenderWindow* get_window() const noexcept override {
+			return window_;
+		}
+	};
+}
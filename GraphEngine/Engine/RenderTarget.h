@@ -0,0 +1,276 @@
+#pragma once
+
+#include "../GraphicClasses/GraphicFunctions.h"
+
+
+namespace gre {
+	// Frame buffers of one camera with the size of its viewport, all of them share one depth and stencil texture
+	// Transparent and geometry frame buffers exist only while weighted transparency and deferred shading are used
+	class RenderTarget {
+		friend class GraphEngine;
+
+		// Ambient with shadow flag, diffuse, specular with shininess, emission and normal
+		inline static const size_t COUNT_GEOMETRY_TEXTURES = 5;
+
+		GLsizei width_ = 0;
+		GLsizei height_ = 0;
+
+		GLuint screen_texture_id_ = 0;
+		GLuint depth_stencil_texture_id_ = 0;
+		GLuint primary_frame_buffer_ = 0;
+		GLuint accumulation_texture_id_ = 0;
+		GLuint revealage_texture_id_ = 0;
+		GLuint transparent_frame_buffer_ = 0;
+		GLuint geometry_texture_ids_[COUNT_GEOMETRY_TEXTURES] = { 0, 0, 0, 0, 0 };
+		GLuint geometry_frame_buffer_ = 0;
+		GLuint lighting_frame_buffer_ = 0;
+
+		void create_primary_frame_buffer() {
+			glGenTextures(1, &screen_texture_id_);
+			glBindTexture(GL_TEXTURE_2D, screen_texture_id_);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width_, height_, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glGenTextures(1, &depth_stencil_texture_id_);
+			glBindTexture(GL_TEXTURE_2D, depth_stencil_texture_id_);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width_, height_, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_DEPTH_STENCIL_TEXTURE_MODE, GL_STENCIL_INDEX);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+			GLfloat border_color[] = { 0.0, 0.0, 0.0, 0.0 };
+			glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_color);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glGenFramebuffers(1, &primary_frame_buffer_);
+			glBindFramebuffer(GL_FRAMEBUFFER, primary_frame_buffer_);
+
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screen_texture_id_, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth_stencil_texture_id_, 0);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_primary_frame_buffer, framebuffer is not complete.\n\n");
+			}
+			set_gl_object_label(GL_TEXTURE, screen_texture_id_, "screen texture");
+			set_gl_object_label(GL_TEXTURE, depth_stencil_texture_id_, "depth stencil texture");
+			set_gl_object_label(GL_FRAMEBUFFER, primary_frame_buffer_, "primary frame buffer");
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		// Targets of weighted blended transparency, share depth and stencil with the primary frame buffer
+		void create_transparent_frame_buffer() {
+			glGenTextures(1, &accumulation_texture_id_);
+			glBindTexture(GL_TEXTURE_2D, accumulation_texture_id_);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width_, height_, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+			glGenTextures(1, &revealage_texture_id_);
+			glBindTexture(GL_TEXTURE_2D, revealage_texture_id_);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width_, height_, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glGenFramebuffers(1, &transparent_frame_buffer_);
+			glBindFramebuffer(GL_FRAMEBUFFER, transparent_frame_buffer_);
+
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulation_texture_id_, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealage_texture_id_, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth_stencil_texture_id_, 0);
+			GLenum draw_buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+			glDrawBuffers(2, draw_buffers);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_transparent_frame_buffer, framebuffer is not complete.\n\n");
+			}
+			set_gl_object_label(GL_TEXTURE, accumulation_texture_id_, "accumulation texture");
+			set_gl_object_label(GL_TEXTURE, revealage_texture_id_, "revealage texture");
+			set_gl_object_label(GL_FRAMEBUFFER, transparent_frame_buffer_, "transparent frame buffer");
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		// Geometry buffer of deferred shading, shares depth and stencil with the primary frame buffer
+		void create_geometry_frame_buffer() {
+			GLint internal_formats[COUNT_GEOMETRY_TEXTURES] = { GL_RGBA8, GL_RGBA8, GL_RGBA16F, GL_RGBA8, GL_RG16F };
+			GLenum draw_buffers[COUNT_GEOMETRY_TEXTURES + 2] = { GL_NONE, GL_NONE };
+
+			glGenFramebuffers(1, &geometry_frame_buffer_);
+			glBindFramebuffer(GL_FRAMEBUFFER, geometry_frame_buffer_);
+
+			glGenTextures(static_cast<GLsizei>(COUNT_GEOMETRY_TEXTURES), geometry_texture_ids_);
+			for (size_t i = 0; i < COUNT_GEOMETRY_TEXTURES; ++i) {
+				glBindTexture(GL_TEXTURE_2D, geometry_texture_ids_[i]);
+				glTexImage2D(GL_TEXTURE_2D, 0, internal_formats[i], width_, height_, 0, GL_RGBA, GL_FLOAT, NULL);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i), GL_TEXTURE_2D, geometry_texture_ids_[i], 0);
+
+				// Outputs of Main.frag after the two forward targets
+				draw_buffers[i + 2] = static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i);
+			}
+			glBindTexture(GL_TEXTURE_2D, 0);
+
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth_stencil_texture_id_, 0);
+			glDrawBuffers(static_cast<GLsizei>(COUNT_GEOMETRY_TEXTURES + 2), draw_buffers);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_geometry_frame_buffer, framebuffer is not complete.\n\n");
+			}
+
+			// The lighting pass samples depth, so its target has only the screen texture
+			glGenFramebuffers(1, &lighting_frame_buffer_);
+			glBindFramebuffer(GL_FRAMEBUFFER, lighting_frame_buffer_);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screen_texture_id_, 0);
+
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_geometry_frame_buffer, lighting framebuffer is not complete.\n\n");
+			}
+			for (size_t i = 0; i < COUNT_GEOMETRY_TEXTURES; ++i) {
+				set_gl_object_label(GL_TEXTURE, geometry_texture_ids_[i], "geometry texture " + std::to_string(i));
+			}
+			set_gl_object_label(GL_FRAMEBUFFER, geometry_frame_buffer_, "geometry frame buffer");
+			set_gl_object_label(GL_FRAMEBUFFER, lighting_frame_buffer_, "lighting frame buffer");
+
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void delete_transparent_frame_buffer() {
+			glDeleteFramebuffers(1, &transparent_frame_buffer_);
+			glDeleteTextures(1, &accumulation_texture_id_);
+			glDeleteTextures(1, &revealage_texture_id_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			transparent_frame_buffer_ = 0;
+			accumulation_texture_id_ = 0;
+			revealage_texture_id_ = 0;
+		}
+
+		void delete_geometry_frame_buffer() {
+			glDeleteFramebuffers(1, &geometry_frame_buffer_);
+			glDeleteFramebuffers(1, &lighting_frame_buffer_);
+			glDeleteTextures(static_cast<GLsizei>(COUNT_GEOMETRY_TEXTURES), geometry_texture_ids_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			geometry_frame_buffer_ = 0;
+			lighting_frame_buffer_ = 0;
+			std::fill(geometry_texture_ids_, geometry_texture_ids_ + COUNT_GEOMETRY_TEXTURES, 0);
+		}
+
+		void deallocate() {
+			glDeleteFramebuffers(1, &primary_frame_buffer_);
+			glDeleteTextures(1, &screen_texture_id_);
+			glDeleteTextures(1, &depth_stencil_texture_id_);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			primary_frame_buffer_ = 0;
+			screen_texture_id_ = 0;
+			depth_stencil_texture_id_ = 0;
+			delete_transparent_frame_buffer();
+			delete_geometry_frame_buffer();
+		}
+
+	public:
+		RenderTarget() noexcept {
+		}
+
+		RenderTarget(GLsizei width, GLsizei height) {
+			if (width <= 0 || height <= 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "RenderTarget, invalid target size.\n\n");
+			}
+
+			width_ = width;
+			height_ = height;
+			create_primary_frame_buffer();
+		}
+
+		// Frame buffers are created again, their content is not copied
+		RenderTarget(const RenderTarget& other) {
+			width_ = other.width_;
+			height_ = other.height_;
+			if (width_ > 0 && height_ > 0) {
+				create_primary_frame_buffer();
+				set_transparent(other.transparent_frame_buffer_ != 0);
+				set_geometry(other.geometry_frame_buffer_ != 0);
+			}
+		}
+
+		RenderTarget(RenderTarget&& other) noexcept {
+			swap(other);
+		}
+
+		RenderTarget& operator=(const RenderTarget& other)& {
+			RenderTarget object(other);
+			swap(object);
+			return *this;
+		}
+
+		RenderTarget& operator=(RenderTarget&& other)& {
+			deallocate();
+			swap(other);
+			return *this;
+		}
+
+		GLsizei get_width() const noexcept {
+			return width_;
+		}
+
+		GLsizei get_height() const noexcept {
+			return height_;
+		}
+
+		// Creates or deletes targets of weighted blended transparency
+		RenderTarget& set_transparent(bool transparent) {
+			if (transparent && transparent_frame_buffer_ == 0) {
+				create_transparent_frame_buffer();
+			} else if (!transparent && transparent_frame_buffer_ != 0) {
+				delete_transparent_frame_buffer();
+			}
+			return *this;
+		}
+
+		// Creates or deletes the geometry buffer of deferred shading
+		RenderTarget& set_geometry(bool geometry) {
+			if (geometry && geometry_frame_buffer_ == 0) {
+				create_geometry_frame_buffer();
+			} else if (!geometry && geometry_frame_buffer_ != 0) {
+				delete_geometry_frame_buffer();
+			}
+			return *this;
+		}
+
+		bool get_transparent() const noexcept {
+			return transparent_frame_buffer_ != 0;
+		}
+
+		bool get_geometry() const noexcept {
+			return geometry_frame_buffer_ != 0;
+		}
+
+		void swap(RenderTarget& other) noexcept {
+			std::swap(width_, other.width_);
+			std::swap(height_, other.height_);
+			std::swap(screen_texture_id_, other.screen_texture_id_);
+			std::swap(depth_stencil_texture_id_, other.depth_stencil_texture_id_);
+			std::swap(primary_frame_buffer_, other.primary_frame_buffer_);
+			std::swap(accumulation_texture_id_, other.accumulation_texture_id_);
+			std::swap(revealage_texture_id_, other.revealage_texture_id_);
+			std::swap(transparent_frame_buffer_, other.transparent_frame_buffer_);
+			std::swap(geometry_texture_ids_, other.geometry_texture_ids_);
+			std::swap(geometry_frame_buffer_, other.geometry_frame_buffer_);
+			std::swap(lighting_frame_buffer_, other.lighting_frame_buffer_);
+		}
+
+		~RenderTarget() {
+			deallocate();
+		}
+	};
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "GraphObjectStorage.h"
+
+
+namespace gre {
+	// Back to front order of transparent models, one instance per camera
+	class TransparentSorter {
+	public:
+		struct Item {
+			size_t object_id = 0;
+			size_t model_id = 0;
+			const GraphObject* object = nullptr;
+		};
+
+		struct Statistics {
+			size_t count_items = 0;
+			size_t count_updated_centers = 0;
+			size_t count_moves = 0;
+			bool incremental = false;
+		};
+
+	private:
+		struct ObjectCenter {
+			std::vector<double> signature;
+			Vec3 center;
+		};
+
+		struct ModelCenter {
+			Matrix model = Matrix(4, 4);
+			Vec3 center;
+		};
+
+		inline static const size_t RADIX_BITS = 8;
+		inline static const size_t RADIX_SIZE = 1 << RADIX_BITS;
+		// Incremental sort falls back to radix sort after this number of moves per item
+		inline static const size_t MAX_MOVES_PER_ITEM = 4;
+
+		bool incremental_ = true;
+
+		std::unordered_map<size_t, ObjectCenter> object_centers_;
+		std::unordered_map<size_t, std::unordered_map<size_t, ModelCenter>> model_centers_;
+		std::vector<Item> items_;
+		std::vector<std::pair<size_t, size_t>> previous_ids_;
+		std::vector<uint32_t> keys_;
+		std::vector<size_t> order_;
+		std::vector<size_t> buffer_;
+		std::vector<Item> sorted_;
+		Statistics statistics_;
+
+		// Vertex buffers are read back only when the object geometry changes
+		void update_object_center(size_t object_id, const GraphObject& object) {
+			std::vector<double> signature = object.get_geometry_signature();
+			ObjectCenter& object_center = object_centers_[object_id];
+			if (object_center.signature.empty() || object_center.signature != signature) {
+				object_center = { signature, object.get_center() };
+				model_centers_[object_id].clear();
+			}
+		}
+
+		// World space center of the model, recomputed only when the model matrix changes
+		const Vec3& get_center(const Item& item) {
+			const ObjectCenter& object_center = object_centers_[item.object_id];
+			auto& model_centers = model_centers_[item.object_id];
+			const Matrix& model = item.object->models[item.model_id];
+			auto [model_center, inserted] = model_centers.insert({ item.model_id, ModelCenter() });
+			if (inserted || model_center->second.model != model) {
+				model_center->second = { model, model * object_center.center };
+				++statistics_.count_updated_centers;
+			}
+			return model_center->second.center;
+		}
+
+		// Larger distance gives smaller key, bits of non negative floats are ordered as unsigned integers
+		static uint32_t get_key(double distance) noexcept {
+			float value = static_cast<float>(distance);
+			uint32_t bits = 0;
+			std::memcpy(&bits, &value, sizeof(bits));
+			return ~bits;
+		}
+
+		void radix_sort() {
+			buffer_.resize(order_.size());
+			for (size_t shift = 0; shift < 32; shift += RADIX_BITS) {
+				size_t counts[RADIX_SIZE + 1] = {};
+				for (size_t index : order_) {
+					++counts[((keys_[index] >> shift) & (RADIX_SIZE - 1)) + 1];
+				}
+				for (size_t i = 1; i <= RADIX_SIZE; ++i) {
+					counts[i] += counts[i - 1];
+				}
+				for (size_t index : order_) {
+					buffer_[counts[(keys_[index] >> shift) & (RADIX_SIZE - 1)]++] = index;
+				}
+				order_.swap(buffer_);
+			}
+		}
+
+		// Insertion sort of the previous order, returns false if the order changed too much
+		bool incremental_sort() {
+			size_t max_moves = MAX_MOVES_PER_ITEM * order_.size();
+			for (size_t i = 1; i < order_.size(); ++i) {
+				size_t index = order_[i];
+				size_t j = i;
+				for (; j > 0 && keys_[order_[j - 1]] > keys_[index]; --j) {
+					if (++statistics_.count_moves > max_moves) {
+						return false;
+					}
+					order_[j] = order_[j - 1];
+				}
+				order_[j] = index;
+			}
+			return true;
+		}
+
+	public:
+		TransparentSorter() noexcept {
+		}
+
+		// true - order of the previous frame is corrected by insertion sort when the set of models is the same
+		TransparentSorter& set_incremental(bool incremental) noexcept {
+			incremental_ = incremental;
+			return *this;
+		}
+
+		bool get_incremental() const noexcept {
+			return incremental_;
+		}
+
+		const Statistics& get_statistics() const noexcept {
+			return statistics_;
+		}
+
+		void clear() noexcept {
+			items_.clear();
+		}
+
+		void push(size_t object_id, size_t model_id, const GraphObject& object) {
+			items_.push_back({ object_id, model_id, &object });
+		}
+
+		// Sorts pushed models from far to near and clears the list
+		const std::vector<Item>& sort(const GraphObjectStorage& objects, const Vec3& camera_position) {
+			for (auto model_centers = model_centers_.begin(); model_centers != model_centers_.end();) {
+				if (!objects.contains(model_centers->first)) {
+					object_centers_.erase(model_centers->first);
+					model_centers = model_centers_.erase(model_centers);
+					continue;
+				}
+
+				const GraphObject& object = objects[model_centers->first];
+				for (auto model_center = model_centers->second.begin(); model_center != model_centers->second.end();) {
+					model_center = object.models.contains(model_center->first) ? std::next(model_center) : model_centers->second.erase(model_center);
+				}
+				++model_centers;
+			}
+
+			statistics_ = Statistics();
+			statistics_.count_items = items_.size();
+
+			std::vector<std::pair<size_t, size_t>> ids(items_.size());
+			keys_.resize(items_.size());
+			for (size_t i = 0; i < items_.size(); ++i) {
+				ids[i] = { items_[i].object_id, items_[i].model_id };
+				if (i == 0 || items_[i].object_id != items_[i - 1].object_id) {
+					update_object_center(items_[i].object_id, *items_[i].object);
+				}
+				Vec3 offset = get_center(items_[i]) - camera_position;
+				keys_[i] = get_key(offset * offset);
+			}
+
+			// Items are pushed in the storage order, so equal ids mean the same set of models
+			statistics_.incremental = incremental_ && ids == previous_ids_ && order_.size() == items_.size();
+			if (statistics_.incremental) {
+				statistics_.incremental = incremental_sort();
+			}
+			if (!statistics_.incremental) {
+				order_.resize(items_.size());
+				for (size_t i = 0; i < order_.size(); ++i) {
+					order_[i] = i;
+				}
+				radix_sort();
+			}
+			previous_ids_.swap(ids);
+
+			sorted_.resize(items_.size());
+			for (size_t i = 0; i < order_.size(); ++i) {
+				sorted_[i] = items_[order_[i]];
+			}
+			items_.clear();
+			return sorted_;
+		}
+	};
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <unordered_set>
+#include "GraphObjectStorage.h"
+
+
+namespace gre {
+	// Models outside of the camera frustum, one instance per camera, cameras are culled in parallel before drawing
+	class ViewCuller {
+	public:
+		struct Statistics {
+			size_t count_tested = 0;
+			size_t count_culled = 0;
+
+			Statistics& operator+=(const Statistics& other) noexcept {
+				count_tested += other.count_tested;
+				count_culled += other.count_culled;
+				return *this;
+			}
+		};
+
+	private:
+		std::unordered_map<size_t, std::unordered_set<size_t>> culled_;
+		Statistics statistics_;
+
+	public:
+		ViewCuller() noexcept {
+		}
+
+		const Statistics& get_statistics() const noexcept {
+			return statistics_;
+		}
+
+		// Bounding boxes of models are tested on CPU without GL calls, so updates of different cameras may run on worker threads
+		void update(const GraphObjectStorage& objects, const Matrix& view_projection) {
+			culled_.clear();
+			statistics_ = Statistics();
+			for (const auto& [object_id, object] : objects) {
+				Vec3 bounding_min, bounding_max;
+				if (!object.get_bounding_box(bounding_min, bounding_max)) {
+					continue;
+				}
+
+				for (const auto& [model_id, model] : object.models) {
+					++statistics_.count_tested;
+					if (!intersects_frustum(view_projection * model, bounding_min, bounding_max)) {
+						culled_[object_id].insert(model_id);
+						++statistics_.count_culled;
+					}
+				}
+			}
+		}
+
+		bool is_culled(size_t object_id, size_t model_id) const {
+			auto object = culled_.find(object_id);
+			return object != culled_.end() && object->second.count(model_id) == 1;
+		}
+
+		// true if at least one model of the object is culled
+		bool is_culled(size_t object_id) const noexcept {
+			return culled_.count(object_id) == 1;
+		}
+	};
+}
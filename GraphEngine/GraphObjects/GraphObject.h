@@ -5,6 +5,7 @@
 #include <assimp/Importer.hpp>
 #include <unordered_set>
 #include "MeshStorage.h"
+#include "../CommonClasses/CpuProfiler.h"
 #include "ModelStorage.h"
 
 
@@ -30,7 +31,7 @@ namespace gre {
 		}
 
 		// ...
-		Mesh processMesh(aiMesh* mesh, const aiScene* scene, std::string& directory, Matrix transform) {
+		Mesh processMesh(aiMesh* mesh, const aiScene* scene, std::string& directory, Matrix transform, uint8_t quantization) {
 			std::vector < Vec2 > tex_coords;
 			std::vector < Vec3 > positions, normals;
 			std::vector < Vec3 > colors;
@@ -50,7 +51,7 @@ namespace gre {
 				else
 					colors.push_back(Vec3(0, 0, 0));
 			}
-			Mesh polygon_mesh(positions.size());
+			Mesh polygon_mesh(positions.size(), quantization);
 			polygon_mesh.set_positions(positions, normals.empty());
 			if (!normals.empty())
 				polygon_mesh.set_normals(normals);
@@ -118,7 +119,7 @@ namespace gre {
 		}
 
 		// ...
-		void processNode(aiNode* node, const aiScene* scene, std::string& directory, Matrix transform) {
+		void processNode(aiNode* node, const aiScene* scene, std::string& directory, Matrix transform, uint8_t quantization) {
 			Matrix trans(4, 4, 0);
 			aiMatrix4x4 cur_transform = node->mTransformation;
 			for (int i = 0; i < 4; i++) {
@@ -128,16 +129,16 @@ namespace gre {
 			transform = trans * transform;
 
 			for (size_t i = 0; i < node->mNumMeshes; i++) {
-				meshes.insert(processMesh(scene->mMeshes[node->mMeshes[i]], scene, directory, transform));
+				meshes.insert(processMesh(scene->mMeshes[node->mMeshes[i]], scene, directory, transform, quantization));
 				break;
 			}
 
 			for (unsigned int i = 0; i < node->mNumChildren; i++) {
-				processNode(node->mChildren[i], scene, directory, transform);
+				processNode(node->mChildren[i], scene, directory, transform, quantization);
 			}
 		}
 
-		void draw_meshes(size_t model_id, const Shader<size_t>& shader) const {
+		void draw_meshes(size_t model_id, const Shader<size_t>& shader, size_t lod) const {
 			if (shader.description != ShaderType::MAIN) {
 				throw GreInvalidArgument(__FILE__, __LINE__, "draw_meshes, invalid shader type.\n\n");
 			}
@@ -149,18 +150,18 @@ namespace gre {
 			shader.set_uniform_matrix("not_instance_model", models[model_id]);
 
 			for (const auto& [id, mesh] : meshes) {
-				mesh.draw(1, shader);
+				mesh.draw(1, shader, lod);
 			}
 		}
 
-		void draw_meshes(const Shader<size_t>& shader) const {
+		void draw_meshes(const Shader<size_t>& shader, size_t lod) const {
 			if (shader.description != ShaderType::MAIN) {
 				throw GreInvalidArgument(__FILE__, __LINE__, "draw_meshes, invalid shader type.\n\n");
 			}
 			shader.set_uniform_i("model_id", -1);
 
 			for (const auto& [id, mesh] : meshes) {
-				mesh.draw(models.size(), shader);
+				mesh.draw(models.size(), shader, lod);
 			}
 		}
 
@@ -241,6 +242,35 @@ namespace gre {
 			return normals;
 		}
 
+		// Video memory used by mesh geometry in bytes
+		size_t get_memory_size() const noexcept {
+			return meshes.get_memory_size();
+		}
+
+		size_t get_count_lods() const noexcept {
+			size_t count_lods = 1;
+			for (const auto& [id, mesh] : meshes) {
+				count_lods = std::max(count_lods, mesh.get_count_lods());
+			}
+			return count_lods;
+		}
+
+		size_t get_count_triangles(size_t lod = 0) const noexcept {
+			size_t count_triangles = 0;
+			for (const auto& [id, mesh] : meshes) {
+				count_triangles += mesh.get_count_indices(lod) / 3;
+			}
+			return count_triangles;
+		}
+
+		// Generates simplified levels of detail for all meshes, see Mesh::generate_lods
+		GraphObject& generate_lods(size_t count_lods, double ratio = 0.5) {
+			meshes.apply_func([&](Mesh& mesh) {
+				mesh.generate_lods(count_lods, ratio);
+			});
+			return *this;
+		}
+
 		Vec3 get_mesh_center(size_t model_id, size_t mesh_id) const {
 			if (!models.contains(model_id)) {
 				throw GreOutOfRange(__FILE__, __LINE__, "get_mesh_center, invalid model id.\n\n");
@@ -252,10 +282,8 @@ namespace gre {
 			return models[model_id] * meshes[mesh_id].get_center();
 		}
 
-		Vec3 get_center(size_t model_id) const {
-			if (!models.contains(model_id)) {
-				throw GreOutOfRange(__FILE__, __LINE__, "get_center, invalid model id.\n\n");
-			}
+		// Center of unique vertices in model space, reads back all vertex buffers
+		Vec3 get_center() const {
 			if (meshes.size() == 0) {
 				throw GreDomainError(__FILE__, __LINE__, "get_center, object does not contain vertices.\n\n");
 			}
@@ -272,7 +300,48 @@ namespace gre {
 					center += position;
 				}
 			}
-			return models[model_id] * (center / static_cast<double>(used_positions.size()));
+			return center / static_cast<double>(used_positions.size());
+		}
+
+		Vec3 get_center(size_t model_id) const {
+			if (!models.contains(model_id)) {
+				throw GreOutOfRange(__FILE__, __LINE__, "get_center, invalid model id.\n\n");
+			}
+
+			return models[model_id] * get_center();
+		}
+
+		// Cheap summary of mesh geometry, caches of values read back from vertex buffers are rebuilt when it changes
+		std::vector<double> get_geometry_signature() const {
+			std::vector<double> signature;
+			for (const auto& [mesh_id, mesh] : meshes) {
+				Vec3 bounding_min = mesh.get_bounding_min();
+				Vec3 bounding_max = mesh.get_bounding_max();
+				signature.insert(signature.end(), {
+					static_cast<double>(mesh_id), static_cast<double>(mesh.get_count_points()), static_cast<double>(mesh.get_count_indices()),
+					bounding_min.x, bounding_min.y, bounding_min.z, bounding_max.x, bounding_max.y, bounding_max.z
+				});
+			}
+			return signature;
+		}
+
+		// Union of mesh bounding boxes in model space, returns false if object does not contain vertices
+		bool get_bounding_box(Vec3& bounding_min, Vec3& bounding_max) const {
+			bool empty = true;
+			for (const auto& [id, mesh] : meshes) {
+				if (mesh.get_count_points() == 0) {
+					continue;
+				}
+
+				Vec3 mesh_min = mesh.get_bounding_min();
+				Vec3 mesh_max = mesh.get_bounding_max();
+				for (size_t i = 0; i < 3; ++i) {
+					bounding_min[i] = empty ? mesh_min[i] : std::min(bounding_min[i], mesh_min[i]);
+					bounding_max[i] = empty ? mesh_max[i] : std::max(bounding_max[i], mesh_max[i]);
+				}
+				empty = false;
+			}
+			return !empty;
 		}
 
 		void swap(GraphObject& other) noexcept {
@@ -284,12 +353,13 @@ namespace gre {
 			meshes.set_matrix_buffer(models.matrix_buffer_);
 		}
 
-		// ...
-		void importFromFile(std::string path) {
+		// quantization - combination of VertexQuantization flags applied to imported meshes, count_lods - number of generated levels of detail
+		void importFromFile(std::string path, uint8_t quantization = VertexQuantization::FLOAT_ATTRIBUTES, size_t count_lods = 1) {
+			GRE_PROFILE_ZONE("GraphObject::importFromFile");
 			meshes.clear();
 
 			Assimp::Importer importer;
-			const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenNormals);
+			const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenNormals | (count_lods > 1 ? aiProcess_JoinIdenticalVertices : 0));
 
 			if (scene == NULL || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || scene->mRootNode == NULL) {
 				//std::cout << "ERROR::GRAPH_OBJECT::IMPORT\n" << importer.GetErrorString() << "\n";
@@ -310,16 +380,72 @@ namespace gre {
 				}
 			}
 
-			processNode(scene->mRootNode, scene, directory, Matrix::one_matrix(4));
+			processNode(scene->mRootNode, scene, directory, Matrix::one_matrix(4), quantization);
+			if (count_lods > 1) {
+				generate_lods(count_lods);
+			}
+		}
+
+		void draw_depth_map(size_t model_id, const Shader<size_t>& shader, size_t lod = 0) const {
+			if (shader.description != ShaderType::DEPTH) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "draw_depth_map, invalid shader type.\n\n");
+			}
+			if (!models.contains(model_id)) {
+				throw GreOutOfRange(__FILE__, __LINE__, "draw_depth_map, invalid model id.\n\n");
+			}
+
+			for (const auto& [id, mesh] : meshes) {
+				if (!mesh.material.shadow) {
+					continue;
+				}
+
+				mesh.draw(1, shader, lod, models.get_memory_id(model_id));
+			}
 		}
 
-		void draw_depth_map() const {
+		void draw_depth_map(const Shader<size_t>& shader, size_t lod = 0) const {
+			if (shader.description != ShaderType::DEPTH) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "draw_depth_map, invalid shader type.\n\n");
+			}
+
 			for (const auto& [id, mesh] : meshes) {
 				if (!mesh.material.shadow) {
 					continue;
 				}
 
-				mesh.draw(models.size(), Shader<size_t>());
+				mesh.draw(models.size(), shader, lod);
+			}
+		}
+
+		// Depth of meshes which never discard fragments, other meshes are left to the shading pass
+		void draw_depth_pre_pass(size_t model_id, const Shader<size_t>& shader, size_t lod = 0) const {
+			if (shader.description != ShaderType::DEPTH) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "draw_depth_pre_pass, invalid shader type.\n\n");
+			}
+			if (!models.contains(model_id)) {
+				throw GreOutOfRange(__FILE__, __LINE__, "draw_depth_pre_pass, invalid model id.\n\n");
+			}
+
+			for (const auto& [id, mesh] : meshes) {
+				if (mesh.frame || !mesh.material.is_opaque()) {
+					continue;
+				}
+
+				mesh.draw(1, shader, lod, models.get_memory_id(model_id));
+			}
+		}
+
+		void draw_depth_pre_pass(const Shader<size_t>& shader, size_t lod = 0) const {
+			if (shader.description != ShaderType::DEPTH) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "draw_depth_pre_pass, invalid shader type.\n\n");
+			}
+
+			for (const auto& [id, mesh] : meshes) {
+				if (mesh.frame || !mesh.material.is_opaque()) {
+					continue;
+				}
+
+				mesh.draw(models.size(), shader, lod);
 			}
 		}
 
@@ -349,7 +475,7 @@ namespace gre {
 			}
 		}
 
-		void draw(size_t model_id, const Shader<size_t>& shader) const {
+		void draw(size_t model_id, const Shader<size_t>& shader, size_t lod = 0) const {
 			if (shader.description != ShaderType::MAIN) {
 				throw GreInvalidArgument(__FILE__, __LINE__, "draw, invalid shader type.\n\n");
 			}
@@ -362,14 +488,14 @@ namespace gre {
 				glStencilMask(border_mask);
 			}
 
-			draw_meshes(model_id, shader);
+			draw_meshes(model_id, shader, lod);
 
 			if (border_mask > 0) {
 				glStencilMask(0x00);
 			}
 		}
 
-		void draw(const Shader<size_t>& shader) const {
+		void draw(const Shader<size_t>& shader, size_t lod = 0) const {
 			if (shader.description != ShaderType::MAIN) {
 				throw GreInvalidArgument(__FILE__, __LINE__, "draw_meshes, invalid shader type.\n\n");
 			}
@@ -379,7 +505,7 @@ namespace gre {
 				glStencilMask(border_mask);
 			}
 
-			draw_meshes(shader);
+			draw_meshes(shader, lod);
 
 			if (border_mask > 0) {
 				glStencilMask(0x00);
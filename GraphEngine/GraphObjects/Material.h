@@ -89,6 +89,11 @@ namespace gre {
             return !(*this == other);
         }
 
+        // Fragments are never discarded or blended
+        bool is_opaque() const noexcept {
+            return diffuse_map.get_id() == 0 ? equality(alpha_, 1.0) : diffuse_map.is_opaque();
+        }
+
         void set_shininess(double shininess) {
             if (shininess < 0.0) {
                 throw GreInvalidArgument(__FILE__, __LINE__, "set_shininess, invalid shininess value.\n\n");
@@ -140,5 +145,29 @@ namespace gre {
             check_color_value(__FILE__, __LINE__, __func__, emission);
             emission_ = emission;
         }
+
+        double get_shininess() const noexcept {
+            return shininess_;
+        }
+
+        double get_alpha() const noexcept {
+            return alpha_;
+        }
+
+        Vec3 get_ambient() const noexcept {
+            return ambient_;
+        }
+
+        Vec3 get_diffuse() const noexcept {
+            return diffuse_;
+        }
+
+        Vec3 get_specular() const noexcept {
+            return specular_;
+        }
+
+        Vec3 get_emission() const noexcept {
+            return emission_;
+        }
     };
 }
@@ -1,25 +1,37 @@
 #pragma once
 
 #include "Material.h"
+#include "../GraphicClasses/GeometryArena.h"
+#include "../GraphicClasses/MeshSimplifier.h"
 
 
 namespace gre {
 	class Mesh {
-		inline static const std::vector<GLint> MEMORY_CONFIGURATION = { 3, 3, 2, 3 };
+		friend class MeshStorage;
 
-		GLuint vertex_array_ = 0;
-		GLuint vertex_buffer_ = 0;
-		GLuint index_buffer_ = 0;
+		size_t allocation_id_ = std::numeric_limits<size_t>::max();
+		GLuint matrix_buffer_ = 0;
 
 		GLfloat border_width_ = 1.0;
 
+		uint8_t quantization_ = VertexQuantization::FLOAT_ATTRIBUTES;
+		Vec3 bounding_min_ = Vec3(0.0);
+		Vec3 bounding_max_ = Vec3(0.0);
+
 		size_t count_points_;
 		size_t count_indices_;
 
+		// First index and number of indices of each simplified level of detail, stored after the indices of level 0
+		std::vector<std::pair<size_t, size_t>> lods_;
+
 		void set_uniforms(const Shader<size_t>& shader) const {
 			if (shader.description == ShaderType::MAIN) {
 				material.set_uniforms(shader);
 			}
+			if (shader.description == ShaderType::MAIN || shader.description == ShaderType::DEPTH) {
+				shader.set_uniform_f("position_offset", get_position_offset());
+				shader.set_uniform_f("position_scale", get_position_scale());
+			}
 
 			glLineWidth(border_width_);
 			check_gl_errors(__FILE__, __LINE__, __func__);
@@ -34,40 +46,47 @@ namespace gre {
 			check_gl_errors(__FILE__, __LINE__, __func__);
 		}
 
-		void create_vertex_array() {
-			glGenVertexArrays(1, &vertex_array_);
-			glBindVertexArray(vertex_array_);
+		GeometryArena& get_arena() const {
+			return GeometryArena::get(quantization_);
+		}
 
-			glGenBuffers(1, &vertex_buffer_);
-			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+		void write_attribute(size_t attribute, const GLvoid* data) const {
+			get_arena().write_attribute(allocation_id_, attribute, data);
+		}
 
-			size_t memory_size = get_value<size_t>(MEMORY_CONFIGURATION.begin(), MEMORY_CONFIGURATION.end(), 0, [](auto element, auto* result) { *result += element; });
-			glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * memory_size * count_points_, NULL, GL_STATIC_DRAW);
+		void read_attribute(size_t attribute, GLvoid* data) const {
+			get_arena().read_attribute(allocation_id_, attribute, data);
+		}
 
-			memory_size = 0;
-			for (GLuint i = 0; i < MEMORY_CONFIGURATION.size(); memory_size += MEMORY_CONFIGURATION[i], ++i) {
-				glVertexAttribPointer(i, MEMORY_CONFIGURATION[i], GL_FLOAT, GL_FALSE, sizeof(GLfloat) * MEMORY_CONFIGURATION[i], reinterpret_cast<GLvoid*>(sizeof(GLfloat) * memory_size * count_points_));
-				glEnableVertexAttribArray(i);
-			}
+		void allocate() {
+			allocation_id_ = get_arena().allocate(count_points_, count_indices_);
+		}
 
-			glGenBuffers(1, &index_buffer_);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+		size_t get_count_all_indices() const noexcept {
+			return lods_.empty() ? count_indices_ : lods_.back().first + lods_.back().second;
+		}
 
-			glBindVertexArray(0);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-			check_gl_errors(__FILE__, __LINE__, __func__);
+		std::vector<GLuint> get_all_indices() const {
+			std::vector<GLuint> result(get_count_all_indices());
+			if (!result.empty()) {
+				get_arena().read_indices(allocation_id_, &result[0]);
+			}
+			return result;
+		}
+
+		void set_all_indices(const std::vector<GLuint>& indices) {
+			get_arena().resize_indices(allocation_id_, indices.size());
+			if (!indices.empty()) {
+				get_arena().write_indices(allocation_id_, &indices[0]);
+			}
 		}
 
 		void deallocate() {
-			glDeleteVertexArrays(1, &vertex_array_);
-			glDeleteBuffers(1, &vertex_buffer_);
-			glDeleteBuffers(1, &index_buffer_);
-			check_gl_errors(__FILE__, __LINE__, __func__);
+			if (allocation_id_ != std::numeric_limits<size_t>::max()) {
+				get_arena().free(allocation_id_);
+			}
 
-			vertex_array_ = 0;
-			vertex_buffer_ = 0;
-			index_buffer_ = 0;
+			allocation_id_ = std::numeric_limits<size_t>::max();
 		}
 
 	public:
@@ -84,8 +103,8 @@ namespace gre {
 			count_indices_ = 0;
 		}
 
-		// Default polygon shape
-		explicit Mesh(size_t count_points) {
+		// Default polygon shape, quantization is set before allocation, so attributes are not re-encoded
+		explicit Mesh(size_t count_points, uint8_t quantization = VertexQuantization::FLOAT_ATTRIBUTES) {
 			if (!glew_is_ok()) {
 				throw GreRuntimeError(__FILE__, __LINE__, "Mesh, failed to initialize GLEW.\n\n");
 			}
@@ -95,8 +114,9 @@ namespace gre {
 
 			count_points_ = count_points;
 			count_indices_ = (count_points - 2) * 3;
+			quantization_ = quantization;
 
-			create_vertex_array();
+			allocate();
 
 			std::vector<GLuint> indices(count_indices_);
 			for (size_t i = 0; i < count_points - 2; ++i) {
@@ -109,31 +129,18 @@ namespace gre {
 
 		Mesh(const Mesh& other) {
 			border_width_ = other.border_width_;
+			quantization_ = other.quantization_;
+			bounding_min_ = other.bounding_min_;
+			bounding_max_ = other.bounding_max_;
 			count_points_ = other.count_points_;
 			count_indices_ = other.count_indices_;
+			lods_ = other.lods_;
 			frame = other.frame;
 			material = other.material;
 
-			create_vertex_array();
-
-			glBindVertexArray(vertex_array_);
-			glBindBuffer(GL_COPY_READ_BUFFER, other.vertex_buffer_);
-			glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffer_);
-
-			size_t memory_size = get_value<size_t>(MEMORY_CONFIGURATION.begin(), MEMORY_CONFIGURATION.end(), 0, [](auto element, auto* result) { *result += element; });
-			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLfloat) * memory_size * count_points_);
-
-			glBindBuffer(GL_COPY_READ_BUFFER, other.index_buffer_);
-			glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer_);
-
-			glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * count_indices_, NULL, GL_STATIC_DRAW);
-			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GLuint) * count_indices_);
-
-			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
-			glBindBuffer(GL_COPY_READ_BUFFER, 0);
-			glBindVertexArray(0);
-
-			check_gl_errors(__FILE__, __LINE__, __func__);
+			if (other.allocation_id_ != std::numeric_limits<size_t>::max()) {
+				allocation_id_ = get_arena().allocate_copy(other.allocation_id_);
+			}
 		}
 
 		Mesh(Mesh&& other) noexcept {
@@ -153,7 +160,7 @@ namespace gre {
 		}
 
 		bool operator==(const Mesh& other) const noexcept {
-			return frame == other.frame && material == other.material;
+			return frame == other.frame && quantization_ == other.quantization_ && material == other.material;
 		}
 
 		bool operator!=(const Mesh& other) const noexcept {
@@ -174,18 +181,34 @@ namespace gre {
 				throw GreInvalidArgument(__FILE__, __LINE__, "set_positions, invalid number of points.\n\n");
 			}
 
-			std::vector<GLfloat> converted_positions(count_points_ * 3);
-			for (size_t i = 0; i < count_points_; ++i) {
+			bounding_min_ = positions.empty() ? Vec3(0.0) : positions[0];
+			bounding_max_ = bounding_min_;
+			for (const Vec3& position : positions) {
 				for (size_t j = 0; j < 3; ++j) {
-					converted_positions[3 * i + j] = static_cast<GLfloat>(positions[i][j]);
+					bounding_min_[j] = std::min(bounding_min_[j], position[j]);
+					bounding_max_[j] = std::max(bounding_max_[j], position[j]);
 				}
 			}
 
-			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * 3 * count_points_, reinterpret_cast<const GLvoid*>(&converted_positions[0]));
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-			check_gl_errors(__FILE__, __LINE__, __func__);
+			if (quantization_ & VertexQuantization::UNORM_POSITIONS) {
+				Vec3 extent = bounding_max_ - bounding_min_;
+				std::vector<GLushort> converted_positions(count_points_ * 4, 0);
+				for (size_t i = 0; i < count_points_; ++i) {
+					for (size_t j = 0; j < 3; ++j) {
+						double value = equality(extent[j], 0.0) ? 0.0 : (positions[i][j] - bounding_min_[j]) / extent[j];
+						converted_positions[4 * i + j] = static_cast<GLushort>(round(std::clamp(value, 0.0, 1.0) * 65535.0));
+					}
+				}
+				write_attribute(0, reinterpret_cast<const GLvoid*>(&converted_positions[0]));
+			} else {
+				std::vector<GLfloat> converted_positions(count_points_ * 3);
+				for (size_t i = 0; i < count_points_; ++i) {
+					for (size_t j = 0; j < 3; ++j) {
+						converted_positions[3 * i + j] = static_cast<GLfloat>(positions[i][j]);
+					}
+				}
+				write_attribute(0, reinterpret_cast<const GLvoid*>(&converted_positions[0]));
+			}
 
 			if (update_normals) {
 				if (positions.size() < 3) {
@@ -202,18 +225,22 @@ namespace gre {
 				throw GreInvalidArgument(__FILE__, __LINE__, "set_normals, invalid number of points.\n\n");
 			}
 
+			if (quantization_ & VertexQuantization::PACKED_NORMALS) {
+				std::vector<GLuint> converted_normals(count_points_);
+				for (size_t i = 0; i < count_points_; ++i) {
+					converted_normals[i] = pack_normal(normals[i]);
+				}
+				write_attribute(1, reinterpret_cast<const GLvoid*>(&converted_normals[0]));
+				return *this;
+			}
+
 			std::vector<GLfloat> converted_normals(count_points_ * 3);
 			for (size_t i = 0; i < count_points_; ++i) {
 				for (size_t j = 0; j < 3; ++j) {
 					converted_normals[3 * i + j] = static_cast<GLfloat>(normals[i][j]);
 				}
 			}
-
-			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-			glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 3 * count_points_, sizeof(GLfloat) * 3 * count_points_, reinterpret_cast<const GLvoid*>(&converted_normals[0]));
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-			check_gl_errors(__FILE__, __LINE__, __func__);
+			write_attribute(1, reinterpret_cast<const GLvoid*>(&converted_normals[0]));
 			return *this;
 		}
 
@@ -222,18 +249,24 @@ namespace gre {
 				throw GreInvalidArgument(__FILE__, __LINE__, "set_tex_coords, invalid number of points.\n\n");
 			}
 
+			if (quantization_ & VertexQuantization::HALF_TEX_COORDS) {
+				std::vector<GLhalf> converted_tex_coords(count_points_ * 2);
+				for (size_t i = 0; i < count_points_; ++i) {
+					for (size_t j = 0; j < 2; ++j) {
+						converted_tex_coords[2 * i + j] = float_to_half(static_cast<GLfloat>(tex_coords[i][j]));
+					}
+				}
+				write_attribute(2, reinterpret_cast<const GLvoid*>(&converted_tex_coords[0]));
+				return *this;
+			}
+
 			std::vector<GLfloat> converted_tex_coords(count_points_ * 2);
 			for (size_t i = 0; i < count_points_; ++i) {
 				for (size_t j = 0; j < 2; ++j) {
 					converted_tex_coords[2 * i + j] = static_cast<GLfloat>(tex_coords[i][j]);
 				}
 			}
-
-			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-			glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * count_points_, sizeof(GLfloat) * 2 * count_points_, reinterpret_cast<const GLvoid*>(&converted_tex_coords[0]));
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-			check_gl_errors(__FILE__, __LINE__, __func__);
+			write_attribute(2, reinterpret_cast<const GLvoid*>(&converted_tex_coords[0]));
 			return *this;
 		}
 
@@ -242,41 +275,154 @@ namespace gre {
 				throw GreInvalidArgument(__FILE__, __LINE__, "set_colors, invalid number of points.\n\n");
 			}
 
+			if (quantization_ & VertexQuantization::UNORM_COLORS) {
+				std::vector<GLubyte> converted_colors(count_points_ * 4, 255);
+				for (size_t i = 0; i < count_points_; ++i) {
+					for (size_t j = 0; j < 3; ++j) {
+						converted_colors[4 * i + j] = static_cast<GLubyte>(round(std::clamp(colors[i][j], 0.0, 1.0) * 255.0));
+					}
+				}
+				write_attribute(3, reinterpret_cast<const GLvoid*>(&converted_colors[0]));
+				return *this;
+			}
+
 			std::vector<GLfloat> converted_colors(count_points_ * 3);
 			for (size_t i = 0; i < count_points_; ++i) {
 				for (size_t j = 0; j < 3; ++j) {
 					converted_colors[3 * i + j] = static_cast<GLfloat>(colors[i][j]);
 				}
 			}
-
-			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-			glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 8 * count_points_, sizeof(GLfloat) * 3 * count_points_, reinterpret_cast<const GLvoid*>(&converted_colors[0]));
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-			check_gl_errors(__FILE__, __LINE__, __func__);
+			write_attribute(3, reinterpret_cast<const GLvoid*>(&converted_colors[0]));
 			return *this;
 		}
 
+		// Simplified levels of detail are removed
 		Mesh& set_indices(const std::vector<GLuint>& indices) {
 			count_indices_ = indices.size();
+			lods_.clear();
+
+			if (allocation_id_ == std::numeric_limits<size_t>::max()) {
+				allocate();
+			} else {
+				get_arena().resize_indices(allocation_id_, count_indices_);
+			}
 
-			glBindVertexArray(vertex_array_);
+			if (!indices.empty()) {
+				get_arena().write_indices(allocation_id_, &indices[0]);
+			}
+			return *this;
+		}
 
-			glDeleteBuffers(1, &index_buffer_);
-			glGenBuffers(1, &index_buffer_);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+		// Re-encodes the stored attributes, quantization - combination of VertexQuantization flags
+		Mesh& set_quantization(uint8_t quantization) {
+			if (quantization == quantization_) {
+				return *this;
+			}
+			if (count_points_ == 0) {
+				quantization_ = quantization;
+				return *this;
+			}
 
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), reinterpret_cast<const GLvoid*>(&indices[0]), GL_STATIC_DRAW);
+			std::vector<Vec3> positions = get_positions();
+			std::vector<Vec3> normals = get_normals();
+			std::vector<Vec2> tex_coords = get_tex_coords();
+			std::vector<Vec3> colors = get_colors();
+			std::vector<GLuint> indices = get_all_indices();
 
-			glBindVertexArray(0);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			deallocate();
+			quantization_ = quantization;
+			allocate();
 
-			check_gl_errors(__FILE__, __LINE__, __func__);
+			set_positions(positions);
+			set_normals(normals);
+			set_tex_coords(tex_coords);
+			set_colors(colors);
+			if (!indices.empty()) {
+				set_all_indices(indices);
+			}
+			return *this;
+		}
+
+		// Builds count_lods - 1 simplified levels, each next one keeps ratio of triangles of the previous
+		Mesh& generate_lods(size_t count_lods, double ratio = 0.5) {
+			if (count_lods == 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "generate_lods, invalid number of levels.\n\n");
+			}
+			if (less_equality(ratio, 0.0) || less_equality(1.0, ratio)) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "generate_lods, invalid ratio value.\n\n");
+			}
+
+			std::vector<GLuint> indices = get_indices();
+			std::vector<GLuint> all_indices = indices;
+			std::vector<Vec3> positions = frame || indices.empty() ? std::vector<Vec3>() : get_positions();
+			lods_.clear();
+			for (size_t i = 1; i < count_lods && !positions.empty(); ++i) {
+				size_t target_count_triangles = static_cast<size_t>(static_cast<double>(indices.size() / 3) * ratio);
+				std::vector<GLuint> simplified = MeshSimplifier::simplify(positions, indices, target_count_triangles);
+				if (simplified.empty() || simplified.size() >= indices.size()) {
+					break;
+				}
+
+				lods_.emplace_back(all_indices.size(), simplified.size());
+				all_indices.insert(all_indices.end(), simplified.begin(), simplified.end());
+				indices = std::move(simplified);
+			}
+
+			if (allocation_id_ != std::numeric_limits<size_t>::max()) {
+				set_all_indices(all_indices);
+			}
 			return *this;
 		}
 
-		GLuint get_vertex_array() const noexcept {
-			return vertex_array_;
+		GLuint get_vertex_array() const {
+			return get_arena().get_vertex_array();
+		}
+
+		uint8_t get_quantization() const noexcept {
+			return quantization_;
+		}
+
+		// Decoded position is position_offset + position_scale * stored position
+		Vec3 get_position_offset() const noexcept {
+			return quantization_ & VertexQuantization::UNORM_POSITIONS ? bounding_min_ : Vec3(0.0);
+		}
+
+		Vec3 get_position_scale() const noexcept {
+			return quantization_ & VertexQuantization::UNORM_POSITIONS ? bounding_max_ - bounding_min_ : Vec3(1.0);
+		}
+
+		GLfloat get_border_width() const noexcept {
+			return border_width_;
+		}
+
+		bool is_allocated() const noexcept {
+			return allocation_id_ != std::numeric_limits<size_t>::max();
+		}
+
+		// Offsets of the mesh geometry in the buffers of its arena, in indices and in vertices
+		size_t get_first_index() const {
+			return get_arena().get_index_offset(allocation_id_);
+		}
+
+		size_t get_base_vertex() const {
+			return get_arena().get_vertex_offset(allocation_id_);
+		}
+
+		Vec3 get_bounding_min() const noexcept {
+			return bounding_min_;
+		}
+
+		Vec3 get_bounding_max() const noexcept {
+			return bounding_max_;
+		}
+
+		size_t get_vertex_memory_size() const noexcept {
+			return GeometryArena::get_vertex_size(quantization_) * count_points_;
+		}
+
+		// Video memory used by vertices and indices of all levels of detail in bytes
+		size_t get_memory_size() const noexcept {
+			return get_vertex_memory_size() + sizeof(GLuint) * get_count_all_indices();
 		}
 
 		size_t get_count_points() const noexcept {
@@ -287,60 +433,88 @@ namespace gre {
 			return count_indices_;
 		}
 
+		size_t get_count_indices(size_t lod) const noexcept {
+			return lod == 0 || lods_.empty() ? count_indices_ : lods_[std::min(lod, lods_.size()) - 1].second;
+		}
+
+		size_t get_count_lods() const noexcept {
+			return lods_.size() + 1;
+		}
+
 		std::vector<Vec3> get_positions() const {
-			GLvoid* buffer = new GLfloat[3 * count_points_];
-			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-			glGetBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * 3 * count_points_, buffer);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			if (quantization_ & VertexQuantization::UNORM_POSITIONS) {
+				std::vector<GLushort> buffer(4 * count_points_);
+				read_attribute(0, reinterpret_cast<GLvoid*>(&buffer[0]));
+
+				Vec3 extent = bounding_max_ - bounding_min_;
+				std::vector<Vec3> result(count_points_);
+				for (size_t i = 0; i < count_points_; ++i) {
+					for (size_t j = 0; j < 3; ++j) {
+						result[i][j] = bounding_min_[j] + extent[j] * static_cast<double>(buffer[4 * i + j]) / 65535.0;
+					}
+				}
+				return result;
+			}
 
-			check_gl_errors(__FILE__, __LINE__, __func__);
-			return Vec3::move_in(count_points_, reinterpret_cast<GLfloat*>(buffer));
+			GLfloat* buffer = new GLfloat[3 * count_points_];
+			read_attribute(0, reinterpret_cast<GLvoid*>(buffer));
+			return Vec3::move_in(count_points_, buffer);
 		}
 
 		std::vector<Vec3> get_normals() const {
-			GLvoid* buffer = new GLfloat[3 * count_points_];
-			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-			glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 3 * count_points_, sizeof(GLfloat) * 3 * count_points_, buffer);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			if (quantization_ & VertexQuantization::PACKED_NORMALS) {
+				std::vector<GLuint> buffer(count_points_);
+				read_attribute(1, reinterpret_cast<GLvoid*>(&buffer[0]));
 
-			check_gl_errors(__FILE__, __LINE__, __func__);
-			return Vec3::move_in(count_points_, reinterpret_cast<GLfloat*>(buffer));
+				std::vector<Vec3> result(count_points_);
+				for (size_t i = 0; i < count_points_; ++i) {
+					result[i] = unpack_normal(buffer[i]);
+				}
+				return result;
+			}
+
+			GLfloat* buffer = new GLfloat[3 * count_points_];
+			read_attribute(1, reinterpret_cast<GLvoid*>(buffer));
+			return Vec3::move_in(count_points_, buffer);
 		}
 
 		std::vector<Vec2> get_tex_coords() const {
-			GLvoid* buffer = new GLfloat[2 * count_points_];
-			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-			glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * count_points_, sizeof(GLfloat) * 2 * count_points_, buffer);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			if (quantization_ & VertexQuantization::HALF_TEX_COORDS) {
+				std::vector<GLhalf> buffer(2 * count_points_);
+				read_attribute(2, reinterpret_cast<GLvoid*>(&buffer[0]));
 
-			check_gl_errors(__FILE__, __LINE__, __func__);
-			return Vec2::move_in(count_points_, reinterpret_cast<GLfloat*>(buffer));
+				std::vector<Vec2> result(count_points_);
+				for (size_t i = 0; i < count_points_; ++i) {
+					result[i] = Vec2(half_to_float(buffer[2 * i]), half_to_float(buffer[2 * i + 1]));
+				}
+				return result;
+			}
+
+			GLfloat* buffer = new GLfloat[2 * count_points_];
+			read_attribute(2, reinterpret_cast<GLvoid*>(buffer));
+			return Vec2::move_in(count_points_, buffer);
 		}
 
 		std::vector<Vec3> get_colors() const {
-			GLvoid* buffer = new GLfloat[3 * count_points_];
-			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
-			glGetBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 8 * count_points_, sizeof(GLfloat) * 3 * count_points_, buffer);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			if (quantization_ & VertexQuantization::UNORM_COLORS) {
+				std::vector<GLubyte> buffer(4 * count_points_);
+				read_attribute(3, reinterpret_cast<GLvoid*>(&buffer[0]));
 
-			check_gl_errors(__FILE__, __LINE__, __func__);
-			return Vec3::move_in(count_points_, reinterpret_cast<GLfloat*>(buffer));
+				std::vector<Vec3> result(count_points_);
+				for (size_t i = 0; i < count_points_; ++i) {
+					result[i] = Vec3(buffer[4 * i], buffer[4 * i + 1], buffer[4 * i + 2]) / 255.0;
+				}
+				return result;
+			}
+
+			GLfloat* buffer = new GLfloat[3 * count_points_];
+			read_attribute(3, reinterpret_cast<GLvoid*>(buffer));
+			return Vec3::move_in(count_points_, buffer);
 		}
 
 		std::vector<GLuint> get_indices() const {
-			GLuint* buffer = new GLuint[count_indices_];
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
-			glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLuint) * count_indices_, reinterpret_cast<GLvoid*>(buffer));
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-			check_gl_errors(__FILE__, __LINE__, __func__);
-
-			std::vector<GLuint> result(count_indices_);
-			for (size_t i = 0; i < count_indices_; ++i) {
-				result[i] = buffer[i];
-			}
-			delete[] buffer;
-
+			std::vector<GLuint> result = get_all_indices();
+			result.resize(count_indices_);
 			return result;
 		}
 
@@ -350,12 +524,15 @@ namespace gre {
 		}
 
 		void swap(Mesh& other) noexcept {
-			std::swap(vertex_array_, other.vertex_array_);
-			std::swap(vertex_buffer_, other.vertex_buffer_);
-			std::swap(index_buffer_, other.index_buffer_);
+			std::swap(allocation_id_, other.allocation_id_);
+			std::swap(matrix_buffer_, other.matrix_buffer_);
 			std::swap(border_width_, other.border_width_);
+			std::swap(quantization_, other.quantization_);
+			std::swap(bounding_min_, other.bounding_min_);
+			std::swap(bounding_max_, other.bounding_max_);
 			std::swap(count_points_, other.count_points_);
 			std::swap(count_indices_, other.count_indices_);
+			std::swap(lods_, other.lods_);
 			std::swap(frame, other.frame);
 			std::swap(material, other.material);
 		}
@@ -380,19 +557,23 @@ namespace gre {
 			return *this;
 		}
 
-		void draw(size_t count, const Shader<size_t>& shader) const {
-			if (count == 0) {
+		// Levels above the generated ones are drawn with the coarsest level, first_instance - memory id of the first model
+		void draw(size_t count, const Shader<size_t>& shader, size_t lod = 0, size_t first_instance = 0) const {
+			if (count == 0 || allocation_id_ == std::numeric_limits<size_t>::max()) {
 				return;
 			}
 
+			lod = std::min(lod, lods_.size());
+			size_t first_index = lod == 0 ? 0 : lods_[lod - 1].first;
+
 			set_uniforms(shader);
 
-			glBindVertexArray(vertex_array_);
-			if (!frame) {
-				glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(count_indices_), GL_UNSIGNED_INT, NULL, static_cast<GLsizei>(count));
-			} else {
-				glDrawElementsInstanced(GL_LINE_LOOP, static_cast<GLsizei>(count_indices_), GL_UNSIGNED_INT, NULL, static_cast<GLsizei>(count));
-			}
+			const GeometryArena& arena = get_arena();
+			arena.bind(matrix_buffer_);
+
+			GLvoid* indices = reinterpret_cast<GLvoid*>(sizeof(GLuint) * (arena.get_index_offset(allocation_id_) + first_index));
+			GLint base_vertex = static_cast<GLint>(arena.get_vertex_offset(allocation_id_));
+			glDrawElementsInstancedBaseVertexBaseInstance(frame ? GL_LINE_LOOP : GL_TRIANGLES, static_cast<GLsizei>(get_count_indices(lod)), GL_UNSIGNED_INT, indices, static_cast<GLsizei>(count), base_vertex, static_cast<GLuint>(first_instance));
 			glBindVertexArray(0);
 
 			check_gl_errors(__FILE__, __LINE__, __func__);
@@ -405,7 +586,7 @@ namespace gre {
 		}
 
 		static size_t get_count_params() noexcept {
-			return MEMORY_CONFIGURATION.size();
+			return GeometryArena::get_count_attributes();
 		}
 	};
 }
@@ -39,25 +39,8 @@ namespace gre {
 			return *this;
 		}
 
-		void set_mesh_matrix_buffer(Mesh& mesh) const {
-			if (matrix_buffer_ == 0) {
-				return;
-			}
-
-			glBindVertexArray(mesh.get_vertex_array());
-			glBindBuffer(GL_ARRAY_BUFFER, matrix_buffer_);
-
-			GLuint attrib_offset = static_cast<GLuint>(Mesh::get_count_params());
-			for (GLuint i = 0; i < 4; ++i) {
-				glVertexAttribPointer(attrib_offset + i, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 16, reinterpret_cast<GLvoid*>(sizeof(GLfloat) * 4 * i));
-				glEnableVertexAttribArray(attrib_offset + i);
-				glVertexAttribDivisor(attrib_offset + i, 1);
-			}
-
-			glBindVertexArray(0);
-			glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-			check_gl_errors(__FILE__, __LINE__, __func__);
+		void set_mesh_matrix_buffer(Mesh& mesh) const noexcept {
+			mesh.matrix_buffer_ = matrix_buffer_;
 		}
 
 		void set_matrix_buffer(GLuint matrix_buffer) {
@@ -126,6 +109,14 @@ namespace gre {
 			return meshes_.size();
 		}
 
+		size_t get_memory_size() const noexcept {
+			size_t memory_size = 0;
+			for (const auto& [id, mesh] : meshes_) {
+				memory_size += mesh.get_memory_size();
+			}
+			return memory_size;
+		}
+
 		bool empty() const noexcept {
 			return meshes_.empty();
 		}
@@ -208,6 +199,7 @@ namespace gre {
 			std::vector<Mesh> new_meshes;
 			while (!meshes_.empty()) {
 				Mesh current_mesh = meshes_[0].second;
+				size_t count_lods = 1;
 				std::vector<Vec3> positions;
 				std::vector<Vec3> normals;
 				std::vector<Vec2> tex_coords;
@@ -218,6 +210,7 @@ namespace gre {
 						continue;
 					}
 
+					count_lods = std::max(count_lods, meshes_[i].second.get_count_lods());
 					for (GLuint index : meshes_[i].second.get_indices()) {
 						indices.push_back(static_cast<GLuint>(positions.size()) + index);
 					}
@@ -238,12 +231,15 @@ namespace gre {
 					--i;
 				}
 
-				new_meshes.push_back(Mesh(positions.size()));
+				new_meshes.push_back(Mesh(positions.size(), current_mesh.get_quantization()));
 				new_meshes.back().set_positions(positions);
 				new_meshes.back().set_normals(normals);
 				new_meshes.back().set_tex_coords(tex_coords);
 				new_meshes.back().set_colors(colors);
 				new_meshes.back().set_indices(indices);
+				if (count_lods > 1) {
+					new_meshes.back().generate_lods(count_lods);
+				}
 			}
 
 			clear();
@@ -145,6 +145,11 @@ namespace gre {
 			return max_count_models_;
 		}
 
+		// Model matrices by memory ids, instanced attribute of meshes
+		GLuint get_matrix_buffer() const noexcept {
+			return matrix_buffer_;
+		}
+
 		bool contains(size_t id) const noexcept {
 			return id < models_index_.size() && models_index_[id] < std::numeric_limits<size_t>::max();
 		}
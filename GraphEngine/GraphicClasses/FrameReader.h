@@ -0,0 +1,163 @@
+#pragma once
+
+#include "GraphicFunctions.h"
+
+
+namespace gre {
+	// Reading of frame buffer pixels through pixel buffers, glReadPixels returns at once and pixels are mapped when their fence is signaled
+	class FrameReader {
+		struct Frame {
+			GLuint buffer = 0;
+			GLsync fence = nullptr;
+			GLsizei width = 0;
+			GLsizei height = 0;
+		};
+
+		inline static const size_t COUNT_FRAMES = 3;
+
+		// Requested frames are read in order from the first one
+		size_t first_frame_ = 0;
+		size_t count_requested_ = 0;
+		size_t count_dropped_frames_ = 0;
+		std::vector<Frame> frames_ = std::vector<Frame>(COUNT_FRAMES);
+
+		void pop_frame() {
+			glDeleteSync(frames_[first_frame_].fence);
+			frames_[first_frame_].fence = nullptr;
+			first_frame_ = (first_frame_ + 1) % COUNT_FRAMES;
+			--count_requested_;
+		}
+
+		void deallocate() {
+			for (Frame& frame : frames_) {
+				glDeleteSync(frame.fence);
+				glDeleteBuffers(1, &frame.buffer);
+				frame = Frame();
+			}
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			first_frame_ = 0;
+			count_requested_ = 0;
+		}
+
+	public:
+		FrameReader() noexcept {
+		}
+
+		// Requested frames are not copied
+		FrameReader(const FrameReader& other) noexcept {
+		}
+
+		FrameReader(FrameReader&& other) noexcept {
+			swap(other);
+		}
+
+		FrameReader& operator=(const FrameReader& other)& {
+			FrameReader reader(other);
+			swap(reader);
+			return *this;
+		}
+
+		FrameReader& operator=(FrameReader&& other)& {
+			deallocate();
+			swap(other);
+			return *this;
+		}
+
+		size_t get_count_requested() const noexcept {
+			return count_requested_;
+		}
+
+		// Frames overwritten by new requests before they were read
+		size_t get_count_dropped_frames() const noexcept {
+			return count_dropped_frames_;
+		}
+
+		// Copies RGBA pixels of the frame buffer, the first unread frame is dropped if COUNT_FRAMES frames are already requested
+		void request(GLuint frame_buffer, GLsizei width, GLsizei height) {
+			if (width <= 0 || height <= 0) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "request, invalid frame size.\n\n");
+			}
+
+			if (count_requested_ == COUNT_FRAMES) {
+				pop_frame();
+				++count_dropped_frames_;
+			}
+
+			Frame& frame = frames_[(first_frame_ + count_requested_) % COUNT_FRAMES];
+			if (frame.buffer == 0) {
+				glGenBuffers(1, &frame.buffer);
+				set_gl_object_label(GL_BUFFER, frame.buffer, "frame reader buffer");
+			}
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, frame.buffer);
+			if (frame.width != width || frame.height != height) {
+				glBufferData(GL_PIXEL_PACK_BUFFER, 4 * static_cast<GLsizeiptr>(width) * height, nullptr, GL_STREAM_READ);
+				frame.width = width;
+				frame.height = height;
+			}
+
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, frame_buffer);
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			++count_requested_;
+		}
+
+		// Pixels of the first requested frame with rows from top to bottom, returns false if the GPU has not finished it, wait = true blocks until it is finished
+		bool read(std::vector<uint8_t>& pixels, GLsizei& width, GLsizei& height, bool wait = false) {
+			if (count_requested_ == 0) {
+				throw GreRuntimeError(__FILE__, __LINE__, "read, there is no requested frame.\n\n");
+			}
+
+			Frame& frame = frames_[first_frame_];
+			GLenum status = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			while (wait && status == GL_TIMEOUT_EXPIRED) {
+				status = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			}
+			if (status == GL_WAIT_FAILED) {
+				throw GreRuntimeError(__FILE__, __LINE__, "read, failed to wait for the frame.\n\n");
+			}
+			if (status == GL_TIMEOUT_EXPIRED) {
+				return false;
+			}
+
+			width = frame.width;
+			height = frame.height;
+			size_t row_size = 4 * static_cast<size_t>(width);
+			pixels.resize(row_size * height);
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, frame.buffer);
+			const uint8_t* data = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, row_size * height, GL_MAP_READ_BIT));
+			if (data != nullptr) {
+				// Rows of GL images go from bottom to top
+				for (GLsizei y = 0; y < height; ++y) {
+					std::copy(data + y * row_size, data + (y + 1) * row_size, pixels.begin() + (height - 1 - y) * row_size);
+				}
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			pop_frame();
+			if (data == nullptr) {
+				throw GreRuntimeError(__FILE__, __LINE__, "read, failed to map the pixel buffer.\n\n");
+			}
+			return true;
+		}
+
+		void swap(FrameReader& other) noexcept {
+			std::swap(first_frame_, other.first_frame_);
+			std::swap(count_requested_, other.count_requested_);
+			std::swap(count_dropped_frames_, other.count_dropped_frames_);
+			std::swap(frames_, other.frames_);
+		}
+
+		~FrameReader() {
+			deallocate();
+		}
+	};
+}
@@ -0,0 +1,588 @@
+#pragma once
+
+#include <map>
+#include "GraphicFunctions.h"
+
+
+namespace gre {
+	// Shared vertex and index buffers for all meshes with one vertex format
+	class GeometryArena {
+		// First fit free list over a range of elements with coalescing of neighbour blocks
+		class FreeList {
+			size_t capacity_ = 0;
+			size_t free_size_ = 0;
+			std::map<size_t, size_t> blocks_;
+
+		public:
+			size_t allocate(size_t size) {
+				for (auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+					if (it->second < size) {
+						continue;
+					}
+
+					size_t offset = it->first;
+					size_t rest = it->second - size;
+					blocks_.erase(it);
+					if (rest > 0) {
+						blocks_[offset + size] = rest;
+					}
+
+					free_size_ -= size;
+					return offset;
+				}
+				return std::numeric_limits<size_t>::max();
+			}
+
+			void free(size_t offset, size_t size) {
+				if (size == 0) {
+					return;
+				}
+
+				free_size_ += size;
+
+				auto next = blocks_.lower_bound(offset);
+				if (next != blocks_.end() && offset + size == next->first) {
+					size += next->second;
+					next = blocks_.erase(next);
+				}
+				if (next != blocks_.begin()) {
+					auto prev = std::prev(next);
+					if (prev->first + prev->second == offset) {
+						prev->second += size;
+						return;
+					}
+				}
+
+				blocks_[offset] = size;
+			}
+
+			void grow(size_t capacity) {
+				if (capacity <= capacity_) {
+					return;
+				}
+
+				size_t offset = capacity_;
+				capacity_ = capacity;
+				free(offset, capacity - offset);
+			}
+
+			// Marks [0, size) as used and the rest as free
+			void reset(size_t size) {
+				blocks_.clear();
+				free_size_ = 0;
+				free(size, capacity_ - size);
+			}
+
+			size_t get_capacity() const noexcept {
+				return capacity_;
+			}
+
+			size_t get_free_size() const noexcept {
+				return free_size_;
+			}
+
+			size_t get_largest_block() const noexcept {
+				size_t largest_block = 0;
+				for (const auto& [offset, size] : blocks_) {
+					largest_block = std::max(largest_block, size);
+				}
+				return largest_block;
+			}
+
+			size_t get_count_blocks() const noexcept {
+				return blocks_.size();
+			}
+		};
+
+		struct Allocation {
+			size_t vertex_offset = 0;
+			size_t count_points = 0;
+			size_t index_offset = 0;
+			size_t count_indices = 0;
+		};
+
+		inline static const std::vector<GLint> MEMORY_CONFIGURATION = { 3, 3, 2, 3 };
+		inline static const size_t INITIAL_COUNT_POINTS = 1 << 16;
+		inline static const size_t INITIAL_COUNT_INDICES = 1 << 18;
+		inline static const GLuint MATRIX_BINDING = 4;
+		inline static const GLuint MODEL_ID_BINDING = 5;
+		inline static const GLuint MODEL_ID_ATTRIBUTE = 8;
+
+		// Arenas live until the process exits, the GL context may already be destroyed at static destruction
+		inline static std::map<uint8_t, GeometryArena*> arenas_;
+
+		uint8_t format_;
+		size_t count_defragmentations_ = 0;
+
+		GLuint vertex_array_ = 0;
+		std::vector<GLuint> vertex_buffers_;
+		GLuint index_buffer_ = 0;
+
+		FreeList vertices_;
+		FreeList indices_;
+
+		std::vector<size_t> free_allocation_id_;
+		std::vector<Allocation> allocations_;
+		std::vector<bool> used_allocations_;
+
+		explicit GeometryArena(uint8_t format) {
+			if (!glew_is_ok()) {
+				throw GreRuntimeError(__FILE__, __LINE__, "GeometryArena, failed to initialize GLEW.\n\n");
+			}
+
+			format_ = format;
+			vertex_buffers_.resize(MEMORY_CONFIGURATION.size(), 0);
+
+			glGenVertexArrays(1, &vertex_array_);
+			glBindVertexArray(vertex_array_);
+
+			for (GLuint i = 0; i < MEMORY_CONFIGURATION.size(); ++i) {
+				set_attribute_format(i);
+				glVertexAttribBinding(i, i);
+				glEnableVertexAttribArray(i);
+			}
+
+			for (GLuint i = 0; i < 4; ++i) {
+				glVertexAttribFormat(MATRIX_BINDING + i, 4, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 4 * i);
+				glVertexAttribBinding(MATRIX_BINDING + i, MATRIX_BINDING);
+			}
+			glVertexBindingDivisor(MATRIX_BINDING, 1);
+
+			glVertexAttribFormat(MODEL_ID_ATTRIBUTE, 1, GL_UNSIGNED_INT, GL_FALSE, 0);
+			glVertexAttribBinding(MODEL_ID_ATTRIBUTE, MODEL_ID_BINDING);
+			glVertexBindingDivisor(MODEL_ID_BINDING, 1);
+
+			glBindVertexArray(0);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			reallocate(INITIAL_COUNT_POINTS, INITIAL_COUNT_INDICES);
+		}
+
+		GeometryArena(const GeometryArena& other) = delete;
+		GeometryArena& operator=(const GeometryArena& other) = delete;
+
+		void set_attribute_format(GLuint attribute) const {
+			switch (attribute) {
+			case 0:
+				if (format_ & VertexQuantization::UNORM_POSITIONS) {
+					glVertexAttribFormat(attribute, 4, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+					return;
+				}
+				break;
+			case 1:
+				if (format_ & VertexQuantization::PACKED_NORMALS) {
+					glVertexAttribFormat(attribute, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 0);
+					return;
+				}
+				break;
+			case 2:
+				if (format_ & VertexQuantization::HALF_TEX_COORDS) {
+					glVertexAttribFormat(attribute, 2, GL_HALF_FLOAT, GL_FALSE, 0);
+					return;
+				}
+				break;
+			case 3:
+				if (format_ & VertexQuantization::UNORM_COLORS) {
+					glVertexAttribFormat(attribute, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0);
+					return;
+				}
+				break;
+			}
+			glVertexAttribFormat(attribute, MEMORY_CONFIGURATION[attribute], GL_FLOAT, GL_FALSE, 0);
+		}
+
+		// Moves live ranges into new buffers, packed is true to place them without gaps
+		void reallocate(size_t count_points, size_t count_indices, bool packed = false) {
+			std::vector<GLuint> vertex_buffers(vertex_buffers_.size(), 0);
+			glGenBuffers(static_cast<GLsizei>(vertex_buffers.size()), &vertex_buffers[0]);
+
+			GLuint index_buffer = 0;
+			glGenBuffers(1, &index_buffer);
+
+			for (size_t i = 0; i < vertex_buffers.size(); ++i) {
+				glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffers[i]);
+				glBufferData(GL_COPY_WRITE_BUFFER, get_attribute_size(format_, i) * count_points, NULL, GL_STATIC_DRAW);
+			}
+			glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * count_indices, NULL, GL_STATIC_DRAW);
+
+			std::vector<size_t> order;
+			for (size_t id = 0; id < allocations_.size(); ++id) {
+				if (used_allocations_[id]) {
+					order.push_back(id);
+				}
+			}
+			std::sort(order.begin(), order.end(), [&](size_t left, size_t right) { return allocations_[left].vertex_offset < allocations_[right].vertex_offset; });
+
+			size_t vertex_offset = 0;
+			for (size_t id : order) {
+				Allocation& allocation = allocations_[id];
+				size_t new_offset = packed ? vertex_offset : allocation.vertex_offset;
+				for (size_t i = 0; i < vertex_buffers.size(); ++i) {
+					size_t attribute_size = get_attribute_size(format_, i);
+					glBindBuffer(GL_COPY_READ_BUFFER, vertex_buffers_[i]);
+					glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffers[i]);
+					glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, attribute_size * allocation.vertex_offset, attribute_size * new_offset, attribute_size * allocation.count_points);
+				}
+				allocation.vertex_offset = new_offset;
+				vertex_offset += allocation.count_points;
+			}
+
+			std::sort(order.begin(), order.end(), [&](size_t left, size_t right) { return allocations_[left].index_offset < allocations_[right].index_offset; });
+
+			size_t index_offset = 0;
+			glBindBuffer(GL_COPY_READ_BUFFER, index_buffer_);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer);
+			for (size_t id : order) {
+				Allocation& allocation = allocations_[id];
+				size_t new_offset = packed ? index_offset : allocation.index_offset;
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(GLuint) * allocation.index_offset, sizeof(GLuint) * new_offset, sizeof(GLuint) * allocation.count_indices);
+				allocation.index_offset = new_offset;
+				index_offset += allocation.count_indices;
+			}
+
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+			glDeleteBuffers(static_cast<GLsizei>(vertex_buffers_.size()), &vertex_buffers_[0]);
+			glDeleteBuffers(1, &index_buffer_);
+			vertex_buffers_ = vertex_buffers;
+			index_buffer_ = index_buffer;
+
+			glBindVertexArray(vertex_array_);
+			for (GLuint i = 0; i < vertex_buffers_.size(); ++i) {
+				glBindVertexBuffer(i, vertex_buffers_[i], 0, static_cast<GLsizei>(get_attribute_size(format_, i)));
+			}
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+			glBindVertexArray(0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+
+			vertices_.grow(count_points);
+			indices_.grow(count_indices);
+			if (packed) {
+				vertices_.reset(vertex_offset);
+				indices_.reset(index_offset);
+			}
+		}
+
+		// Returns offset of the free range, the buffers are grown or packed if necessary
+		size_t allocate_range(FreeList& free_list, size_t size, bool vertices) {
+			if (size == 0) {
+				return 0;
+			}
+
+			size_t offset = free_list.allocate(size);
+			if (offset != std::numeric_limits<size_t>::max()) {
+				return offset;
+			}
+
+			if (free_list.get_free_size() >= size) {
+				defragment();
+			} else {
+				size_t capacity = std::max(2 * free_list.get_capacity(), free_list.get_capacity() + size);
+				if (vertices) {
+					reallocate(capacity, indices_.get_capacity());
+				} else {
+					reallocate(vertices_.get_capacity(), capacity);
+				}
+			}
+			return free_list.allocate(size);
+		}
+
+		const Allocation& get_allocation(size_t id, const char* func_name) const {
+			if (!contains(id)) {
+				throw GreOutOfRange(__FILE__, __LINE__, std::string(func_name) + ", invalid allocation id.\n\n");
+			}
+
+			return allocations_[id];
+		}
+
+	public:
+		struct Statistics {
+			size_t count_allocations = 0;
+			size_t count_defragmentations = 0;
+
+			size_t vertex_capacity = 0;
+			size_t used_vertices = 0;
+			size_t largest_free_vertex_block = 0;
+			size_t count_free_vertex_blocks = 0;
+
+			size_t index_capacity = 0;
+			size_t used_indices = 0;
+			size_t largest_free_index_block = 0;
+			size_t count_free_index_blocks = 0;
+
+			// Video memory reserved by the buffers in bytes
+			size_t memory_size = 0;
+
+			Statistics& operator+=(const Statistics& other) noexcept {
+				count_allocations += other.count_allocations;
+				count_defragmentations += other.count_defragmentations;
+				vertex_capacity += other.vertex_capacity;
+				used_vertices += other.used_vertices;
+				largest_free_vertex_block = std::max(largest_free_vertex_block, other.largest_free_vertex_block);
+				count_free_vertex_blocks += other.count_free_vertex_blocks;
+				index_capacity += other.index_capacity;
+				used_indices += other.used_indices;
+				largest_free_index_block = std::max(largest_free_index_block, other.largest_free_index_block);
+				count_free_index_blocks += other.count_free_index_blocks;
+				memory_size += other.memory_size;
+				return *this;
+			}
+
+			double get_vertex_occupancy() const noexcept {
+				return vertex_capacity == 0 ? 0.0 : static_cast<double>(used_vertices) / static_cast<double>(vertex_capacity);
+			}
+
+			double get_index_occupancy() const noexcept {
+				return index_capacity == 0 ? 0.0 : static_cast<double>(used_indices) / static_cast<double>(index_capacity);
+			}
+		};
+
+		size_t allocate(size_t count_points, size_t count_indices) {
+			size_t id = allocations_.size();
+			if (free_allocation_id_.empty()) {
+				allocations_.push_back(Allocation());
+				used_allocations_.push_back(true);
+			} else {
+				id = free_allocation_id_.back();
+				free_allocation_id_.pop_back();
+				used_allocations_[id] = true;
+			}
+
+			// Ranges are registered one by one as packing the buffers moves only registered ranges
+			size_t vertex_offset = allocate_range(vertices_, count_points, true);
+			allocations_[id].vertex_offset = vertex_offset;
+			allocations_[id].count_points = count_points;
+
+			size_t index_offset = allocate_range(indices_, count_indices, false);
+			allocations_[id].index_offset = index_offset;
+			allocations_[id].count_indices = count_indices;
+			return id;
+		}
+
+		// Copy of the vertices and indices of other allocation from this arena
+		size_t allocate_copy(size_t id) {
+			Allocation source = get_allocation(id, __func__);
+			size_t new_id = allocate(source.count_points, source.count_indices);
+			source = allocations_[id];
+			const Allocation& destination = allocations_[new_id];
+
+			for (size_t i = 0; i < vertex_buffers_.size(); ++i) {
+				size_t attribute_size = get_attribute_size(format_, i);
+				glBindBuffer(GL_COPY_READ_BUFFER, vertex_buffers_[i]);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, vertex_buffers_[i]);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, attribute_size * source.vertex_offset, attribute_size * destination.vertex_offset, attribute_size * source.count_points);
+			}
+			glBindBuffer(GL_COPY_READ_BUFFER, index_buffer_);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer_);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(GLuint) * source.index_offset, sizeof(GLuint) * destination.index_offset, sizeof(GLuint) * source.count_indices);
+
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return new_id;
+		}
+
+		GeometryArena& resize_indices(size_t id, size_t count_indices) {
+			Allocation allocation = get_allocation(id, __func__);
+			if (allocation.count_indices == count_indices) {
+				return *this;
+			}
+
+			indices_.free(allocation.index_offset, allocation.count_indices);
+			allocations_[id].count_indices = 0;
+
+			size_t index_offset = allocate_range(indices_, count_indices, false);
+			allocations_[id].index_offset = index_offset;
+			allocations_[id].count_indices = count_indices;
+			return *this;
+		}
+
+		GeometryArena& free(size_t id) {
+			const Allocation& allocation = get_allocation(id, __func__);
+
+			vertices_.free(allocation.vertex_offset, allocation.count_points);
+			indices_.free(allocation.index_offset, allocation.count_indices);
+
+			allocations_[id] = Allocation();
+			used_allocations_[id] = false;
+			free_allocation_id_.push_back(id);
+			return *this;
+		}
+
+		// Packs all allocations to the beginning of the buffers
+		GeometryArena& defragment() {
+			reallocate(vertices_.get_capacity(), indices_.get_capacity(), true);
+			++count_defragmentations_;
+			return *this;
+		}
+
+		void write_attribute(size_t id, size_t attribute, const GLvoid* data) const {
+			const Allocation& allocation = get_allocation(id, __func__);
+			if (vertex_buffers_.size() <= attribute) {
+				throw GreOutOfRange(__FILE__, __LINE__, "write_attribute, invalid attribute index.\n\n");
+			}
+
+			size_t attribute_size = get_attribute_size(format_, attribute);
+			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers_[attribute]);
+			glBufferSubData(GL_ARRAY_BUFFER, attribute_size * allocation.vertex_offset, attribute_size * allocation.count_points, data);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void read_attribute(size_t id, size_t attribute, GLvoid* data) const {
+			const Allocation& allocation = get_allocation(id, __func__);
+			if (vertex_buffers_.size() <= attribute) {
+				throw GreOutOfRange(__FILE__, __LINE__, "read_attribute, invalid attribute index.\n\n");
+			}
+
+			size_t attribute_size = get_attribute_size(format_, attribute);
+			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers_[attribute]);
+			glGetBufferSubData(GL_ARRAY_BUFFER, attribute_size * allocation.vertex_offset, attribute_size * allocation.count_points, data);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void write_indices(size_t id, const GLuint* data) const {
+			const Allocation& allocation = get_allocation(id, __func__);
+
+			glBindBuffer(GL_COPY_WRITE_BUFFER, index_buffer_);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * allocation.index_offset, sizeof(GLuint) * allocation.count_indices, reinterpret_cast<const GLvoid*>(data));
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		void read_indices(size_t id, GLuint* data) const {
+			const Allocation& allocation = get_allocation(id, __func__);
+
+			glBindBuffer(GL_COPY_READ_BUFFER, index_buffer_);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, sizeof(GLuint) * allocation.index_offset, sizeof(GLuint) * allocation.count_indices, reinterpret_cast<GLvoid*>(data));
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		// Binds shared vertex array, matrix_buffer - per instance model matrices or 0, model_id_buffer - per instance model memory ids or 0
+		void bind(GLuint matrix_buffer, GLuint model_id_buffer = 0) const {
+			glBindVertexArray(vertex_array_);
+			for (GLuint i = 0; i < 4; ++i) {
+				if (matrix_buffer != 0) {
+					glEnableVertexAttribArray(MATRIX_BINDING + i);
+				} else {
+					glDisableVertexAttribArray(MATRIX_BINDING + i);
+				}
+			}
+			glBindVertexBuffer(MATRIX_BINDING, matrix_buffer, 0, matrix_buffer != 0 ? sizeof(GLfloat) * 16 : 0);
+
+			if (model_id_buffer != 0) {
+				glEnableVertexAttribArray(MODEL_ID_ATTRIBUTE);
+			} else {
+				glDisableVertexAttribArray(MODEL_ID_ATTRIBUTE);
+			}
+			glBindVertexBuffer(MODEL_ID_BINDING, model_id_buffer, 0, model_id_buffer != 0 ? sizeof(GLuint) : 0);
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+		bool contains(size_t id) const noexcept {
+			return id < allocations_.size() && used_allocations_[id];
+		}
+
+		size_t get_vertex_offset(size_t id) const {
+			return get_allocation(id, __func__).vertex_offset;
+		}
+
+		size_t get_index_offset(size_t id) const {
+			return get_allocation(id, __func__).index_offset;
+		}
+
+		GLuint get_vertex_array() const noexcept {
+			return vertex_array_;
+		}
+
+		GLuint get_index_buffer() const noexcept {
+			return index_buffer_;
+		}
+
+		uint8_t get_format() const noexcept {
+			return format_;
+		}
+
+		Statistics get_statistics() const noexcept {
+			Statistics statistics;
+			statistics.count_allocations = allocations_.size() - free_allocation_id_.size();
+			statistics.count_defragmentations = count_defragmentations_;
+
+			statistics.vertex_capacity = vertices_.get_capacity();
+			statistics.used_vertices = vertices_.get_capacity() - vertices_.get_free_size();
+			statistics.largest_free_vertex_block = vertices_.get_largest_block();
+			statistics.count_free_vertex_blocks = vertices_.get_count_blocks();
+
+			statistics.index_capacity = indices_.get_capacity();
+			statistics.used_indices = indices_.get_capacity() - indices_.get_free_size();
+			statistics.largest_free_index_block = indices_.get_largest_block();
+			statistics.count_free_index_blocks = indices_.get_count_blocks();
+
+			statistics.memory_size = get_vertex_size(format_) * vertices_.get_capacity() + sizeof(GLuint) * indices_.get_capacity();
+			return statistics;
+		}
+
+		// Size in bytes of one vertex in the attribute stream
+		static size_t get_attribute_size(uint8_t format, size_t attribute) noexcept {
+			switch (attribute) {
+			case 0:
+				return format & VertexQuantization::UNORM_POSITIONS ? 4 * sizeof(GLushort) : 3 * sizeof(GLfloat);
+			case 1:
+				return format & VertexQuantization::PACKED_NORMALS ? sizeof(GLuint) : 3 * sizeof(GLfloat);
+			case 2:
+				return format & VertexQuantization::HALF_TEX_COORDS ? 2 * sizeof(GLhalf) : 2 * sizeof(GLfloat);
+			case 3:
+				return format & VertexQuantization::UNORM_COLORS ? 4 * sizeof(GLubyte) : 3 * sizeof(GLfloat);
+			default:
+				return 0;
+			}
+		}
+
+		static size_t get_vertex_size(uint8_t format) noexcept {
+			size_t vertex_size = 0;
+			for (size_t i = 0; i < MEMORY_CONFIGURATION.size(); ++i) {
+				vertex_size += get_attribute_size(format, i);
+			}
+			return vertex_size;
+		}
+
+		static size_t get_count_attributes() noexcept {
+			return MEMORY_CONFIGURATION.size();
+		}
+
+		// Arena for the vertex format, it is created on first use
+		static GeometryArena& get(uint8_t format) {
+			auto it = arenas_.find(format);
+			if (it == arenas_.end()) {
+				it = arenas_.insert({ format, new GeometryArena(format) }).first;
+			}
+			return *it->second;
+		}
+
+		static Statistics get_total_statistics() noexcept {
+			Statistics statistics;
+			for (const auto& [format, arena] : arenas_) {
+				statistics += arena->get_statistics();
+			}
+			return statistics;
+		}
+
+		static void defragment_all() {
+			for (auto& [format, arena] : arenas_) {
+				arena->defragment();
+			}
+		}
+	};
+}
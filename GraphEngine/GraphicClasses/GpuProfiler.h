@@ -0,0 +1,128 @@
+#pragma once
+
+#include "TimestampQueries.h"
+
+
+namespace gre {
+	// Nested GPU time scopes by timestamp queries, results are read TimestampQueries::COUNT_FRAMES frames later without waiting for the GPU
+	// GL_TIME_ELAPSED queries can not be nested, so every scope is measured by a pair of timestamps
+	class GpuProfiler {
+	public:
+		struct Scope {
+			std::string name;
+			size_t depth = 0;
+			// Milliseconds
+			double time = 0.0;
+		};
+
+	private:
+		struct Record {
+			std::string name;
+			size_t depth = 0;
+			size_t begin_query = 0;
+			size_t end_query = 0;
+		};
+
+		TimestampQueries queries_;
+		// Records of every frame of the ring of queries
+		std::vector<std::vector<Record>> records_ = std::vector<std::vector<Record>>(TimestampQueries::COUNT_FRAMES);
+		// Records of scopes which are not ended yet
+		std::vector<size_t> open_records_;
+		std::vector<Scope> scopes_;
+
+	public:
+		GpuProfiler() noexcept {
+		}
+
+		GpuProfiler(const GpuProfiler& other) noexcept : queries_(other.queries_) {
+		}
+
+		GpuProfiler(GpuProfiler&& other) noexcept {
+			swap(other);
+		}
+
+		GpuProfiler& operator=(const GpuProfiler& other)& {
+			GpuProfiler profiler(other);
+			swap(profiler);
+			return *this;
+		}
+
+		GpuProfiler& operator=(GpuProfiler&& other)& noexcept {
+			swap(other);
+			return *this;
+		}
+
+		// Scopes of the last read frame in order of their beginning, children follow their parent with greater depth
+		const std::vector<Scope>& get_scopes() const noexcept {
+			return scopes_;
+		}
+
+		// Total time of all scopes with this name in milliseconds
+		double get_time(const std::string& name) const noexcept {
+			double time = 0.0;
+			for (const Scope& scope : scopes_) {
+				if (scope.name == name) {
+					time += scope.time;
+				}
+			}
+			return time;
+		}
+
+		// Time of all scopes without parent in milliseconds
+		double get_frame_time() const noexcept {
+			double time = 0.0;
+			for (const Scope& scope : scopes_) {
+				if (scope.depth == 0) {
+					time += scope.time;
+				}
+			}
+			return time;
+		}
+
+		// Frames which results were not ready in time, their scopes are skipped
+		size_t get_count_dropped_frames() const noexcept {
+			return queries_.get_count_dropped_frames();
+		}
+
+		// Reads scopes of the oldest frame of the ring if they are ready and reuses their queries
+		void begin_frame() {
+			if (!open_records_.empty()) {
+				throw GreRuntimeError(__FILE__, __LINE__, "begin_frame, profiler scope is not ended.\n\n");
+			}
+
+			bool ready = queries_.begin_frame();
+			std::vector<Record>& records = records_[queries_.get_frame()];
+			if (ready) {
+				const std::vector<GLuint64>& timestamps = queries_.get_timestamps();
+				scopes_.clear();
+				for (const Record& record : records) {
+					scopes_.push_back({ record.name, record.depth, static_cast<double>(timestamps[record.end_query] - timestamps[record.begin_query]) / 1000000.0 });
+				}
+			}
+			records.clear();
+		}
+
+		void begin(const std::string& name) {
+			std::vector<Record>& records = records_[queries_.get_frame()];
+			size_t begin_query = queries_.query_counter();
+			open_records_.push_back(records.size());
+			records.push_back({ name, open_records_.size() - 1, begin_query, begin_query });
+		}
+
+		void end() {
+			if (open_records_.empty()) {
+				throw GreRuntimeError(__FILE__, __LINE__, "end, there is no profiler scope to end.\n\n");
+			}
+
+			records_[queries_.get_frame()][open_records_.back()].end_query = queries_.query_counter();
+			open_records_.pop_back();
+		}
+
+		void swap(GpuProfiler& other) noexcept {
+			queries_.swap(other.queries_);
+			std::swap(records_, other.records_);
+			std::swap(open_records_, other.open_records_);
+			std::swap(scopes_, other.scopes_);
+		}
+	};
+}
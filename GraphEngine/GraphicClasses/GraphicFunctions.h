@@ -1,21 +1,151 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
 #include "../CommonClasses/Functions.h"
+#include "../CommonClasses/Matrix.h"
 #include "../CommonClasses/Vec3.h"
 
 
+// Initial GL error policy, see GlErrorPolicy, without definition checks are disabled in release builds and done by the debug callback otherwise
+#ifndef GRE_GL_ERROR_POLICY
+#ifdef NDEBUG
+#define GRE_GL_ERROR_POLICY 0
+#else
+#define GRE_GL_ERROR_POLICY 1
+#endif
+#endif
+
+
 namespace gre {
 	bool GLEW_IS_OK = false;
 
-	enum ShaderType : size_t { NONE = 0, MAIN = 1, DEPTH = 2, POST = 3 };
+	// NO_CHECKS - errors are ignored, DEBUG_CALLBACK - KHR_debug reports errors without stalls and they are thrown by the next check, SYNCHRONOUS_CHECKS - glGetError after every checked operation
+	enum GlErrorPolicy : uint8_t { NO_CHECKS = 0, DEBUG_CALLBACK = 1, SYNCHRONOUS_CHECKS = 2 };
+
+	GlErrorPolicy GL_ERROR_POLICY = static_cast<GlErrorPolicy>(GRE_GL_ERROR_POLICY);
+	// Until init_gl_debug_output installs the callback, DEBUG_CALLBACK checks are done by glGetError
+	bool GL_DEBUG_CALLBACK_INSTALLED = false;
+	// Debug callback may be called from a driver thread, the first error message is kept until it is thrown
+	std::atomic<bool> GL_DEBUG_ERROR = false;
+	std::mutex GL_DEBUG_MUTEX;
+	std::string GL_DEBUG_MESSAGE;
+
+	enum ShaderType : size_t { NONE = 0, MAIN = 1, DEPTH = 2, POST = 3, CULLING = 4, BOUNDS = 5, LIGHTING = 6 };
+
+	// Vertex attribute encodings, combined as bit flags
+	enum VertexQuantization : uint8_t { FLOAT_ATTRIBUTES = 0, UNORM_POSITIONS = 1, PACKED_NORMALS = 2, HALF_TEX_COORDS = 4, UNORM_COLORS = 8 };
 
     bool glew_is_ok() noexcept {
 		glewExperimental = GL_TRUE;
-		return GLEW_IS_OK = GLEW_IS_OK ? true : glewInit() == GLEW_OK;
+		if (GLEW_IS_OK) {
+			return true;
+		}
+
+		GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+		// GLEW built for GLX reports the missing X display of EGL contexts after GL functions are already loaded
+		if (status == GLEW_ERROR_NO_GLX_DISPLAY) {
+			status = GLEW_OK;
+		}
+#endif
+		return GLEW_IS_OK = status == GLEW_OK;
 	}
 	
+	void GLAPIENTRY gl_debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* user_param) {
+		if (type != GL_DEBUG_TYPE_ERROR || GL_DEBUG_ERROR.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(GL_DEBUG_MUTEX);
+		GL_DEBUG_MESSAGE = std::string(message, length >= 0 ? static_cast<size_t>(length) : std::strlen(message));
+		GL_DEBUG_ERROR.store(true, std::memory_order_release);
+	}
+
+	// Returns the message of the last reported debug error and clears it
+	std::string take_gl_debug_message() {
+		std::lock_guard<std::mutex> lock(GL_DEBUG_MUTEX);
+		std::string message;
+		std::swap(message, GL_DEBUG_MESSAGE);
+		GL_DEBUG_ERROR.store(false, std::memory_order_release);
+		return message;
+	}
+
+	// Applies the error policy to the current context, called right after GLEW is initialized for the context
+	void init_gl_debug_output() {
+		GL_DEBUG_CALLBACK_INSTALLED = false;
+
+		// Without KHR_debug errors are reported only by glGetError, other contexts than debug ones may report nothing
+		GLint context_flags = 0;
+		glGetIntegerv(GL_CONTEXT_FLAGS, &context_flags);
+		if (GL_ERROR_POLICY == GlErrorPolicy::DEBUG_CALLBACK && (!GLEW_KHR_debug || (context_flags & GL_CONTEXT_FLAG_DEBUG_BIT) == 0)) {
+			GL_ERROR_POLICY = GlErrorPolicy::SYNCHRONOUS_CHECKS;
+		}
+		if (!GLEW_KHR_debug) {
+			return;
+		}
+		if (GL_ERROR_POLICY == GlErrorPolicy::NO_CHECKS) {
+			glDisable(GL_DEBUG_OUTPUT);
+			return;
+		}
+
+		glEnable(GL_DEBUG_OUTPUT);
+		if (GL_ERROR_POLICY == GlErrorPolicy::SYNCHRONOUS_CHECKS) {
+			glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+		} else {
+			glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+		}
+		glDebugMessageCallback(gl_debug_callback, nullptr);
+		GL_DEBUG_CALLBACK_INSTALLED = true;
+	}
+
+	// Errors left by the previous policy are discarded, so they are not thrown by the first check of the new one
+	void set_gl_error_policy(GlErrorPolicy policy) {
+		GL_ERROR_POLICY = policy;
+		if (GLEW_IS_OK) {
+			init_gl_debug_output();
+			while (glGetError() != GL_NO_ERROR) {
+			}
+		}
+		take_gl_debug_message();
+	}
+
+	// Object names in debug messages and in GPU debuggers, set only if errors are checked
+	void set_gl_object_label(GLenum identifier, GLuint name, const std::string& label) {
+		if (GL_ERROR_POLICY != GlErrorPolicy::NO_CHECKS && GLEW_KHR_debug && name != 0) {
+			glObjectLabel(identifier, name, static_cast<GLsizei>(label.size()), label.c_str());
+		}
+	}
+
+	// Named groups of GL commands shown by GPU debuggers
+	void push_gl_debug_group(const std::string& name) {
+		if (GL_ERROR_POLICY != GlErrorPolicy::NO_CHECKS && GLEW_KHR_debug) {
+			glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, static_cast<GLsizei>(name.size()), name.c_str());
+		}
+	}
+
+	void pop_gl_debug_group() {
+		if (GL_ERROR_POLICY != GlErrorPolicy::NO_CHECKS && GLEW_KHR_debug) {
+			glPopDebugGroup();
+		}
+	}
+
 	void check_gl_errors(const char* filename, uint32_t line, const char* func_name) {
+		if (GL_ERROR_POLICY == GlErrorPolicy::NO_CHECKS) {
+			return;
+		}
+
+		if (GL_ERROR_POLICY == GlErrorPolicy::DEBUG_CALLBACK && GL_DEBUG_CALLBACK_INSTALLED) {
+			if (!GL_DEBUG_ERROR.load(std::memory_order_acquire)) {
+				return;
+			}
+
+			throw GreRuntimeError(filename, line, std::string(func_name) + ", GL debug error \"" + take_gl_debug_message() + "\".\n\n");
+		}
+
 		GLenum error_code = glGetError();
 		if (error_code == GL_NO_ERROR) {
 			return;
@@ -33,6 +163,10 @@ namespace gre {
 			default:                               error = "UNKNOWN"; break;
 		}
 
+		// Synchronous debug output has already described this error
+		if (GL_DEBUG_ERROR.load(std::memory_order_acquire)) {
+			error += "\", debug message \"" + take_gl_debug_message();
+		}
 		throw GreRuntimeError(filename, line, std::string(func_name) + ", GL error with name \"" + error + "\".\n\n");
 	}
 
@@ -41,4 +175,105 @@ namespace gre {
 			throw GreInvalidArgument(filename, line, std::string(func_name) + ", invalid color value.\n\n");
 		}
 	}
+
+	// GL_INT_2_10_10_10_REV encoding, the direction is normalized before packing
+	GLuint pack_normal(const Vec3& normal) {
+		Vec3 direction = equality(normal.length(), 0.0) ? Vec3(0.0) : normal.normalize();
+
+		GLuint result = 0;
+		for (size_t i = 0; i < 3; ++i) {
+			int32_t value = static_cast<int32_t>(round(std::clamp(direction[i], -1.0, 1.0) * 511.0));
+			result |= (static_cast<GLuint>(value) & 0x3FF) << (10 * i);
+		}
+		return result;
+	}
+
+	Vec3 unpack_normal(GLuint packed) {
+		Vec3 result;
+		for (size_t i = 0; i < 3; ++i) {
+			int32_t value = static_cast<int32_t>((packed >> (10 * i)) & 0x3FF);
+			if (value & 0x200) {
+				value -= 0x400;
+			}
+			result[i] = std::max(static_cast<double>(value) / 511.0, -1.0);
+		}
+		return result;
+	}
+
+	// IEEE 754 binary16 with round to nearest
+	GLhalf float_to_half(float value) noexcept {
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		GLhalf sign = static_cast<GLhalf>((bits >> 16) & 0x8000);
+		int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+		uint32_t mantissa = bits & 0x7FFFFF;
+
+		if (((bits >> 23) & 0xFF) == 0xFF) {
+			return sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0);
+		}
+		if (exponent >= 31) {
+			return sign | 0x7C00;
+		}
+		if (exponent <= 0) {
+			if (exponent < -10) {
+				return sign;
+			}
+
+			mantissa |= 0x800000;
+			uint32_t shift = static_cast<uint32_t>(14 - exponent);
+			uint32_t result = mantissa >> shift;
+			if ((mantissa >> (shift - 1)) & 1) {
+				++result;
+			}
+			return sign | static_cast<GLhalf>(result);
+		}
+
+		uint32_t result = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+		if (mantissa & 0x1000) {
+			++result;
+		}
+		return sign | static_cast<GLhalf>(result);
+	}
+
+	float half_to_float(GLhalf value) noexcept {
+		uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+		uint32_t exponent = (value >> 10) & 0x1F;
+		uint32_t mantissa = value & 0x3FF;
+
+		uint32_t bits = sign;
+		if (exponent == 31) {
+			bits |= 0x7F800000 | (mantissa << 13);
+		} else if (exponent != 0) {
+			bits |= ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		} else if (mantissa != 0) {
+			exponent = 127 - 15 + 1;
+			while ((mantissa & 0x400) == 0) {
+				mantissa <<= 1;
+				--exponent;
+			}
+			bits |= (exponent << 23) | ((mantissa & 0x3FF) << 13);
+		}
+
+		float result;
+		std::memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
+	// false if the box transformed to clip space is outside of one of the frustum planes
+	bool intersects_frustum(const Matrix& transform, const Vec3& bounding_min, const Vec3& bounding_max) {
+		size_t outside[6] = { 0, 0, 0, 0, 0, 0 };
+		for (size_t mask = 0; mask < 8; ++mask) {
+			Vec3 corner((mask & 1) ? bounding_max.x : bounding_min.x, (mask & 2) ? bounding_max.y : bounding_min.y, (mask & 4) ? bounding_max.z : bounding_min.z);
+			double clip[4];
+			for (size_t i = 0; i < 4; ++i) {
+				clip[i] = transform[i][0] * corner.x + transform[i][1] * corner.y + transform[i][2] * corner.z + transform[i][3];
+			}
+			for (size_t i = 0; i < 3; ++i) {
+				outside[2 * i] += clip[i] < -clip[3];
+				outside[2 * i + 1] += clip[i] > clip[3];
+			}
+		}
+		return std::find(std::begin(outside), std::end(outside), 8) == std::end(outside);
+	}
 }
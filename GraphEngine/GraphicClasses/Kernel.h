@@ -60,6 +60,46 @@ namespace gre {
 			shader.set_uniform_fv<1>("kernel", 9, &std::vector<GLfloat>(kernel_)[0]);
 		}
 
+		// Single tap in the center does not change the image
+		bool is_identity() const noexcept {
+			return *this == Kernel();
+		}
+
+		// Weights of taps along x from left to right and along y from top to bottom, returns false if the kernel is not their outer product
+		bool get_separable(std::vector<GLfloat>& horizontal, std::vector<GLfloat>& vertical) const {
+			size_t pivot_x = 0, pivot_y = 0;
+			for (size_t i = 0; i < 3; ++i) {
+				for (size_t j = 0; j < 3; ++j) {
+					if (std::abs(kernel_[i][j]) > std::abs(kernel_[pivot_x][pivot_y])) {
+						pivot_x = i;
+						pivot_y = j;
+					}
+				}
+			}
+
+			double pivot = kernel_[pivot_x][pivot_y];
+			if (equality(pivot, 0.0)) {
+				return false;
+			}
+
+			// Rows of the matrix are taps along x, columns are taps along y
+			for (size_t i = 0; i < 3; ++i) {
+				for (size_t j = 0; j < 3; ++j) {
+					if (!equality(kernel_[i][j], kernel_[i][pivot_y] * kernel_[pivot_x][j] / pivot)) {
+						return false;
+					}
+				}
+			}
+
+			horizontal.resize(3);
+			vertical.resize(3);
+			for (size_t i = 0; i < 3; ++i) {
+				horizontal[i] = static_cast<GLfloat>(kernel_[i][pivot_y]);
+				vertical[i] = static_cast<GLfloat>(kernel_[pivot_x][i] / pivot);
+			}
+			return true;
+		}
+
 		Kernel& set_offset(GLuint offset) noexcept {
 			offset_ = offset;
 			return *this;
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <array>
+#include <queue>
+#include "GraphicFunctions.h"
+
+
+namespace gre {
+	// Quadric error metric simplification by half edge collapses, vertices are never moved so simplified indices reuse the original vertices
+	class MeshSimplifier {
+		// Symmetric 4x4 matrix of the sum of squared distances to planes
+		class Quadric {
+			double a_[10] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+		public:
+			Quadric() noexcept {
+			}
+
+			Quadric(const Vec3& normal, double distance, double weight) noexcept {
+				a_[0] = weight * normal.x * normal.x;
+				a_[1] = weight * normal.x * normal.y;
+				a_[2] = weight * normal.x * normal.z;
+				a_[3] = weight * normal.x * distance;
+				a_[4] = weight * normal.y * normal.y;
+				a_[5] = weight * normal.y * normal.z;
+				a_[6] = weight * normal.y * distance;
+				a_[7] = weight * normal.z * normal.z;
+				a_[8] = weight * normal.z * distance;
+				a_[9] = weight * distance * distance;
+			}
+
+			Quadric& operator+=(const Quadric& other) noexcept {
+				for (size_t i = 0; i < 10; ++i) {
+					a_[i] += other.a_[i];
+				}
+				return *this;
+			}
+
+			Quadric operator+(const Quadric& other) const noexcept {
+				Quadric result = *this;
+				return result += other;
+			}
+
+			double evaluate(const Vec3& point) const noexcept {
+				double x = point.x, y = point.y, z = point.z;
+				return a_[0] * x * x + 2.0 * a_[1] * x * y + 2.0 * a_[2] * x * z + 2.0 * a_[3] * x
+					+ a_[4] * y * y + 2.0 * a_[5] * y * z + 2.0 * a_[6] * y
+					+ a_[7] * z * z + 2.0 * a_[8] * z
+					+ a_[9];
+			}
+		};
+
+		struct Collapse {
+			double cost = 0.0;
+			GLuint from = 0;
+			GLuint to = 0;
+			size_t version_from = 0;
+			size_t version_to = 0;
+
+			bool operator>(const Collapse& other) const noexcept {
+				return cost > other.cost;
+			}
+		};
+
+		// Border edges are kept by planes perpendicular to their triangles with this weight
+		inline static const double BORDER_WEIGHT = 1000.0;
+		// Collapses rotating triangle normals further are rejected
+		inline static const double MIN_NORMAL_COSINE = 0.2;
+
+		std::vector<Vec3> positions_;
+		std::vector<std::array<GLuint, 3>> triangles_;
+		std::vector<bool> removed_;
+		std::vector<std::vector<size_t>> vertex_triangles_;
+		std::vector<Quadric> quadrics_;
+		std::vector<size_t> versions_;
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses_;
+		size_t count_triangles_ = 0;
+
+		MeshSimplifier(const std::vector<Vec3>& positions, const std::vector<GLuint>& indices) : positions_(positions), vertex_triangles_(positions.size()), quadrics_(positions.size()), versions_(positions.size(), 0) {
+			for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+				std::array<GLuint, 3> triangle = { indices[i], indices[i + 1], indices[i + 2] };
+				if (triangle[0] >= positions.size() || triangle[1] >= positions.size() || triangle[2] >= positions.size()) {
+					throw GreOutOfRange(__FILE__, __LINE__, "MeshSimplifier, invalid index.\n\n");
+				}
+				if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2]) {
+					continue;
+				}
+
+				for (GLuint vertex : triangle) {
+					vertex_triangles_[vertex].push_back(triangles_.size());
+				}
+				triangles_.push_back(triangle);
+			}
+			removed_.assign(triangles_.size(), false);
+			count_triangles_ = triangles_.size();
+
+			std::map<std::pair<GLuint, GLuint>, size_t> edge_triangles;
+			for (const auto& triangle : triangles_) {
+				Vec3 normal = get_normal(triangle);
+				double area = normal.length();
+				if (equality(area, 0.0)) {
+					continue;
+				}
+
+				normal /= area;
+				Quadric quadric(normal, -(normal * positions_[triangle[0]]), area);
+				for (size_t i = 0; i < 3; ++i) {
+					quadrics_[triangle[i]] += quadric;
+					++edge_triangles[std::minmax(triangle[i], triangle[(i + 1) % 3])];
+				}
+			}
+
+			for (const auto& triangle : triangles_) {
+				Vec3 normal = get_normal(triangle);
+				for (size_t i = 0; i < 3; ++i) {
+					GLuint from = triangle[i], to = triangle[(i + 1) % 3];
+					if (edge_triangles[std::minmax(from, to)] != 1) {
+						continue;
+					}
+
+					Vec3 edge = positions_[to] - positions_[from];
+					Vec3 border_normal = edge ^ normal;
+					if (equality(border_normal.length(), 0.0)) {
+						continue;
+					}
+
+					border_normal = border_normal.normalize();
+					Quadric quadric(border_normal, -(border_normal * positions_[from]), BORDER_WEIGHT * (edge * edge));
+					quadrics_[from] += quadric;
+					quadrics_[to] += quadric;
+				}
+			}
+
+			for (GLuint vertex = 0; vertex < positions_.size(); ++vertex) {
+				push_collapses(vertex);
+			}
+		}
+
+		Vec3 get_normal(const std::array<GLuint, 3>& triangle) const noexcept {
+			return (positions_[triangle[1]] - positions_[triangle[0]]) ^ (positions_[triangle[2]] - positions_[triangle[0]]);
+		}
+
+		std::vector<GLuint> get_neighbours(GLuint vertex) const {
+			std::vector<GLuint> neighbours;
+			for (size_t triangle_id : vertex_triangles_[vertex]) {
+				if (removed_[triangle_id]) {
+					continue;
+				}
+
+				for (GLuint neighbour : triangles_[triangle_id]) {
+					if (neighbour != vertex) {
+						neighbours.push_back(neighbour);
+					}
+				}
+			}
+
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+			return neighbours;
+		}
+
+		void push_collapses(GLuint vertex) {
+			for (GLuint neighbour : get_neighbours(vertex)) {
+				Quadric quadric = quadrics_[vertex] + quadrics_[neighbour];
+				collapses_.push({ quadric.evaluate(positions_[neighbour]), vertex, neighbour, versions_[vertex], versions_[neighbour] });
+				collapses_.push({ quadric.evaluate(positions_[vertex]), neighbour, vertex, versions_[neighbour], versions_[vertex] });
+			}
+		}
+
+		// Rejects collapses creating non manifold edges, flipped or degenerate triangles
+		bool is_valid(GLuint from, GLuint to) const {
+			size_t count_shared = 0;
+			for (size_t triangle_id : vertex_triangles_[from]) {
+				if (removed_[triangle_id]) {
+					continue;
+				}
+
+				std::array<GLuint, 3> triangle = triangles_[triangle_id];
+				if (std::find(triangle.begin(), triangle.end(), to) != triangle.end()) {
+					++count_shared;
+					continue;
+				}
+
+				Vec3 old_normal = get_normal(triangle);
+				if (equality(old_normal.length(), 0.0)) {
+					continue;
+				}
+
+				std::replace(triangle.begin(), triangle.end(), from, to);
+				Vec3 new_normal = get_normal(triangle);
+				if (equality(new_normal.length(), 0.0) || old_normal.normalize() * new_normal.normalize() < MIN_NORMAL_COSINE) {
+					return false;
+				}
+			}
+
+			std::vector<GLuint> from_neighbours = get_neighbours(from);
+			std::vector<GLuint> to_neighbours = get_neighbours(to);
+			std::vector<GLuint> common;
+			std::set_intersection(from_neighbours.begin(), from_neighbours.end(), to_neighbours.begin(), to_neighbours.end(), std::back_inserter(common));
+			return common.size() == count_shared;
+		}
+
+		void collapse(GLuint from, GLuint to) {
+			for (size_t triangle_id : vertex_triangles_[from]) {
+				if (removed_[triangle_id]) {
+					continue;
+				}
+
+				std::array<GLuint, 3>& triangle = triangles_[triangle_id];
+				if (std::find(triangle.begin(), triangle.end(), to) != triangle.end()) {
+					removed_[triangle_id] = true;
+					--count_triangles_;
+					continue;
+				}
+
+				std::replace(triangle.begin(), triangle.end(), from, to);
+				vertex_triangles_[to].push_back(triangle_id);
+			}
+			vertex_triangles_[from].clear();
+
+			quadrics_[to] += quadrics_[from];
+			++versions_[from];
+			++versions_[to];
+			push_collapses(to);
+		}
+
+		void simplify(size_t target_count_triangles) {
+			while (count_triangles_ > target_count_triangles && !collapses_.empty()) {
+				Collapse collapse_info = collapses_.top();
+				collapses_.pop();
+
+				if (versions_[collapse_info.from] != collapse_info.version_from || versions_[collapse_info.to] != collapse_info.version_to) {
+					continue;
+				}
+				if (!is_valid(collapse_info.from, collapse_info.to)) {
+					continue;
+				}
+
+				collapse(collapse_info.from, collapse_info.to);
+			}
+		}
+
+		std::vector<GLuint> get_indices() const {
+			std::vector<GLuint> indices;
+			for (size_t i = 0; i < triangles_.size(); ++i) {
+				if (!removed_[i]) {
+					indices.insert(indices.end(), triangles_[i].begin(), triangles_[i].end());
+				}
+			}
+			return indices;
+		}
+
+	public:
+		// Collapses edges until target_count_triangles triangles are left or no valid collapse remains
+		static std::vector<GLuint> simplify(const std::vector<Vec3>& positions, const std::vector<GLuint>& indices, size_t target_count_triangles) {
+			MeshSimplifier simplifier(positions, indices);
+			simplifier.simplify(target_count_triangles);
+			return simplifier.get_indices();
+		}
+	};
+}
@@ -10,12 +10,45 @@ namespace gre {
 	class Shader {
 		inline static const char* VERTEX_SHADER_EXTENSION = ".vert";
 		inline static const char* FRAGMENT_SHADER_EXTENSION = ".frag";
+		inline static const char* COMPUTE_SHADER_EXTENSION = ".comp";
+		inline static const size_t MAX_INCLUDE_DEPTH = 8;
 
 		size_t* count_links_ = nullptr;
 		std::string* vertex_shader_code_ = nullptr;
 		std::string* fragment_shader_code_ = nullptr;
+		std::string* compute_shader_code_ = nullptr;
 		GLuint program_id_ = 0;
 
+		static std::string get_directory(const std::string& path) {
+			size_t position = path.find_last_of("/\\");
+			return position == std::string::npos ? "" : path.substr(0, position + 1);
+		}
+
+		// Lines #include "path" are replaced by the code of the file, path is relative to the including file
+		static void load_code(std::ifstream& file, const std::string& directory, std::string& code, size_t depth = 0) {
+			for (std::string line; std::getline(file, line);) {
+				std::vector<std::string> split_line = split(line, [](const char c) { return c == ' ' || c == '\t' || c == '\r'; });
+				if (split_line.empty() || split_line[0] != "#include") {
+					code += line + "\n";
+					continue;
+				}
+
+				if (split_line.size() < 2 || split_line[1].size() < 2 || split_line[1].front() != '"' || split_line[1].back() != '"') {
+					throw GreRuntimeError(__FILE__, __LINE__, "load_code, invalid include directive \"" + line + "\".\n\n");
+				}
+				if (depth == MAX_INCLUDE_DEPTH) {
+					throw GreRuntimeError(__FILE__, __LINE__, "load_code, too deep include of \"" + line + "\".\n\n");
+				}
+
+				std::string path = directory + split_line[1].substr(1, split_line[1].size() - 2);
+				std::ifstream include_file(path);
+				if (include_file.fail()) {
+					throw GreRuntimeError(__FILE__, __LINE__, "load_code, the included file \"" + path + "\" does not exist.\n\n");
+				}
+				load_code(include_file, get_directory(path), code, depth + 1);
+			}
+		}
+
 		void load_vertex_shader(const std::string& vertex_shader_path) {
 			std::ifstream vertex_shader_file(vertex_shader_path + VERTEX_SHADER_EXTENSION);
 			if (vertex_shader_file.fail()) {
@@ -23,9 +56,7 @@ namespace gre {
 			}
 
 			vertex_shader_code_ = new std::string();
-			for (std::string line; std::getline(vertex_shader_file, line);) {
-				*vertex_shader_code_ += line + "\n";
-			}
+			load_code(vertex_shader_file, get_directory(vertex_shader_path), *vertex_shader_code_);
 		}
 
 		void load_fragment_shader(const std::string& fragment_shader_path) {
@@ -35,9 +66,17 @@ namespace gre {
 			}
 
 			fragment_shader_code_ = new std::string();
-			for (std::string line; std::getline(fragment_shader_file, line);) {
-				*fragment_shader_code_ += line + "\n";
+			load_code(fragment_shader_file, get_directory(fragment_shader_path), *fragment_shader_code_);
+		}
+
+		void load_compute_shader(const std::string& compute_shader_path) {
+			std::ifstream compute_shader_file(compute_shader_path + COMPUTE_SHADER_EXTENSION);
+			if (compute_shader_file.fail()) {
+				throw GreRuntimeError(__FILE__, __LINE__, "load_compute_shader, the compute shader file does not exist.\n\n");
 			}
+
+			compute_shader_code_ = new std::string();
+			load_code(compute_shader_file, get_directory(compute_shader_path), *compute_shader_code_);
 		}
 
 		void deallocate() {
@@ -47,11 +86,13 @@ namespace gre {
 					delete count_links_;
 					delete vertex_shader_code_;
 					delete fragment_shader_code_;
+					delete compute_shader_code_;
 				}
 			}
 			count_links_ = nullptr;
 			vertex_shader_code_ = nullptr;
 			fragment_shader_code_ = nullptr;
+			compute_shader_code_ = nullptr;
 
 			glDeleteProgram(program_id_);
 			check_gl_errors(__FILE__, __LINE__, __func__);
@@ -91,6 +132,40 @@ namespace gre {
 			return fragment_shader;
 		}
 
+		static GLuint create_compute_shader(const std::string& code) {
+			const char* compute_shader_code_c = code.c_str();
+			GLuint compute_shader = glCreateShader(GL_COMPUTE_SHADER);
+			glShaderSource(compute_shader, 1, &compute_shader_code_c, NULL);
+			glCompileShader(compute_shader);
+
+			GLint success;
+			glGetShaderiv(compute_shader, GL_COMPILE_STATUS, &success);
+			if (success == GL_FALSE) {
+				throw GreRuntimeError(__FILE__, __LINE__, "create_compute_shader, compilation failed, description \\/\n" + load_shader_info_log(compute_shader) + "\n\n");
+			}
+
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return compute_shader;
+		}
+
+		static GLuint link_compute_shader(const std::string& compute_shader_code) {
+			GLuint compute_shader = create_compute_shader(compute_shader_code);
+
+			GLuint program = glCreateProgram();
+			glAttachShader(program, compute_shader);
+			glLinkProgram(program);
+
+			GLint success;
+			glGetProgramiv(program, GL_LINK_STATUS, &success);
+			if (success == GL_FALSE) {
+				throw GreRuntimeError(__FILE__, __LINE__, "link_compute_shader, linking failed, description \\/\n" + load_program_info_log(program) + "\n\n");
+			}
+
+			glDeleteShader(compute_shader);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return program;
+		}
+
 		static GLuint link_shaders(const std::string& vertex_shader_code, const std::string& fragment_shader_code) {
 			GLuint vertex_shader = create_vertex_shader(vertex_shader_code);
 			GLuint fragment_shader = create_fragment_shader(fragment_shader_code);
@@ -190,6 +265,7 @@ namespace gre {
 			description = desc_value;
 			if (vertex_shader_code_ != nullptr && fragment_shader_code_ != nullptr) {
 				program_id_ = link_shaders(*vertex_shader_code_, *fragment_shader_code_);
+				set_gl_object_label(GL_PROGRAM, program_id_, vertex_shader_path + ", " + fragment_shader_path);
 			}
 		}
 
@@ -197,12 +273,17 @@ namespace gre {
 			description = other.description;
 			vertex_shader_code_ = other.vertex_shader_code_;
 			fragment_shader_code_ = other.fragment_shader_code_;
+			compute_shader_code_ = other.compute_shader_code_;
 			count_links_ = other.count_links_;
 			if (count_links_ != nullptr) {
 				++(*count_links_);
 			}
 
-			program_id_ = link_shaders(*vertex_shader_code_, *fragment_shader_code_);
+			if (compute_shader_code_ != nullptr) {
+				program_id_ = link_compute_shader(*compute_shader_code_);
+			} else {
+				program_id_ = link_shaders(*vertex_shader_code_, *fragment_shader_code_);
+			}
 		}
 
 		Shader(Shader<T>&& other) noexcept {
@@ -483,6 +564,10 @@ namespace gre {
 			return find_value(*fragment_shader_code_, variable_name);
 		}
 
+		std::string get_value_comp(const std::string& variable_name) const {
+			return find_value(*compute_shader_code_, variable_name);
+		}
+
 		GLint get_uniform_location(const GLchar* uniform_name) const noexcept {
 			return glGetUniformLocation(program_id_, uniform_name);
 		}
@@ -497,17 +582,30 @@ namespace gre {
 			std::swap(program_id_, other.program_id_);
 			std::swap(vertex_shader_code_, other.vertex_shader_code_);
 			std::swap(fragment_shader_code_, other.fragment_shader_code_);
+			std::swap(compute_shader_code_, other.compute_shader_code_);
 		}
 
 		bool check_window_settings(const sf::ContextSettings& settings) const noexcept {
-			uint64_t vert_version = find_version(*vertex_shader_code_);
-			uint64_t frag_version = find_version(*fragment_shader_code_);
+			uint64_t vert_version = find_version(compute_shader_code_ != nullptr ? *compute_shader_code_ : *vertex_shader_code_);
+			uint64_t frag_version = find_version(fragment_shader_code_ != nullptr ? *fragment_shader_code_ : *compute_shader_code_);
 			if (vert_version / 100 > settings.majorVersion || (vert_version / 100 == settings.majorVersion && (vert_version % 100) / 10 > settings.minorVersion)) {
 				return false;
 			}
 			return vert_version / 100 < settings.majorVersion || (vert_version / 100 == settings.majorVersion && (vert_version % 100) / 10 <= settings.minorVersion);
 		}
 
+		void dispatch(GLuint count_groups_x, GLuint count_groups_y = 1, GLuint count_groups_z = 1) const {
+			if (compute_shader_code_ == nullptr) {
+				throw GreInvalidArgument(__FILE__, __LINE__, "dispatch, the program is not a compute shader.\n\n");
+			}
+
+			if (get_current_program() != program_id_) {
+				use();
+			}
+			glDispatchCompute(count_groups_x, count_groups_y, count_groups_z);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
 		void use() const {
 			glUseProgram(program_id_);
 			check_gl_errors(__FILE__, __LINE__, __func__);
@@ -536,5 +634,16 @@ namespace gre {
 			glGetIntegerv(GL_CURRENT_PROGRAM, &result);
 			return result;
 		}
+
+		static Shader<T> compute(const std::string& compute_shader_path, T desc_value = T()) {
+			Shader<T> shader;
+			shader.load_compute_shader(compute_shader_path);
+
+			shader.count_links_ = new size_t(1);
+			shader.description = desc_value;
+			shader.program_id_ = link_compute_shader(*shader.compute_shader_code_);
+			set_gl_object_label(GL_PROGRAM, shader.program_id_, compute_shader_path);
+			return shader;
+		}
 	};
 }
@@ -9,6 +9,7 @@ namespace gre {
 
 		size_t width_ = 0;
 		size_t height_ = 0;
+		bool opaque_ = true;
 		size_t* count_links_ = nullptr;
 		GLuint texture_id_ = 0;
 
@@ -29,6 +30,7 @@ namespace gre {
 		void swap(Texture& other) noexcept {
 			std::swap(width_, other.width_);
 			std::swap(height_, other.height_);
+			std::swap(opaque_, other.opaque_);
 			std::swap(count_links_, other.count_links_);
 			std::swap(texture_id_, other.texture_id_);
 		}
@@ -57,6 +59,11 @@ namespace gre {
 			height_ = image.getSize().y;
 			count_links_ = new size_t(1);
 
+			const sf::Uint8* pixels = image.getPixelsPtr();
+			for (size_t i = 0; i < width_ * height_ && opaque_; ++i) {
+				opaque_ = pixels[4 * i + 3] == 255;
+			}
+
 			glGenTextures(1, &texture_id_);
 			glBindTexture(GL_TEXTURE_2D, texture_id_);
 
@@ -78,6 +85,7 @@ namespace gre {
 		Texture(const Texture& other) noexcept {
 			width_ = other.width_;
 			height_ = other.height_;
+			opaque_ = other.opaque_;
 			texture_id_ = other.texture_id_;
 			count_links_ = other.count_links_;
 			if (count_links_ != nullptr) {
@@ -134,6 +142,11 @@ namespace gre {
 			return height_;
 		}
 
+		// true if all texels have full alpha
+		bool is_opaque() const noexcept {
+			return opaque_;
+		}
+
 		template <typename T>
 		T get_value(T value, std::function<void(sf::Color, T*)> func) const {
 			uint8_t* buffer = new uint8_t[4 * width_ * height_];
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "TimestampQueries.h"
+
+
+namespace gre {
+	// GPU time of a render pass by pairs of timestamps, the time of the last frame finished by the GPU is kept
+	class TimerQuery {
+		TimestampQueries queries_;
+		bool running_ = false;
+		double elapsed_time_ = 0.0;
+
+	public:
+		TimerQuery() noexcept {
+		}
+
+		TimerQuery(const TimerQuery& other) noexcept : queries_(other.queries_) {
+		}
+
+		TimerQuery(TimerQuery&& other) noexcept {
+			swap(other);
+		}
+
+		TimerQuery& operator=(const TimerQuery& other)& {
+			TimerQuery timer(other);
+			swap(timer);
+			return *this;
+		}
+
+		TimerQuery& operator=(TimerQuery&& other)& noexcept {
+			swap(other);
+			return *this;
+		}
+
+		// Time of all intervals of one frame in milliseconds
+		double get_elapsed_time() const noexcept {
+			return elapsed_time_;
+		}
+
+		// Frames which were not finished by the GPU in time, the elapsed time is not updated for them
+		size_t get_count_dropped_frames() const noexcept {
+			return queries_.get_count_dropped_frames();
+		}
+
+		// Reads intervals measured TimestampQueries::COUNT_FRAMES frames ago if they are ready
+		void begin_frame() {
+			if (running_) {
+				throw GreRuntimeError(__FILE__, __LINE__, "begin_frame, timer is running.\n\n");
+			}
+			if (!queries_.begin_frame()) {
+				return;
+			}
+
+			const std::vector<GLuint64>& timestamps = queries_.get_timestamps();
+			GLuint64 elapsed_time = 0;
+			for (size_t i = 0; i + 1 < timestamps.size(); i += 2) {
+				elapsed_time += timestamps[i + 1] - timestamps[i];
+			}
+			elapsed_time_ = static_cast<double>(elapsed_time) / 1000000.0;
+		}
+
+		void begin() {
+			if (running_) {
+				throw GreRuntimeError(__FILE__, __LINE__, "begin, timer is already running.\n\n");
+			}
+
+			queries_.query_counter();
+			running_ = true;
+		}
+
+		void end() {
+			if (!running_) {
+				throw GreRuntimeError(__FILE__, __LINE__, "end, timer is not running.\n\n");
+			}
+
+			queries_.query_counter();
+			running_ = false;
+		}
+
+		void swap(TimerQuery& other) noexcept {
+			queries_.swap(other.queries_);
+			std::swap(running_, other.running_);
+			std::swap(elapsed_time_, other.elapsed_time_);
+		}
+	};
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "GraphicFunctions.h"
+
+
+namespace gre {
+	// Ring of GL_TIMESTAMP queries, timestamps of a frame are read COUNT_FRAMES frames later only if the GPU has finished them
+	class TimestampQueries {
+	public:
+		inline static const size_t COUNT_FRAMES = 3;
+
+	private:
+		struct Frame {
+			std::vector<GLuint> query_ids;
+			size_t count_used = 0;
+		};
+
+		size_t frame_ = 0;
+		size_t count_dropped_frames_ = 0;
+		std::vector<Frame> frames_ = std::vector<Frame>(COUNT_FRAMES);
+		std::vector<GLuint64> timestamps_;
+
+		void deallocate() {
+			for (Frame& frame : frames_) {
+				if (!frame.query_ids.empty()) {
+					glDeleteQueries(static_cast<GLsizei>(frame.query_ids.size()), &frame.query_ids[0]);
+				}
+				frame.query_ids.clear();
+				frame.count_used = 0;
+			}
+			check_gl_errors(__FILE__, __LINE__, __func__);
+		}
+
+	public:
+		TimestampQueries() noexcept {
+		}
+
+		// Queries are not copied, time is measured again
+		TimestampQueries(const TimestampQueries& other) noexcept {
+		}
+
+		TimestampQueries(TimestampQueries&& other) noexcept {
+			swap(other);
+		}
+
+		TimestampQueries& operator=(const TimestampQueries& other)& {
+			TimestampQueries queries(other);
+			swap(queries);
+			return *this;
+		}
+
+		TimestampQueries& operator=(TimestampQueries&& other)& {
+			deallocate();
+			swap(other);
+			return *this;
+		}
+
+		// Index of the current frame in the ring
+		size_t get_frame() const noexcept {
+			return frame_;
+		}
+
+		// Frames which timestamps were not ready COUNT_FRAMES frames later, they are never read
+		size_t get_count_dropped_frames() const noexcept {
+			return count_dropped_frames_;
+		}
+
+		// Timestamps in nanoseconds read by the last successful begin_frame, in order of their queries
+		const std::vector<GLuint64>& get_timestamps() const noexcept {
+			return timestamps_;
+		}
+
+		// Moves to the frame measured COUNT_FRAMES frames ago and reuses its queries
+		// Returns true if its timestamps were ready and are read, the GPU is never waited for
+		bool begin_frame() {
+			frame_ = (frame_ + 1) % COUNT_FRAMES;
+			Frame& frame = frames_[frame_];
+			size_t count_used = frame.count_used;
+			frame.count_used = 0;
+			if (count_used == 0) {
+				return false;
+			}
+
+			// Timestamps become available in order of their queries
+			GLint available = 0;
+			glGetQueryObjectiv(frame.query_ids[count_used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				check_gl_errors(__FILE__, __LINE__, __func__);
+				++count_dropped_frames_;
+				return false;
+			}
+
+			timestamps_.resize(count_used);
+			for (size_t i = 0; i < count_used; ++i) {
+				glGetQueryObjectui64v(frame.query_ids[i], GL_QUERY_RESULT, &timestamps_[i]);
+			}
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return true;
+		}
+
+		// Records the time when the GPU finishes all previous commands, returns the index of the timestamp in the current frame
+		size_t query_counter() {
+			Frame& frame = frames_[frame_];
+			if (frame.count_used == frame.query_ids.size()) {
+				frame.query_ids.push_back(0);
+				glGenQueries(1, &frame.query_ids.back());
+			}
+
+			glQueryCounter(frame.query_ids[frame.count_used], GL_TIMESTAMP);
+			check_gl_errors(__FILE__, __LINE__, __func__);
+			return frame.count_used++;
+		}
+
+		void swap(TimestampQueries& other) noexcept {
+			std::swap(frame_, other.frame_);
+			std::swap(count_dropped_frames_, other.count_dropped_frames_);
+			std::swap(frames_, other.frames_);
+			std::swap(timestamps_, other.timestamps_);
+		}
+
+		~TimestampQueries() {
+			deallocate();
+		}
+	};
+}
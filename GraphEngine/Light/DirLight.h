@@ -47,19 +47,12 @@ namespace gre {
             set_projection_matrix();
         }
 
-        void set_uniforms(size_t id, const Shader<size_t>& shader) const override {
-            if (shader.description != ShaderType::MAIN) {
-                throw GreInvalidArgument(__FILE__, __LINE__, "set_uniforms, invalid shader type.\n\n");
-            }
-
-            std::string name = "lights[" + std::to_string(id) + "].";
-            set_light_uniforms(name, shader);
-
-            shader.set_uniform_i((name + "type").c_str(), LIGHT_TYPE);
-            shader.set_uniform_f((name + "direction").c_str(), direction_);
-            if (shadow) {
-                shader.set_uniform_matrix((name + "light_space").c_str(), get_light_space_matrix());
-            }
+        LightData get_data() const override {
+            LightData data = get_light_data();
+            data.type = LIGHT_TYPE;
+            LightData::copy(direction_, data.direction);
+            LightData::copy(get_light_space_matrix(), data.light_space);
+            return data;
         }
 
         DirLight& set_shadow_width(double shadow_width) {
@@ -106,6 +99,40 @@ namespace gre {
             return projection_ * get_view_matrix();
         }
 
+        // Box around the bounding sphere of corners snapped to texels, so the cascade does not shimmer when the camera moves or rotates
+        // Casters up to shadow_depth before the sphere are kept
+        bool get_cascade_matrix(const std::vector<Vec3>& corners, const Vec2& resolution, Matrix& light_space) const override {
+            if (corners.empty()) {
+                throw GreInvalidArgument(__FILE__, __LINE__, "get_cascade_matrix, empty corners list.\n\n");
+            }
+
+            Vec3 center(0.0);
+            for (const Vec3& corner : corners) {
+                center += corner;
+            }
+            center /= static_cast<double>(corners.size());
+
+            double radius = 0.0;
+            for (const Vec3& corner : corners) {
+                radius = std::max(radius, (corner - center).length());
+            }
+            radius = std::max(std::ceil(radius * 16.0) / 16.0, 1.0 / 16.0);
+
+            const Vec3& horizont = direction_.horizont();
+            Matrix rotation = Matrix(horizont, direction_ ^ horizont, direction_).transpose();
+            center = rotation * center;
+            for (size_t i = 0; i < 2; ++i) {
+                double texel_size = 2.0 * radius / resolution[i];
+                center[i] = std::floor(center[i] / texel_size) * texel_size;
+            }
+
+            double near = center.z - radius - shadow_depth_, far = center.z + radius;
+            light_space = Matrix::scale_matrix(Vec3(1.0 / radius, 1.0 / radius, 2.0 / (far - near)));
+            light_space *= Matrix::translation_matrix(-Vec3(center.x, center.y, (near + far) / 2.0));
+            light_space *= rotation;
+            return true;
+        }
+
         GraphObject get_shadow_box() const {
             GraphObject shadow_box = GraphObject::cube(1);
             shadow_box.transparent = true;
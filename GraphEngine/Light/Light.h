@@ -4,25 +4,95 @@
 
 
 namespace gre {
+    // Number of shadow map comparisons per fragment, every comparison is filtered bilinearly
+    enum ShadowKernel : GLint { SINGLE_TAP = 1, FOUR_TAPS = 4, POISSON_TAPS = 16 };
+
+    // Layout of the Light structure of the lights buffer in Shaders/Include/Lights.glsl (std430)
+    struct LightData {
+        inline static const size_t MAX_COUNT_CASCADES = 4;
+
+        GLfloat position[4] = { 0.0, 0.0, 0.0, 0.0 };
+        GLfloat direction[4] = { 0.0, 0.0, 0.0, 0.0 };
+        GLfloat ambient[4] = { 0.0, 0.0, 0.0, 0.0 };
+        GLfloat diffuse[4] = { 0.0, 0.0, 0.0, 0.0 };
+        GLfloat specular[4] = { 0.0, 0.0, 0.0, 0.0 };
+        // Constant, linear and quadratic coefficients
+        GLfloat attenuation[4] = { 1.0, 0.0, 0.0, 0.0 };
+        // Cosines of the internal and external angles
+        GLfloat cut[4] = { 0.0, 0.0, 0.0, 0.0 };
+        // Constant and slope scaled depth bias
+        GLfloat shadow_bias[4] = { 0.0, 0.0, 0.0, 0.0 };
+        GLint type = 0;
+        GLint shadow = 0;
+        GLint cascades = 0;
+        GLint shadow_kernel = FOUR_TAPS;
+        GLfloat light_space[16] = {};
+        GLfloat cascade_spaces[MAX_COUNT_CASCADES][16] = {};
+        GLfloat shadow_tiles[MAX_COUNT_CASCADES][4] = {};
+
+        static void copy(const Vec3& vector, GLfloat* destination) noexcept {
+            for (size_t i = 0; i < 3; ++i) {
+                destination[i] = static_cast<GLfloat>(vector[i]);
+            }
+        }
+
+        static void copy(const Matrix& matrix, GLfloat* destination) {
+            std::vector<GLfloat> values(matrix);
+            std::copy(values.begin(), values.end(), destination);
+        }
+    };
+
+
     class Light {
     protected:
+        // Lights are culled where the attenuated color falls below this value
+        inline static const double MIN_INTENSITY = 1.0 / 256.0;
+
         Vec3 ambient_ = Vec3(0.25);
         Vec3 diffuse_ = Vec3(0.5);
         Vec3 specular_ = Vec3(0.75);
 
-        void set_light_uniforms(const std::string& name, const Shader<size_t>& shader) const {
-            if (shader.description != ShaderType::MAIN) {
-                throw GreInvalidArgument(__FILE__, __LINE__, "set_light_uniforms, invalid shader type.\n\n");
+        ShadowKernel shadow_kernel_ = FOUR_TAPS;
+        // Depth bias is shadow_bias_ plus shadow_slope_bias_ times the tangent of the angle between the normal and the light
+        double shadow_bias_ = 0.005;
+        double shadow_slope_bias_ = 0.002;
+
+        LightData get_light_data() const {
+            LightData data;
+            LightData::copy(ambient_, data.ambient);
+            LightData::copy(diffuse_, data.diffuse);
+            LightData::copy(specular_, data.specular);
+            data.shadow = shadow;
+            data.shadow_kernel = shadow_kernel_;
+            data.shadow_bias[0] = static_cast<GLfloat>(shadow_bias_);
+            data.shadow_bias[1] = static_cast<GLfloat>(shadow_slope_bias_);
+            return data;
+        }
+
+        // Distance where attenuation of the brightest color component reaches MIN_INTENSITY, returns false if it is never reached
+        bool get_range(double constant, double linear, double quadratic, double& range) const noexcept {
+            double intensity = 0.0;
+            for (const Vec3& color : { ambient_, diffuse_, specular_ }) {
+                intensity = std::max({ intensity, color.x, color.y, color.z });
             }
 
-            shader.set_uniform_f((name + "ambient").c_str(), ambient_);
-            shader.set_uniform_f((name + "diffuse").c_str(), diffuse_);
-            shader.set_uniform_f((name + "specular").c_str(), specular_);
-            shader.set_uniform_i((name + "shadow").c_str(), shadow);
+            double limit = intensity / MIN_INTENSITY - constant;
+            if (limit <= 0.0) {
+                range = 0.0;
+            } else if (quadratic > 0.0) {
+                range = (std::sqrt(linear * linear + 4.0 * quadratic * limit) - linear) / (2.0 * quadratic);
+            } else if (linear > 0.0) {
+                range = limit / linear;
+            } else {
+                return false;
+            }
+            return true;
         }
 
     public:
         bool shadow = false;
+        // Relative share of the shadow atlas, scaled by the screen coverage of the light
+        double shadow_importance = 1.0;
 
         Light() {
             if (!glew_is_ok()) {
@@ -57,10 +127,49 @@ namespace gre {
             specular_ = specular;
         }
 
-        virtual void set_uniforms(size_t id, const Shader<size_t>& shader) const = 0;
+        void set_shadow_kernel(ShadowKernel shadow_kernel) {
+            if (shadow_kernel != SINGLE_TAP && shadow_kernel != FOUR_TAPS && shadow_kernel != POISSON_TAPS) {
+                throw GreInvalidArgument(__FILE__, __LINE__, "set_shadow_kernel, invalid shadow kernel.\n\n");
+            }
+
+            shadow_kernel_ = shadow_kernel;
+        }
+
+        void set_shadow_bias(double constant_bias, double slope_bias) {
+            if (constant_bias < 0.0 || slope_bias < 0.0) {
+                throw GreInvalidArgument(__FILE__, __LINE__, "set_shadow_bias, negative depth bias.\n\n");
+            }
+
+            shadow_bias_ = constant_bias;
+            shadow_slope_bias_ = slope_bias;
+        }
+
+        ShadowKernel get_shadow_kernel() const noexcept {
+            return shadow_kernel_;
+        }
+
+        double get_shadow_bias() const noexcept {
+            return shadow_bias_;
+        }
+
+        double get_shadow_slope_bias() const noexcept {
+            return shadow_slope_bias_;
+        }
+
+        virtual LightData get_data() const = 0;
+
+        // Sphere outside of which the light is negligible, returns false for lights affecting all space
+        virtual bool get_bounding_sphere(Vec3& center, double& radius) const {
+            return false;
+        }
 
         virtual Matrix get_light_space_matrix() const = 0;
 
+        // Light space matrix covering the frustum part given by corners, returns false if the light does not support cascades
+        virtual bool get_cascade_matrix(const std::vector<Vec3>& corners, const Vec2& resolution, Matrix& light_space) const {
+            return false;
+        }
+
         virtual ~Light() {
         }
     };
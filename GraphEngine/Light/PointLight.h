@@ -23,19 +23,19 @@ namespace gre {
             this->position = position;
         }
 
-        void set_uniforms(size_t id, const Shader<size_t>& shader) const override {
-            if (shader.description != ShaderType::MAIN) {
-                throw GreInvalidArgument(__FILE__, __LINE__, "set_uniforms, invalid shader type.\n\n");
-            }
-
-            std::string name = "lights[" + std::to_string(id) + "].";
-            set_light_uniforms(name, shader);
+        LightData get_data() const override {
+            LightData data = get_light_data();
+            data.type = LIGHT_TYPE;
+            data.attenuation[0] = static_cast<GLfloat>(constant_);
+            data.attenuation[1] = static_cast<GLfloat>(linear_);
+            data.attenuation[2] = static_cast<GLfloat>(quadratic_);
+            LightData::copy(position, data.position);
+            return data;
+        }
 
-            shader.set_uniform_i((name + "type").c_str(), LIGHT_TYPE);
-            shader.set_uniform_f((name + "constant").c_str(), static_cast<GLfloat>(constant_));
-            shader.set_uniform_f((name + "linear").c_str(), static_cast<GLfloat>(linear_));
-            shader.set_uniform_f((name + "quadratic").c_str(), static_cast<GLfloat>(quadratic_));
-            shader.set_uniform_f((name + "position").c_str(), position);
+        bool get_bounding_sphere(Vec3& center, double& radius) const override {
+            center = position;
+            return get_range(constant_, linear_, quadratic_, radius);
         }
 
         PointLight& set_constant(double coefficient) {
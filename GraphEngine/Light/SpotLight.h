@@ -60,25 +60,24 @@ namespace gre {
             set_projection_matrix();
         }
 
-        void set_uniforms(size_t id, const Shader<size_t>& shader) const override {
-            if (shader.description != ShaderType::MAIN) {
-                throw GreInvalidArgument(__FILE__, __LINE__, "set_uniforms, invalid shader type.\n\n");
-            }
+        LightData get_data() const override {
+            LightData data = get_light_data();
+            data.type = LIGHT_TYPE;
+            data.attenuation[0] = static_cast<GLfloat>(constant_);
+            data.attenuation[1] = static_cast<GLfloat>(linear_);
+            data.attenuation[2] = static_cast<GLfloat>(quadratic_);
+            data.cut[0] = static_cast<GLfloat>(cos(border_in_));
+            data.cut[1] = static_cast<GLfloat>(cos(border_out_));
+            LightData::copy(direction_, data.direction);
+            LightData::copy(position, data.position);
+            LightData::copy(get_light_space_matrix(), data.light_space);
+            return data;
+        }
 
-            std::string name = "lights[" + std::to_string(id) + "].";
-            set_light_uniforms(name, shader);
-
-            shader.set_uniform_i((name + "type").c_str(), LIGHT_TYPE);
-            shader.set_uniform_f((name + "constant").c_str(), static_cast<GLfloat>(constant_));
-            shader.set_uniform_f((name + "linear").c_str(), static_cast<GLfloat>(linear_));
-            shader.set_uniform_f((name + "quadratic").c_str(), static_cast<GLfloat>(quadratic_));
-            shader.set_uniform_f((name + "cut_in").c_str(), static_cast<GLfloat>(cos(border_in_)));
-            shader.set_uniform_f((name + "cut_out").c_str(), static_cast<GLfloat>(cos(border_out_)));
-            shader.set_uniform_f((name + "direction").c_str(), direction_);
-            shader.set_uniform_f((name + "position").c_str(), position);
-            if (shadow) {
-                shader.set_uniform_matrix((name + "light_space").c_str(), get_light_space_matrix());
-            }
+        // Sphere around the light position, the cone is not taken into account
+        bool get_bounding_sphere(Vec3& center, double& radius) const override {
+            center = position;
+            return get_range(constant_, linear_, quadratic_, radius);
         }
 
         SpotLight& set_shadow_distance(double shadow_min_distance, double shadow_max_distance) {
@@ -0,0 +1,18 @@
+#version 430 core
+
+
+out vec4 color;
+
+uniform sampler2D screen_texture;
+uniform sampler2D accumulation_texture;
+uniform sampler2D revealage_texture;
+
+
+#include "../Include/Transparency.glsl"
+
+
+void main() {
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+    vec3 opaque_color = texelFetch(screen_texture, pos, 0).rgb;
+    color = vec4(compose_transparency(opaque_color, texelFetch(accumulation_texture, pos, 0), texelFetch(revealage_texture, pos, 0).r), 1.0);
+}
\ No newline at end of file
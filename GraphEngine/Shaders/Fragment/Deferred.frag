@@ -0,0 +1,47 @@
+#version 430 core
+
+
+in vec2 tex_coord;
+
+out vec4 color;
+
+uniform float gamma;
+uniform mat4 inverse_view_projection;
+uniform sampler2D ambient_texture;
+uniform sampler2D diffuse_texture;
+uniform sampler2D specular_texture;
+uniform sampler2D emission_texture;
+uniform sampler2D normal_texture;
+uniform sampler2D depth_texture;
+
+vec3 frag_pos;
+
+#include "../Include/Lights.glsl"
+
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(depth_texture, texel, 0).r;
+    if (depth == 1.0)
+        discard;
+
+    vec4 position = inverse_view_projection * vec4(tex_coord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    frag_pos = position.xyz / position.w;
+
+    vec4 ambient = texelFetch(ambient_texture, texel, 0);
+    vec4 specular = texelFetch(specular_texture, texel, 0);
+    Material material;
+    material.shadow = ambient.a > 0.5;
+    material.use_vertex_color = false;
+    material.shininess = specular.a;
+    material.alpha = 1.0;
+    material.ambient = ambient.rgb;
+    material.diffuse = texelFetch(diffuse_texture, texel, 0).rgb;
+    material.specular = specular.rgb;
+    material.emission = texelFetch(emission_texture, texel, 0).rgb;
+
+    vec3 normal = decode_normal(texelFetch(normal_texture, texel, 0).xy);
+    vec3 view_dir = normalize(view_pos - frag_pos);
+
+    color = vec4(pow(calc_lights(normal, view_dir, material) + material.emission, vec3(1.0 / gamma)), 1.0);
+}
\ No newline at end of file
@@ -1,21 +1,13 @@
 #version 430 core
 
-const int NR_LIGHTS = 3;
 const int NR_CAMERAS = 2;
 
 
-struct Light {
-    bool shadow;
-    int type;
-    float constant, linear, quadratic, cut_in, cut_out;
-    vec3 position, direction, ambient, diffuse, specular;
-    mat4 light_space;
-};
-
-struct Material {
-    bool shadow, use_vertex_color;
+struct DrawData {
+    vec4 ambient, diffuse, specular, emission;
+    vec4 position_offset, position_scale;
     float shininess, alpha;
-    vec3 ambient, diffuse, specular, emission;
+    int object_id, flags;
 };
 
 
@@ -24,24 +16,33 @@ in vec3 frag_pos;
 in vec3 norm;
 in vec3 vert_color;
 in float object_model_id;
+flat in int draw_index;
+
+layout(location = 0) out vec4 color;
+layout(location = 1) out vec4 revealage;
+// Targets of the deferred geometry pass, the lighting pass reads them instead of shading every fragment
+layout(location = 2) out vec4 geometry_ambient;
+layout(location = 3) out vec4 geometry_diffuse;
+layout(location = 4) out vec4 geometry_specular;
+layout(location = 5) out vec4 geometry_emission;
+layout(location = 6) out vec2 geometry_normal;
 
-out vec4 color;
+#include "../Include/Lights.glsl"
 
 uniform bool use_diffuse_map;
 uniform bool use_specular_map;
 uniform bool use_emission_map;
+uniform bool indirect_draw;
+uniform bool weighted_transparency;
+uniform bool deferred_geometry;
 uniform int object_id;
 uniform int camera_id;
-uniform int number_lights;
 uniform float gamma;
 uniform sampler2D diffuse_map;
 uniform sampler2D specular_map;
 uniform sampler2D emission_map;
-uniform sampler2DArray shadow_maps;
 uniform vec2 check_point;
-uniform vec3 view_pos;
 uniform Material object_material;
-uniform Light lights[NR_LIGHTS];
 
 
 layout(std430, binding=0) buffer central_object {
@@ -50,109 +51,34 @@ layout(std430, binding=0) buffer central_object {
     float depth[NR_CAMERAS];
 };
 
+layout(std430, binding=1) readonly buffer draw_data_buffer {
+    DrawData draw_data[];
+};
 
-float calc_shadow(Light light, vec3 light_dir, vec3 normal, int id) {
-    if (!light.shadow)
-        return 0.0;
-
-    float bias = 0.01;
-    
-    vec4 frag_pos_light_space = light.light_space * vec4(frag_pos, 1.0);
-    frag_pos_light_space = frag_pos_light_space / frag_pos_light_space.w;
-    vec3 proj_coords = vec3(frag_pos_light_space) * 0.5 + 0.5;
-    float current_depth = proj_coords.z;
-
-    if(proj_coords.z > 1.0)
-        return 0.0;
-
-    float shadow = 0.0;
-    vec2 texel_size = 1.0 / textureSize(shadow_maps, 0).xy;
-    for (int x = -1; x <= 1; ++x) {
-        for(int y = -1; y <= 1; ++y) {
-            float pcf_depth = texture(shadow_maps, vec3(proj_coords.xy + vec2(x, y) * texel_size, id)).r;
-            shadow += current_depth - bias > pcf_depth ? 1.0 : 0.0;
-        }
-    }
-
-    return shadow / 9.0;
-}
-
-
-vec3 calc_dir_light(Light light, vec3 normal, vec3 view_dir, Material material, int id) {
-    vec3 light_dir = normalize(-light.direction);
-    float diff = max(dot(normal, light_dir), 0.0);
-
-    vec3 halfway_dir = normalize(light_dir + view_dir);
-    float spec = pow(max(dot(normal, halfway_dir), 0.0), material.shininess);
-
-    float shadow = material.shadow ? calc_shadow(light, light_dir, normal, id) : 0.0;
-    vec3 ambient = light.ambient * material.ambient;
-    vec3 diffuse = light.diffuse * diff * material.diffuse;
-    vec3 specular = light.specular * spec * material.specular;
-
-    if (dot(light_dir, normal) < 0.0)
-        return ambient;
-
-    return ambient + (1.0 - shadow) * (diffuse + specular);
-}
-
-
-vec3 calc_point_light(Light light, vec3 normal, vec3 view_dir, Material material, int id) {
-    vec3 light_dir = normalize(light.position - frag_pos);
-
-    float diff = max(dot(normal, light_dir), 0.0);
-
-    vec3 halfway_dir = normalize(light_dir + view_dir);
-    float spec = pow(max(dot(normal, halfway_dir), 0.0), material.shininess);
-
-    float distance = length(light.position - frag_pos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    
-    vec3 ambient = light.ambient * material.ambient * attenuation;
-    vec3 diffuse = light.diffuse * diff * material.diffuse * attenuation;
-    vec3 specular = light.specular * spec * material.specular * attenuation;
-
-    if (dot(light_dir, normal) < 0.0)
-        return ambient;
-
-    return ambient + diffuse + specular;
-}
-
-
-vec3 calc_spot_light(Light light, vec3 normal, vec3 view_dir, Material material, int id) {
-    vec3 light_dir = normalize(light.position - frag_pos);
-    float diff = max(dot(normal, light_dir), 0.0);
-
-    vec3 halfway_dir = normalize(light_dir + view_dir);
-    float spec = pow(max(dot(normal, halfway_dir), 0.0), material.shininess);
-
-    float distance = length(light.position - frag_pos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-
-    float theta = dot(light_dir, normalize(-light.direction));
-    float intensity = clamp((theta - light.cut_out) / (light.cut_in - light.cut_out), 0.0, 1.0);    
-    
-    float shadow = material.shadow ? calc_shadow(light, light_dir, normal, id) : 0.0;
-    vec3 ambient = light.ambient * material.ambient * attenuation;
-    vec3 diffuse = light.diffuse * diff * material.diffuse * attenuation * intensity;
-    vec3 specular = light.specular * spec * material.specular * attenuation * intensity;
-
-    if (dot(light_dir, normal) < 0.0)
-        return ambient;
-
-    return ambient + (1.0 - shadow) * (diffuse + specular);
+Material get_draw_material(DrawData data) {
+    Material material;
+    material.shadow = (data.flags & 1) != 0;
+    material.use_vertex_color = (data.flags & 2) != 0;
+    material.shininess = data.shininess;
+    material.alpha = data.alpha;
+    material.ambient = data.ambient.xyz;
+    material.diffuse = data.diffuse.xyz;
+    material.specular = data.specular.xyz;
+    material.emission = data.emission.xyz;
+    return material;
 }
 
 
 void main() {
+    int current_object_id = indirect_draw ? draw_data[draw_index].object_id : object_id;
     if (abs(gl_FragCoord.x - check_point.x) <= 1 && abs(gl_FragCoord.y - check_point.y) <= 1 && gl_FragCoord.z < depth[camera_id]) {
-        central_object_id[camera_id] = object_id;
+        central_object_id[camera_id] = current_object_id;
         central_object_model_id[camera_id] = int(object_model_id);
         depth[camera_id] = gl_FragCoord.z;
     }
 
-    Material material = object_material;
-    if (object_material.use_vertex_color) {
+    Material material = indirect_draw ? get_draw_material(draw_data[draw_index]) : object_material;
+    if (material.use_vertex_color) {
 		material.ambient = vert_color;
         material.diffuse = vert_color;
     }
@@ -171,20 +97,24 @@ void main() {
         discard;
 
     vec3 normal = normalize(norm);
+    if (deferred_geometry) {
+        geometry_ambient = vec4(material.ambient, material.shadow ? 1.0 : 0.0);
+        geometry_diffuse = vec4(material.diffuse, 1.0);
+        geometry_specular = vec4(material.specular, material.shininess);
+        geometry_emission = vec4(material.emission, 1.0);
+        geometry_normal = encode_normal(normal);
+        return;
+    }
+
     vec3 view_dir = normalize(view_pos - frag_pos);
 
-    vec3 result_color = vec3(0.0);
-    for(int i = 0; i < NR_LIGHTS; i++) {
-        if (i == number_lights)
-            break;
-
-        if (lights[i].type == 0)
-  	        result_color += calc_dir_light(lights[i], normal, view_dir, material, i);
-        else if (lights[i].type == 1)
-            result_color += calc_point_light(lights[i], normal, view_dir, material, i);
-        else
-            result_color += calc_spot_light(lights[i], normal, view_dir, material, i);
-    }
+    vec3 result_color = calc_lights(normal, view_dir, material);
 
     color = vec4(pow(result_color + material.emission, vec3(1.0 / gamma)), material.alpha);
+    if (weighted_transparency) {
+        // Weighted blended order independent transparency, accumulation and revealage are composed in the post pass
+        float weight = clamp(pow(min(1.0, color.a * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+        revealage = vec4(color.a);
+        color = vec4(color.rgb * color.a, color.a) * weight;
+    }
 }
@@ -0,0 +1,20 @@
+#version 430 core
+
+
+out vec4 color;
+
+uniform ivec2 direction;
+uniform ivec2 image_size;
+uniform float weights[3];
+uniform sampler2D input_texture;
+
+
+void main() {
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+
+    vec3 frag_color = vec3(0.0);
+    for (int i = -1; i <= 1; i++)
+        frag_color += texelFetch(input_texture, clamp(pos + i * direction, ivec2(0), image_size - 1), 0).rgb * weights[i + 1];
+
+    color = vec4(frag_color, 1.0);
+}
\ No newline at end of file
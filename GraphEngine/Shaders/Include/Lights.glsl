@@ -0,0 +1,207 @@
+// Lighting of a surface point by lights of its cluster, frag_pos in world space is declared by the including shader
+
+const int NR_CASCADES = 4;
+
+
+// Attenuation stores constant, linear and quadratic coefficients, cut stores cosines of the internal and external angles, shadow_bias stores constant and slope scaled bias
+struct Light {
+    vec4 position, direction, ambient, diffuse, specular, attenuation, cut, shadow_bias;
+    int type, shadow, cascades, shadow_kernel;
+    mat4 light_space;
+    mat4 cascade_spaces[NR_CASCADES];
+    vec4 shadow_tiles[NR_CASCADES];
+};
+
+struct Material {
+    bool shadow, use_vertex_color;
+    float shininess, alpha;
+    vec3 ambient, diffuse, specular, emission;
+};
+
+
+uniform ivec3 cluster_size;
+uniform vec2 cluster_distance;
+uniform vec3 view_pos;
+uniform vec3 cluster_direction;
+uniform mat4 view_projection;
+uniform sampler2DShadow shadow_atlas;
+
+
+layout(std430, binding=9) readonly buffer lights_buffer {
+    Light lights[];
+};
+
+// Offset and number of light indices of every cluster
+layout(std430, binding=10) readonly buffer clusters_buffer {
+    uvec2 clusters[];
+};
+
+layout(std430, binding=11) readonly buffer light_indices_buffer {
+    uint light_indices[];
+};
+
+
+const vec2 POISSON_DISK[16] = vec2[] (
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725), vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464), vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420), vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590), vec2(0.19984126, 0.78641304), vec2(0.14383161, -0.14100790)
+);
+
+
+float calc_shadow(int id, vec3 light_dir, vec3 normal) {
+    if (lights[id].shadow == 0)
+        return 0.0;
+
+    float cos_angle = clamp(dot(normal, light_dir), 0.1, 1.0);
+    float bias = lights[id].shadow_bias.x + lights[id].shadow_bias.y * sqrt(1.0 - cos_angle * cos_angle) / cos_angle;
+    vec2 texel_size = 1.0 / textureSize(shadow_atlas, 0);
+    
+    // The first cascade containing the fragment with its filter border is used
+    int cascade = 0;
+    vec4 frag_pos_light_space = lights[id].light_space * vec4(frag_pos, 1.0);
+    for (; cascade < lights[id].cascades; ++cascade) {
+        frag_pos_light_space = lights[id].cascade_spaces[cascade] * vec4(frag_pos, 1.0);
+        vec3 cascade_coords = frag_pos_light_space.xyz * 0.5 + 0.5;
+        vec4 tile = lights[id].shadow_tiles[cascade];
+        if (all(greaterThan(cascade_coords.xy, tile.xy + 2.0 * texel_size)) && all(lessThan(cascade_coords.xy, tile.zw - 2.0 * texel_size)) && cascade_coords.z <= 1.0)
+            break;
+    }
+    if (lights[id].cascades > 0 && cascade == lights[id].cascades)
+        return 0.0;
+
+    frag_pos_light_space = frag_pos_light_space / frag_pos_light_space.w;
+    vec3 proj_coords = vec3(frag_pos_light_space) * 0.5 + 0.5;
+    float current_depth = proj_coords.z - bias;
+    vec4 tile = lights[id].shadow_tiles[cascade];
+
+    if(proj_coords.z > 1.0 || any(lessThan(proj_coords.xy, tile.xy)) || any(greaterThan(proj_coords.xy, tile.zw)))
+        return 0.0;
+
+    // Every tap is a bilinear comparison, samples are clamped to the tile of the light
+    vec2 tile_min = tile.xy + 0.5 * texel_size;
+    vec2 tile_max = tile.zw - 0.5 * texel_size;
+    int count_taps = lights[id].shadow_kernel;
+    float lit = 0.0;
+    for (int i = 0; i < count_taps; ++i) {
+        vec2 offset = vec2(0.0);
+        if (count_taps == 4)
+            offset = vec2((i & 1) == 0 ? -0.5 : 0.5, (i & 2) == 0 ? -0.5 : 0.5);
+        else if (count_taps == 16)
+            offset = 1.5 * POISSON_DISK[i];
+        lit += texture(shadow_atlas, vec3(clamp(proj_coords.xy + offset * texel_size, tile_min, tile_max), current_depth));
+    }
+
+    return 1.0 - lit / float(count_taps);
+}
+
+
+vec3 calc_dir_light(int id, vec3 normal, vec3 view_dir, Material material) {
+    vec3 light_dir = normalize(-lights[id].direction.xyz);
+    float diff = max(dot(normal, light_dir), 0.0);
+
+    vec3 halfway_dir = normalize(light_dir + view_dir);
+    float spec = pow(max(dot(normal, halfway_dir), 0.0), material.shininess);
+
+    float shadow = material.shadow ? calc_shadow(id, light_dir, normal) : 0.0;
+    vec3 ambient = lights[id].ambient.xyz * material.ambient;
+    vec3 diffuse = lights[id].diffuse.xyz * diff * material.diffuse;
+    vec3 specular = lights[id].specular.xyz * spec * material.specular;
+
+    if (dot(light_dir, normal) < 0.0)
+        return ambient;
+
+    return ambient + (1.0 - shadow) * (diffuse + specular);
+}
+
+
+vec3 calc_point_light(int id, vec3 normal, vec3 view_dir, Material material) {
+    vec3 light_dir = normalize(lights[id].position.xyz - frag_pos);
+
+    float diff = max(dot(normal, light_dir), 0.0);
+
+    vec3 halfway_dir = normalize(light_dir + view_dir);
+    float spec = pow(max(dot(normal, halfway_dir), 0.0), material.shininess);
+
+    float distance = length(lights[id].position.xyz - frag_pos);
+    float attenuation = 1.0 / (lights[id].attenuation.x + lights[id].attenuation.y * distance + lights[id].attenuation.z * (distance * distance));
+    
+    vec3 ambient = lights[id].ambient.xyz * material.ambient * attenuation;
+    vec3 diffuse = lights[id].diffuse.xyz * diff * material.diffuse * attenuation;
+    vec3 specular = lights[id].specular.xyz * spec * material.specular * attenuation;
+
+    if (dot(light_dir, normal) < 0.0)
+        return ambient;
+
+    return ambient + diffuse + specular;
+}
+
+
+vec3 calc_spot_light(int id, vec3 normal, vec3 view_dir, Material material) {
+    vec3 light_dir = normalize(lights[id].position.xyz - frag_pos);
+    float diff = max(dot(normal, light_dir), 0.0);
+
+    vec3 halfway_dir = normalize(light_dir + view_dir);
+    float spec = pow(max(dot(normal, halfway_dir), 0.0), material.shininess);
+
+    float distance = length(lights[id].position.xyz - frag_pos);
+    float attenuation = 1.0 / (lights[id].attenuation.x + lights[id].attenuation.y * distance + lights[id].attenuation.z * (distance * distance));
+
+    float theta = dot(light_dir, normalize(-lights[id].direction.xyz));
+    float intensity = clamp((theta - lights[id].cut.y) / (lights[id].cut.x - lights[id].cut.y), 0.0, 1.0);    
+    
+    float shadow = material.shadow ? calc_shadow(id, light_dir, normal) : 0.0;
+    vec3 ambient = lights[id].ambient.xyz * material.ambient * attenuation;
+    vec3 diffuse = lights[id].diffuse.xyz * diff * material.diffuse * attenuation * intensity;
+    vec3 specular = lights[id].specular.xyz * spec * material.specular * attenuation * intensity;
+
+    if (dot(light_dir, normal) < 0.0)
+        return ambient;
+
+    return ambient + (1.0 - shadow) * (diffuse + specular);
+}
+
+
+// Depth slices grow exponentially from the near to the far plane, as in LightClusters
+uvec2 get_cluster() {
+    vec4 clip_pos = view_projection * vec4(frag_pos, 1.0);
+    vec2 screen_pos = clip_pos.xy / clip_pos.w * 0.5 + 0.5;
+    float depth = max(dot(frag_pos - view_pos, cluster_direction), cluster_distance.x);
+    int slice = int(log(depth / cluster_distance.x) / log(cluster_distance.y / cluster_distance.x) * float(cluster_size.z));
+
+    ivec3 cell = clamp(ivec3(ivec2(screen_pos * vec2(cluster_size.xy)), slice), ivec3(0), cluster_size - 1);
+    return clusters[(cell.z * cluster_size.y + cell.y) * cluster_size.x + cell.x];
+}
+
+
+// Octahedral encoding of unit normals for the geometry buffer
+vec2 encode_normal(vec3 normal) {
+    vec2 result = normal.xy / (abs(normal.x) + abs(normal.y) + abs(normal.z));
+    if (normal.z < 0.0)
+        result = (1.0 - abs(result.yx)) * vec2(result.x >= 0.0 ? 1.0 : -1.0, result.y >= 0.0 ? 1.0 : -1.0);
+    return result;
+}
+
+
+vec3 decode_normal(vec2 value) {
+    vec3 normal = vec3(value, 1.0 - abs(value.x) - abs(value.y));
+    float offset = max(-normal.z, 0.0);
+    normal.xy += vec2(normal.x >= 0.0 ? -offset : offset, normal.y >= 0.0 ? -offset : offset);
+    return normalize(normal);
+}
+
+
+vec3 calc_lights(vec3 normal, vec3 view_dir, Material material) {
+    vec3 result_color = vec3(0.0);
+    uvec2 cluster = get_cluster();
+    for(uint i = cluster.x; i < cluster.x + cluster.y; i++) {
+        int id = int(light_indices[i]);
+        if (lights[id].type == 0)
+  	        result_color += calc_dir_light(id, normal, view_dir, material);
+        else if (lights[id].type == 1)
+            result_color += calc_point_light(id, normal, view_dir, material);
+        else
+            result_color += calc_spot_light(id, normal, view_dir, material);
+    }
+    return result_color;
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+// Weighted blended transparency over the opaque color
+vec3 compose_transparency(vec3 opaque_color, vec4 accumulation, float revealage) {
+    if (revealage >= 1.0)
+        return opaque_color;
+
+    vec3 transparent_color = accumulation.rgb / clamp(accumulation.a, 1e-4, 5e4);
+    return mix(transparent_color, opaque_color, revealage);
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 430 core
+
+
+layout (location = 0) in vec3 position;
+layout (location = 4) in mat4 model;
+
+uniform mat4 view_projection;
+uniform vec3 bounding_min;
+uniform vec3 bounding_max;
+
+
+void main() {
+    gl_Position = view_projection * model * vec4(mix(bounding_min, bounding_max, position), 1.0);
+}
@@ -1,12 +1,42 @@
 #version 430 core
+#extension GL_ARB_shader_draw_parameters : enable
+
+
+struct DrawData {
+    vec4 ambient, diffuse, specular, emission;
+    vec4 position_offset, position_scale;
+    float shininess, alpha;
+    int object_id, flags;
+};
 
 
 layout (location = 0) in vec3 position;
 layout (location = 4) in mat4 model;
 
+uniform bool indirect_draw;
+uniform int draw_offset;
 uniform mat4 light_space;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
+
+layout(std430, binding=1) readonly buffer draw_data_buffer {
+    DrawData draw_data[];
+};
+
+// Matches Main.vert, so the depth pre-pass writes exactly the depth of the shading pass
+invariant gl_Position;
 
 
 void main() {
-    gl_Position = light_space * model * vec4(position, 1.0);
+    vec3 local_position = position * position_scale + position_offset;
+    if (indirect_draw) {
+#ifdef GL_ARB_shader_draw_parameters
+        int draw_index = draw_offset + gl_DrawIDARB;
+#else
+        int draw_index = draw_offset;
+#endif
+        local_position = position * draw_data[draw_index].position_scale.xyz + draw_data[draw_index].position_offset.xyz;
+    }
+    gl_Position = light_space * model * vec4(local_position, 1.0);
 }
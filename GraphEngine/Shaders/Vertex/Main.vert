@@ -1,4 +1,13 @@
 #version 430 core
+#extension GL_ARB_shader_draw_parameters : enable
+
+
+struct DrawData {
+    vec4 ambient, diffuse, specular, emission;
+    vec4 position_offset, position_scale;
+    float shininess, alpha;
+    int object_id, flags;
+};
 
 
 layout (location = 0) in vec3 position;
@@ -6,17 +15,31 @@ layout (location = 1) in vec3 vertex_normal;
 layout (location = 2) in vec2 texture_coord;
 layout (location = 3) in vec3 vertex_color;
 layout (location = 4) in mat4 instance_model;
+layout (location = 8) in float instance_model_id;
 
 out vec2 tex_coord;
 out vec3 frag_pos;
 out vec3 norm;
 out vec3 vert_color;
 out float object_model_id;
+flat out int draw_index;
 
+uniform bool indirect_draw;
+uniform bool use_instance_model_ids;
+uniform int draw_offset;
 uniform int model_id;
 uniform mat4 not_instance_model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 view_projection;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
+
+layout(std430, binding=1) readonly buffer draw_data_buffer {
+    DrawData draw_data[];
+};
+
+// Matches Depth.vert, so the depth pre-pass writes exactly the depth of the shading pass
+invariant gl_Position;
 
 
 void main() {
@@ -24,12 +47,22 @@ void main() {
     object_model_id = model_id;
     if (model_id == -1) {
         model = instance_model;
-        object_model_id = gl_InstanceID;
+        object_model_id = use_instance_model_ids ? instance_model_id : gl_InstanceID;
     }
 
-    gl_Position =  projection * view * model * vec4(position, 1.0);
+    vec3 local_position = position * position_scale + position_offset;
+    draw_index = 0;
+    if (indirect_draw) {
+#ifdef GL_ARB_shader_draw_parameters
+        draw_index = draw_offset + gl_DrawIDARB;
+#else
+        draw_index = draw_offset;
+#endif
+        local_position = position * draw_data[draw_index].position_scale.xyz + draw_data[draw_index].position_offset.xyz;
+    }
+    gl_Position = view_projection * model * vec4(local_position, 1.0);
     tex_coord = vec2(texture_coord.x, 1.0 - texture_coord.y);
-    frag_pos = vec3(model * vec4(position, 1.0f));
+    frag_pos = vec3(model * vec4(local_position, 1.0f));
     norm = transpose(inverse(mat3(model))) * vertex_normal;
     vert_color = vertex_color;
 }
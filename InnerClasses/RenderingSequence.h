@@ -192,6 +192,7 @@ class RenderingSequence {
 			if (!object->moved)
 				continue;
 
+			GRE_PROFILE_ZONE("RenderObject::update");
 			object->update();
 		}
 		for (RenderObject* object : objects) {
@@ -379,6 +380,7 @@ public:
 	}
 
 	void update(std::pair < int, int > cur_active_button) {
+		GRE_PROFILE_ZONE("RenderingSequence::update");
 		int cam_id = 0;
 
 		check_active_button(cur_active_button);
@@ -30,6 +30,20 @@ void screenshot(sf::RenderWindow& window) {
 }
 
 
+void draw_gpu_profile(sf::RenderWindow& window, const gre::GraphEngine& scene, const sf::Font& font) {
+    std::string profile = "GPU: " + std::to_string(scene.get_gpu_profiler().get_frame_time()) + " ms";
+    for (const gre::GpuProfiler::Scope& scope : scene.get_gpu_profiler().get_scopes()) {
+        char time[64];
+        snprintf(time, sizeof(time), "%.3f ms", scope.time);
+        profile += "\n" + std::string(4 * (scope.depth + 1), ' ') + scope.name + ": " + time;
+    }
+
+    sf::Text text(profile, font, 16);
+    text.setPosition(sf::Vector2f(0, 120));
+    window.draw(text);
+}
+
+
 signed main() {
     try {
         sf::RenderWindow window = gre::GraphEngine::create_fullscreen_window("Editor");
@@ -65,6 +79,8 @@ signed main() {
         gre::GraphEngine scene(&window);
         scene.set_clear_color(gre::Vec3(INTERFACE_MAIN_COLOR) / 255.0);
         scene.set_border_color(gre::Vec3(INTERFACE_ADD_COLOR) / 255.0);
+        scene.set_lod_selection(true);
+        scene.set_dynamic_resolution(true);
         scene.cameras[0].set_check_point(gre::Vec2(0.5, 0.5));
         scene.cameras[0].set_fov(FOV);
         scene.cameras[0].set_distance(MIN_DIST, MAX_DIST);
@@ -95,7 +111,7 @@ signed main() {
         RenderingSequence render(&scene);
 
         int obj_id = scene.objects.insert(gre::GraphObject(1));
-        scene.objects[obj_id].importFromFile("Resources/Objects/ships/mjolnir.glb");
+        scene.objects[obj_id].importFromFile("Resources/Objects/ships/mjolnir.glb", gre::VertexQuantization::FLOAT_ATTRIBUTES, 4);
         int model_id = scene.objects[obj_id].models.insert(gre::Matrix::scale_matrix(gre::Vec3(-1, 1, 1)) * gre::Matrix::translation_matrix(gre::Vec3(0, -0.5, 5)) * gre::Matrix::rotation_matrix(gre::Vec3(0, 1, 0), gre::PI));
         render.add_object(new Object({ obj_id, model_id }, &scene));
         //scene.objects[obj_id].importFromFile("Resources/Objects/maps/system_velorum_position_processing_rig.glb");
@@ -119,7 +135,9 @@ signed main() {
         arial.loadFromFile("Interface/Resources/Fonts/arial.ttf");
 
         for (; window_interface.running;) {
+            GRE_PROFILE_ZONE("frame");
             for (sf::Event event; window.pollEvent(event); ) {
+                GRE_PROFILE_ZONE("event");
                 switch (event.type) {
                 case sf::Event::Closed: {
                     window_interface.running = false;
@@ -131,6 +149,12 @@ signed main() {
                         scene.cameras.switch_active();
                     } else if (event.key.code == sf::Keyboard::F11) {
                         screenshot(window);
+                    } else if (event.key.code == sf::Keyboard::F10) {
+                        GRE_PROFILE_SAVE("Resources/cpu_trace.json");
+                    } else if (event.key.code == sf::Keyboard::L) {
+                        scene.set_lod_selection(!scene.get_lod_selection());
+                    } else if (event.key.code == sf::Keyboard::P) {
+                        scene.set_gpu_profiling(!scene.get_gpu_profiling());
                     } else if (event.key.code == sf::Keyboard::F) {
                         if (spot_light_id0 == -1)
                             spot_light_id0 = scene.lights.insert(&spot_light0);
@@ -162,7 +186,9 @@ signed main() {
 
             window.pushGLStates();
 
-            window.draw(sf::Text("FPS: " + std::to_string(scene.cameras[0].get_fps()), arial));
+            window.draw(sf::Text("FPS: " + std::to_string(scene.cameras[0].get_fps()) + "\nTriangles: " + std::to_string(scene.get_count_triangles()) + (scene.get_lod_selection() ? " (LOD)" : "") + "\nRender scale: " + std::to_string(static_cast<int>(std::round(100.0 * scene.get_render_scale()))) + "%", arial));
+            if (scene.get_gpu_profiling())
+                draw_gpu_profile(window, scene, arial);
 
             window.draw(window_interface);
             int cross_state = render.get_cross_state();